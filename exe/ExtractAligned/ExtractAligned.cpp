@@ -0,0 +1,196 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltrušaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltrušaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltrušaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltrušaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// ExtractAligned.cpp : Defines the entry point for the console application for extracting faces from an aligned face archive (written with -simalign_archive).
+
+#include <AlignedArchive.h>
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+// System includes
+#include <cstdio>
+#include <iostream>
+
+std::vector<std::string> get_arguments(int argc, char **argv)
+{
+
+	std::vector<std::string> arguments;
+
+	for (int i = 0; i < argc; ++i)
+	{
+		arguments.push_back(std::string(argv[i]));
+	}
+	return arguments;
+}
+
+int main(int argc, char **argv)
+{
+
+	//Convert arguments to more convenient vector form
+	std::vector<std::string> arguments = get_arguments(argc, argv);
+
+	// no arguments: output usage
+	if (arguments.size() == 1)
+	{
+		std::cout << "Usage: ExtractAligned -f <archive> [-out_dir <directory>] [-format <image format>] [-frame <frame number>] [-face <face id>] [-nobadaligned] [-list]" << std::endl;
+		std::cout << " -list prints the index of the archive (frame, face id, success, offset, size) instead of extracting the faces" << std::endl;
+		return 0;
+	}
+
+	std::string archive_file;
+	std::string out_dir;
+	std::string format;
+	int frame_number = -1;
+	int face_id = -1;
+	bool record_bad = true;
+	bool list = false;
+
+	for (size_t i = 1; i < arguments.size(); ++i)
+	{
+		if (arguments[i].compare("-f") == 0 && i + 1 < arguments.size())
+		{
+			archive_file = arguments[i + 1];
+			i++;
+		}
+		else if (arguments[i].compare("-out_dir") == 0 && i + 1 < arguments.size())
+		{
+			out_dir = arguments[i + 1];
+			i++;
+		}
+		else if (arguments[i].compare("-format") == 0 && i + 1 < arguments.size())
+		{
+			format = arguments[i + 1];
+			i++;
+		}
+		else if (arguments[i].compare("-frame") == 0 && i + 1 < arguments.size())
+		{
+			frame_number = std::stoi(arguments[i + 1]);
+			i++;
+		}
+		else if (arguments[i].compare("-face") == 0 && i + 1 < arguments.size())
+		{
+			face_id = std::stoi(arguments[i + 1]);
+			i++;
+		}
+		else if (arguments[i].compare("-nobadaligned") == 0)
+		{
+			record_bad = false;
+		}
+		else if (arguments[i].compare("-list") == 0)
+		{
+			list = true;
+		}
+	}
+
+	Utilities::AlignedArchiveReader archive;
+	if (archive_file.empty() || !archive.Open(archive_file))
+	{
+		std::cout << "Could not open the aligned face archive " << archive_file << std::endl;
+		return 1;
+	}
+
+	if (list)
+	{
+		std::cout << "frame, face_id, success, offset, size" << std::endl;
+		for (size_t i = 0; i < archive.NumberOfFaces(); ++i)
+		{
+			const Utilities::AlignedArchiveEntry& entry = archive.GetEntry(i);
+			std::cout << entry.frame_number << ", " << entry.face_id << ", " << entry.success << ", " << entry.offset << ", " << entry.size << std::endl;
+		}
+		return 0;
+	}
+
+	// By default output next to the archive, in the same way as -simalign would have
+	if (out_dir.empty())
+	{
+		out_dir = archive_file.substr(0, archive_file.find_last_of('.'));
+	}
+	cv::utils::fs::createDirectories(out_dir);
+
+	// Raw faces have to be encoded in some image format
+	if (format.empty())
+	{
+		format = archive.GetFormat().compare("raw") == 0 ? "bmp" : archive.GetFormat();
+	}
+
+	int num_written = 0;
+	for (size_t i = 0; i < archive.NumberOfFaces(); ++i)
+	{
+		const Utilities::AlignedArchiveEntry& entry = archive.GetEntry(i);
+
+		if ((frame_number >= 0 && entry.frame_number != frame_number) || (face_id >= 0 && entry.face_id != face_id) || (!record_bad && !entry.success))
+		{
+			continue;
+		}
+
+		char name[100];
+		std::sprintf(name, "frame_det_%02d_%06d.", entry.face_id, entry.frame_number);
+		std::string out_file = cv::utils::fs::join(out_dir, std::string(name) + format);
+
+		bool write_success = false;
+		if (format.compare(archive.GetFormat()) == 0)
+		{
+			// Already in the right format, no need to decode and encode again
+			std::vector<uchar> data;
+			if (archive.ReadData(i, data))
+			{
+				FILE* out = std::fopen(out_file.c_str(), "wb");
+				if (out)
+				{
+					write_success = std::fwrite(data.data(), 1, data.size(), out) == data.size();
+					std::fclose(out);
+				}
+			}
+		}
+		else
+		{
+			cv::Mat aligned_face;
+			write_success = archive.Read(i, aligned_face) && cv::imwrite(out_file, aligned_face);
+		}
+
+		if (!write_success)
+		{
+			std::cout << "Could not extract " << out_file << std::endl;
+			continue;
+		}
+		num_written++;
+	}
+
+	std::cout << "Extracted " << num_written << " faces to " << out_dir << std::endl;
+
+	return 0;
+}
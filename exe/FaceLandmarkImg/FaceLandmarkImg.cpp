@@ -46,6 +46,14 @@
 #include <VisualizationUtils.h>
 #include <RecorderOpenFace.h>
 #include <RecorderOpenFaceParameters.h>
+#include <ServerJobs.h>
+
+// System includes
+#include <algorithm>
+#include <iostream>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 
 #ifndef CONFIG_DIR
@@ -64,6 +72,188 @@ std::vector<std::string> get_arguments(int argc, char **argv)
 	return arguments;
 }
 
+// Number of worker threads for batch processing of large image collections (-batch_workers <n>), 0 means serial processing
+int get_batch_workers(std::vector<std::string>& arguments)
+{
+	int num_workers = 0;
+
+	for (size_t i = 0; i < arguments.size(); ++i)
+	{
+		if (arguments[i].compare("-batch_workers") == 0 && i + 1 < arguments.size())
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> num_workers;
+			i++;
+		}
+	}
+
+	// Zero workers means use all of the cores
+	if (num_workers == 0 && std::find(arguments.begin(), arguments.end(), "-batch_workers") != arguments.end())
+	{
+		num_workers = std::max((int)std::thread::hardware_concurrency(), 1);
+	}
+
+	return num_workers;
+}
+
+// The arguments without the output name (-of), the recorder only uses it for the first image it records and the rest are named after their input
+std::vector<std::string> get_arguments_without_output_name(const std::vector<std::string>& arguments)
+{
+	std::vector<std::string> stripped = arguments;
+	for (size_t i = 0; i + 1 < stripped.size(); ++i)
+	{
+		if (stripped[i].compare("-of") == 0)
+		{
+			stripped.erase(stripped.begin() + i, stripped.begin() + i + 2);
+			break;
+		}
+	}
+	return stripped;
+}
+
+// The models and the fitting state needed to process an image, in batch mode every worker has its own copy
+// (the landmark detector copy shares the model weights with the original, but has its own fitting state)
+struct ImageWorker
+{
+	LandmarkDetector::CLNF face_model;
+	LandmarkDetector::FaceModelParameters det_parameters;
+	FaceAnalysis::FaceAnalyser face_analyser;
+
+	cv::CascadeClassifier classifier;
+	dlib::frontal_face_detector face_detector_hog;
+	LandmarkDetector::FaceDetectorMTCNN face_detector_mtcnn;
+
+	ImageWorker(const LandmarkDetector::CLNF& face_model, const LandmarkDetector::FaceModelParameters& det_parameters,
+		const FaceAnalysis::FaceAnalyserParameters& face_analysis_params, const LandmarkDetector::FaceDetectorMTCNN& face_detector_mtcnn) :
+		face_model(face_model), det_parameters(det_parameters), face_analyser(face_analysis_params), face_detector_mtcnn(face_detector_mtcnn)
+	{
+		classifier.load(det_parameters.haar_face_detector_location);
+		face_detector_hog = dlib::get_frontal_face_detector();
+	}
+};
+
+// Detect the faces and landmarks in an image, estimate pose, gaze and Action Units for every face and record the results,
+// returns the CSV file the results were written to (empty if no faces were found)
+std::string ProcessImage(ImageWorker& worker, const cv::Mat& rgb_image, cv::Mat_<uchar>& grayscale_image, const std::string& image_name,
+	bool has_bounding_boxes, const std::vector<cv::Rect_<float> >& bounding_boxes, float fx, float fy, float cx, float cy,
+	Utilities::Visualizer& visualizer, std::vector<std::string>& arguments)
+{
+	LandmarkDetector::CLNF& face_model = worker.face_model;
+	LandmarkDetector::FaceModelParameters& det_parameters = worker.det_parameters;
+	FaceAnalysis::FaceAnalyser& face_analyser = worker.face_analyser;
+
+	Utilities::RecorderOpenFaceParameters recording_params(arguments, false, false, fx, fy, cx, cy);
+
+	if (!face_model.eye_model)
+	{
+		recording_params.setOutputGaze(false);
+	}
+	Utilities::RecorderOpenFace open_face_rec(image_name, recording_params, arguments);
+
+	visualizer.SetImage(rgb_image, fx, fy, cx, cy);
+
+	// Detect faces in an image
+	std::vector<cv::Rect_<float> > face_detections;
+
+	if (has_bounding_boxes)
+	{
+		face_detections = bounding_boxes;
+	}
+	else
+	{
+		if (det_parameters.curr_face_detector == LandmarkDetector::FaceModelParameters::HOG_SVM_DETECTOR)
+		{
+			std::vector<float> confidences;
+			LandmarkDetector::DetectFacesHOG(face_detections, grayscale_image, worker.face_detector_hog, confidences);
+		}
+		else if (det_parameters.curr_face_detector == LandmarkDetector::FaceModelParameters::HAAR_DETECTOR)
+		{
+			LandmarkDetector::DetectFaces(face_detections, grayscale_image, worker.classifier);
+		}
+		else
+		{
+			std::vector<float> confidences;
+			LandmarkDetector::DetectFacesMTCNN(face_detections, rgb_image, worker.face_detector_mtcnn, confidences);
+		}
+	}
+
+	// perform landmark detection for every face detected
+	for (size_t face = 0; face < face_detections.size(); ++face)
+	{
+
+		// if there are multiple detections go through them
+		bool success = LandmarkDetector::DetectLandmarksInImage(rgb_image, face_detections[face], face_model, det_parameters, grayscale_image);
+
+		// Everything derived from the fit (pose, 3D shape, eye landmarks and gaze) is computed once and shared by the visualization and the recording
+		LandmarkDetector::FaceResults face_results(face_model, fx, fy, cx, cy);
+
+		// Estimate head pose and eye gaze				
+		cv::Vec6d pose_estimate = face_results.Pose();
+
+		// Gaze tracking, absolute gaze direction
+		cv::Point3f gaze_direction0(0, 0, -1);
+		cv::Point3f gaze_direction1(0, 0, -1);
+		cv::Vec2f gaze_angle(0, 0);
+
+		if (face_model.eye_model)
+		{
+			GazeAnalysis::EstimateGaze(face_results);
+			gaze_direction0 = face_results.GazeDirection0();
+			gaze_direction1 = face_results.GazeDirection1();
+			gaze_angle = face_results.GazeAngle();
+		}
+
+		cv::Mat sim_warped_img;
+		cv::Mat_<double> hog_descriptor; int num_hog_rows = 0, num_hog_cols = 0;
+
+		// Perform AU detection and HOG feature extraction, as this can be expensive only compute it if needed by output or visualization
+		if (recording_params.outputAlignedFaces() || recording_params.outputHOG() || recording_params.outputAUs() || visualizer.vis_align || visualizer.vis_hog)
+		{
+			face_analyser.PredictStaticAUsAndComputeFeatures(rgb_image, face_model.detected_landmarks);
+			face_analyser.GetLatestAlignedFace(sim_warped_img);
+			face_analyser.GetLatestHOG(hog_descriptor, num_hog_rows, num_hog_cols);
+		}
+
+		// Displaying the tracking visualizations
+		visualizer.SetObservationFaceAlign(sim_warped_img);
+		visualizer.SetObservationHOG(hog_descriptor, num_hog_rows, num_hog_cols);
+		visualizer.SetObservationLandmarks(face_model.detected_landmarks, 1.0, face_results.Visibilities()); // Set confidence to high to make sure we always visualize
+		visualizer.SetObservationPose(pose_estimate, 1.0);
+		visualizer.SetObservationGaze(gaze_direction0, gaze_direction1, face_results.EyeLandmarks2D(), face_results.EyeLandmarks3D(), face_model.detection_certainty);
+		visualizer.SetObservationActionUnits(face_analyser.GetCurrentAUsReg(), face_analyser.GetCurrentAUsClass());
+
+		// Setting up the recorder output
+		open_face_rec.SetObservationHOG(face_model.detection_success, hog_descriptor, num_hog_rows, num_hog_cols, 31); // The number of channels in HOG is fixed at the moment, as using FHOG
+		open_face_rec.SetObservationActionUnits(face_analyser.GetCurrentAUsReg(), face_analyser.GetCurrentAUsClass());
+		open_face_rec.SetObservationLandmarks(face_model.detected_landmarks, face_results.Shape3D(),
+			face_model.params_global, face_model.params_local, face_model.detection_certainty, face_model.detection_success);
+		open_face_rec.SetObservationPose(pose_estimate);
+		open_face_rec.SetObservationGaze(gaze_direction0, gaze_direction1, gaze_angle, face_results.EyeLandmarks2D(), face_results.EyeLandmarks3D());
+		open_face_rec.SetObservationFaceAlign(sim_warped_img);
+		open_face_rec.SetObservationFaceID(face);
+		open_face_rec.WriteObservation();
+
+	}
+	if (face_detections.size() > 0)
+	{
+		visualizer.ShowObservation();
+	}
+
+	// Only draw the visualization if it is going to be recorded
+	if (recording_params.outputTracked())
+	{
+		open_face_rec.SetObservationVisualization(visualizer.GetVisImage());
+	}
+	open_face_rec.WriteObservationTracked();
+
+	open_face_rec.Close();
+
+	if (face_detections.empty())
+		return "";
+
+	return open_face_rec.GetCSVFile();
+}
+
 int main(int argc, char **argv)
 {
 
@@ -78,11 +268,23 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	int num_batch_workers = get_batch_workers(arguments);
+
+	// In server mode the images come with the jobs, and are not opened here
+	bool server_mode = std::find(arguments.begin(), arguments.end(), "-server") != arguments.end();
+
+	// In server mode the standard output only carries the replies to the jobs, all the other messages (from here and the libraries) go to the standard error
+	std::ostream protocol(std::cout.rdbuf());
+	if (server_mode)
+	{
+		std::cout.rdbuf(std::cerr.rdbuf());
+	}
+
 	// Prepare for image reading
 	Utilities::ImageCapture image_reader;
 
 	// The sequence reader chooses what to open based on command line arguments provided
-	if (!image_reader.Open(arguments))
+	if (!server_mode && !image_reader.Open(arguments))
 	{
 		std::cout << "Could not open any images" << std::endl;
 		return 1;
@@ -106,11 +308,8 @@ int main(int argc, char **argv)
 	// Load facial feature extractor and AU analyser (make sure it is static)
 	FaceAnalysis::FaceAnalyserParameters face_analysis_params(arguments);
 	face_analysis_params.OptimizeForImages();
-	FaceAnalysis::FaceAnalyser face_analyser(face_analysis_params);
 
 	// If bounding boxes not provided, use a face detector
-	cv::CascadeClassifier classifier(det_parameters.haar_face_detector_location);
-	dlib::frontal_face_detector face_detector_hog = dlib::get_frontal_face_detector();
 	LandmarkDetector::FaceDetectorMTCNN face_detector_mtcnn(det_parameters.mtcnn_face_detector_location);
 
 	// If can't find MTCNN face detector, default to HOG one
@@ -120,130 +319,148 @@ int main(int argc, char **argv)
 		det_parameters.curr_face_detector = LandmarkDetector::FaceModelParameters::HOG_SVM_DETECTOR;
 	}
 
-	// A utility for visualizing the results
-	Utilities::Visualizer visualizer(arguments);
-
-	cv::Mat rgb_image;
+	ImageWorker main_worker(face_model, det_parameters, face_analysis_params, face_detector_mtcnn);
 
-	rgb_image = image_reader.GetNextImage();
-	
 	if (!face_model.eye_model)
 	{
 		std::cout << "WARNING: no eye model found" << std::endl;
 	}
 
-	if (face_analyser.GetAUClassNames().size() == 0 && face_analyser.GetAUClassNames().size() == 0)
+	if (main_worker.face_analyser.GetAUClassNames().size() == 0 && main_worker.face_analyser.GetAUClassNames().size() == 0)
 	{
 		std::cout << "WARNING: no Action Unit models found" << std::endl;
 	}
 
-	std::cout << "Starting tracking" << std::endl;
-	while (!rgb_image.empty())
+	if (num_batch_workers > 0 && !server_mode)
 	{
-	
-		Utilities::RecorderOpenFaceParameters recording_params(arguments, false, false,
-			image_reader.fx, image_reader.fy, image_reader.cx, image_reader.cy);
-
-		if (!face_model.eye_model)
+		// Batch mode, every worker decodes and processes the next image that has not been taken yet, results of every image
+		// are written to their own output files so no merging is needed. Nothing is displayed, as windows can't be shown from several threads
+		std::cout << "Starting batch processing with " << num_batch_workers << " workers" << std::endl;
+
+		std::vector<ImageWorker> workers;
+		workers.reserve(num_batch_workers);
+		workers.push_back(std::move(main_worker));
+		for (int i = 1; i < num_batch_workers; ++i)
 		{
-			recording_params.setOutputGaze(false);
+			workers.push_back(ImageWorker(face_model, det_parameters, face_analysis_params, face_detector_mtcnn));
 		}
-		Utilities::RecorderOpenFace open_face_rec(image_reader.name, recording_params, arguments);
 
-		visualizer.SetImage(rgb_image, image_reader.fx, image_reader.fy, image_reader.cx, image_reader.cy);
-
-		// Making sure the image is in uchar grayscale (some face detectors use RGB, landmark detector uses grayscale)
-		cv::Mat_<uchar> grayscale_image = image_reader.GetGrayFrame();
+		std::atomic<size_t> next_image(0);
+		std::atomic<size_t> images_done(0);
+		size_t num_images = image_reader.NumberOfImages();
+		std::mutex progress_mutex;
 
-		// Detect faces in an image
-		std::vector<cv::Rect_<float> > face_detections;
+		// The recorder consumes the options it uses from the arguments it is given, so the workers never touch the shared ones and every image
+		// gets its own copy, as in the sequential mode only the first image gets the output name
+		const std::vector<std::string>& first_image_arguments = arguments;
+		const std::vector<std::string> other_image_arguments = get_arguments_without_output_name(arguments);
 
-		if (image_reader.has_bounding_boxes)
-		{
-			face_detections = image_reader.GetBoundingBoxes();
-		}
-		else
+		auto work = [&](ImageWorker& worker)
 		{
-			if (det_parameters.curr_face_detector == LandmarkDetector::FaceModelParameters::HOG_SVM_DETECTOR)
-			{
-				std::vector<float> confidences;
-				LandmarkDetector::DetectFacesHOG(face_detections, grayscale_image, face_detector_hog, confidences);
-			}
-			else if (det_parameters.curr_face_detector == LandmarkDetector::FaceModelParameters::HAAR_DETECTOR)
-			{
-				LandmarkDetector::DetectFaces(face_detections, grayscale_image, classifier);
-			}
-			else
+			// Only the tracked image is drawn, for recording
+			Utilities::Visualizer visualizer(false, false, false, false);
+
+			cv::Mat rgb_image;
+			cv::Mat_<uchar> grayscale_image;
+			std::string image_name;
+			std::vector<cv::Rect_<float> > bounding_boxes;
+			float fx, fy, cx, cy;
+			std::vector<std::string> image_arguments;
+
+			for (size_t image_index = next_image++; image_index < num_images; image_index = next_image++)
 			{
-				std::vector<float> confidences;
-				LandmarkDetector::DetectFacesMTCNN(face_detections, rgb_image, face_detector_mtcnn, confidences);
+				if (image_reader.ReadImage(image_index, rgb_image, grayscale_image, image_name, bounding_boxes, fx, fy, cx, cy))
+				{
+					image_arguments = image_index == 0 ? first_image_arguments : other_image_arguments;
+					ProcessImage(worker, rgb_image, grayscale_image, image_name, image_reader.has_bounding_boxes, bounding_boxes, fx, fy, cx, cy, visualizer, image_arguments);
+				}
+
+				size_t done = ++images_done;
+				if (done % 100 == 0 || done == num_images)
+				{
+					std::lock_guard<std::mutex> lock(progress_mutex);
+					std::cout << done << "/" << num_images << " images processed" << std::endl;
+				}
 			}
-		}
+		};
 
-		// Detect landmarks around detected faces
-		int face_det = 0;
-		// perform landmark detection for every face detected
-		for (size_t face = 0; face < face_detections.size(); ++face)
+		std::vector<std::thread> worker_threads;
+		for (int i = 0; i < num_batch_workers; ++i)
+		{
+			worker_threads.push_back(std::thread(work, std::ref(workers[i])));
+		}
+		for (size_t i = 0; i < worker_threads.size(); ++i)
 		{
+			worker_threads[i].join();
+		}
 
-			// if there are multiple detections go through them
-			bool success = LandmarkDetector::DetectLandmarksInImage(rgb_image, face_detections[face], face_model, det_parameters, grayscale_image);
+		return 0;
+	}
 
-			// Estimate head pose and eye gaze				
-			cv::Vec6d pose_estimate = LandmarkDetector::GetPose(face_model, image_reader.fx, image_reader.fy, image_reader.cx, image_reader.cy);
+	// A utility for visualizing the results
+	Utilities::Visualizer visualizer(arguments);
 
-			// Gaze tracking, absolute gaze direction
-			cv::Point3f gaze_direction0(0, 0, -1);
-			cv::Point3f gaze_direction1(0, 0, -1);
-			cv::Vec2f gaze_angle(0, 0);
+	if (server_mode)
+	{
+		// Every job is answered with an OUTPUT line per image with faces (the CSV file), an ERROR line if it could not be completed, and a DONE line once it is finished
+		protocol << "READY" << std::endl;
 
-			if (face_model.eye_model)
+		std::string executable = arguments[0];
+		while (Utilities::ReadJobArguments(std::cin, arguments, executable))
+		{
+			// A bad job (e.g. a missing directory or an unreadable image) should not stop the server
+			try
 			{
-				GazeAnalysis::EstimateGaze(face_model, gaze_direction0, image_reader.fx, image_reader.fy, image_reader.cx, image_reader.cy, true);
-				GazeAnalysis::EstimateGaze(face_model, gaze_direction1, image_reader.fx, image_reader.fy, image_reader.cx, image_reader.cy, false);
-				gaze_angle = GazeAnalysis::GetGazeAngle(gaze_direction0, gaze_direction1);
+				if (!image_reader.Open(arguments))
+				{
+					protocol << "ERROR Could not open any images" << std::endl;
+				}
+				else
+				{
+					for (cv::Mat rgb_image = image_reader.GetNextImage(); !rgb_image.empty(); rgb_image = image_reader.GetNextImage())
+					{
+						cv::Mat_<uchar> grayscale_image = image_reader.GetGrayFrame();
+
+						std::string csv_file = ProcessImage(main_worker, rgb_image, grayscale_image, image_reader.name, image_reader.has_bounding_boxes, image_reader.GetBoundingBoxes(),
+							image_reader.fx, image_reader.fy, image_reader.cx, image_reader.cy, visualizer, arguments);
+
+						if (!csv_file.empty())
+						{
+							protocol << "OUTPUT " << csv_file << std::endl;
+						}
+					}
+				}
 			}
-
-			cv::Mat sim_warped_img;
-			cv::Mat_<double> hog_descriptor; int num_hog_rows = 0, num_hog_cols = 0;
-
-			// Perform AU detection and HOG feature extraction, as this can be expensive only compute it if needed by output or visualization
-			if (recording_params.outputAlignedFaces() || recording_params.outputHOG() || recording_params.outputAUs() || visualizer.vis_align || visualizer.vis_hog)
+			catch (const std::exception& e)
+			{
+				// The message has to fit on the line
+				std::string message = e.what();
+				std::replace(message.begin(), message.end(), '\n', ' ');
+				protocol << "ERROR " << message << std::endl;
+			}
+			catch (...)
 			{
-				face_analyser.PredictStaticAUsAndComputeFeatures(rgb_image, face_model.detected_landmarks);
-				face_analyser.GetLatestAlignedFace(sim_warped_img);
-				face_analyser.GetLatestHOG(hog_descriptor, num_hog_rows, num_hog_cols);
+				protocol << "ERROR Unknown error" << std::endl;
 			}
+			protocol << "DONE" << std::endl;
+		}
 
-			// Displaying the tracking visualizations
-			visualizer.SetObservationFaceAlign(sim_warped_img);
-			visualizer.SetObservationHOG(hog_descriptor, num_hog_rows, num_hog_cols);
-			visualizer.SetObservationLandmarks(face_model.detected_landmarks, 1.0, face_model.GetVisibilities()); // Set confidence to high to make sure we always visualize
-			visualizer.SetObservationPose(pose_estimate, 1.0);
-			visualizer.SetObservationGaze(gaze_direction0, gaze_direction1, LandmarkDetector::CalculateAllEyeLandmarks(face_model), LandmarkDetector::Calculate3DEyeLandmarks(face_model, image_reader.fx, image_reader.fy, image_reader.cx, image_reader.cy), face_model.detection_certainty);
-			visualizer.SetObservationActionUnits(face_analyser.GetCurrentAUsReg(), face_analyser.GetCurrentAUsClass());
-
-			// Setting up the recorder output
-			open_face_rec.SetObservationHOG(face_model.detection_success, hog_descriptor, num_hog_rows, num_hog_cols, 31); // The number of channels in HOG is fixed at the moment, as using FHOG
-			open_face_rec.SetObservationActionUnits(face_analyser.GetCurrentAUsReg(), face_analyser.GetCurrentAUsClass());
-			open_face_rec.SetObservationLandmarks(face_model.detected_landmarks, face_model.GetShape(image_reader.fx, image_reader.fy, image_reader.cx, image_reader.cy),
-				face_model.params_global, face_model.params_local, face_model.detection_certainty, face_model.detection_success);
-			open_face_rec.SetObservationPose(pose_estimate);
-			open_face_rec.SetObservationGaze(gaze_direction0, gaze_direction1, gaze_angle, LandmarkDetector::CalculateAllEyeLandmarks(face_model), LandmarkDetector::Calculate3DEyeLandmarks(face_model, image_reader.fx, image_reader.fy, image_reader.cx, image_reader.cy));
-			open_face_rec.SetObservationFaceAlign(sim_warped_img);
-			open_face_rec.SetObservationFaceID(face);
-			open_face_rec.WriteObservation();
+		std::cout.rdbuf(protocol.rdbuf());
+		return 0;
+	}
 
-		}
-		if (face_detections.size() > 0)
-		{
-			visualizer.ShowObservation();
-		}
+	cv::Mat rgb_image;
 
-		open_face_rec.SetObservationVisualization(visualizer.GetVisImage());
-		open_face_rec.WriteObservationTracked();
+	rgb_image = image_reader.GetNextImage();
+
+	std::cout << "Starting tracking" << std::endl;
+	while (!rgb_image.empty())
+	{
+		// Making sure the image is in uchar grayscale (some face detectors use RGB, landmark detector uses grayscale)
+		cv::Mat_<uchar> grayscale_image = image_reader.GetGrayFrame();
 
-		open_face_rec.Close();
+		ProcessImage(main_worker, rgb_image, grayscale_image, image_reader.name, image_reader.has_bounding_boxes, image_reader.GetBoundingBoxes(),
+			image_reader.fx, image_reader.fy, image_reader.cx, image_reader.cy, visualizer, arguments);
 
 		// Grabbing the next frame in the sequence
 		rgb_image = image_reader.GetNextImage();
@@ -252,4 +469,3 @@ int main(int argc, char **argv)
 
 	return 0;
 }
-
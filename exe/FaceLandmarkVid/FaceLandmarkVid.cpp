@@ -132,6 +132,9 @@ int main(int argc, char **argv)
 			// The actual facial landmark detection / tracking
 			bool detection_success = LandmarkDetector::DetectLandmarksInVideo(rgb_image, face_model, det_parameters, grayscale_image);
 
+			// Everything derived from the fit (pose, 3D shape, eye landmarks and gaze) is computed once
+			LandmarkDetector::FaceResults face_results(face_model, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
+
 			// Gaze tracking, absolute gaze direction
 			cv::Point3f gazeDirection0(0, 0, -1);
 			cv::Point3f gazeDirection1(0, 0, -1);
@@ -139,21 +142,22 @@ int main(int argc, char **argv)
 			// If tracking succeeded and we have an eye model, estimate gaze
 			if (detection_success && face_model.eye_model)
 			{
-				GazeAnalysis::EstimateGaze(face_model, gazeDirection0, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy, true);
-				GazeAnalysis::EstimateGaze(face_model, gazeDirection1, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy, false);
+				GazeAnalysis::EstimateGaze(face_results);
+				gazeDirection0 = face_results.GazeDirection0();
+				gazeDirection1 = face_results.GazeDirection1();
 			}
 
 			// Work out the pose of the head from the tracked model
-			cv::Vec6d pose_estimate = LandmarkDetector::GetPose(face_model, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
+			cv::Vec6d pose_estimate = face_results.Pose();
 
 			// Keeping track of FPS
 			fps_tracker.AddFrame();
 
 			// Displaying the tracking visualizations
 			visualizer.SetImage(rgb_image, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
-			visualizer.SetObservationLandmarks(face_model.detected_landmarks, face_model.detection_certainty, face_model.GetVisibilities());
+			visualizer.SetObservationLandmarks(face_model.detected_landmarks, face_model.detection_certainty, face_results.Visibilities());
 			visualizer.SetObservationPose(pose_estimate, face_model.detection_certainty);
-			visualizer.SetObservationGaze(gazeDirection0, gazeDirection1, LandmarkDetector::CalculateAllEyeLandmarks(face_model), LandmarkDetector::Calculate3DEyeLandmarks(face_model, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy), face_model.detection_certainty);
+			visualizer.SetObservationGaze(gazeDirection0, gazeDirection1, face_results.EyeLandmarks2D(), face_results.EyeLandmarks3D(), face_model.detection_certainty);
 			visualizer.SetFps(fps_tracker.GetFPS());
 			// detect key presses (due to pecularities of OpenCV, you can get it when displaying images)
 			char character_press = visualizer.ShowObservation();
@@ -166,6 +170,10 @@ int main(int argc, char **argv)
 			// quit the application
 			else if (character_press == 'q')
 			{
+				if (sequence_reader.IsWebcam() && sequence_reader.live_mode)
+				{
+					INFO_STREAM("Frames dropped in live mode: " << sequence_reader.GetDroppedFrames());
+				}
 				return(0);
 			}
 
@@ -174,6 +182,11 @@ int main(int argc, char **argv)
 
 		}
 
+		if (sequence_reader.IsWebcam() && sequence_reader.live_mode)
+		{
+			INFO_STREAM("Frames dropped in live mode: " << sequence_reader.GetDroppedFrames());
+		}
+
 		// Reset the model, for the next video
 		face_model.Reset();
 		sequence_reader.Close();
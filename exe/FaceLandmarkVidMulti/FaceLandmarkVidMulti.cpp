@@ -39,11 +39,15 @@
 #include "VisualizationUtils.h"
 #include "Visualizer.h"
 #include "SequenceCapture.h"
+#include "TaskScheduler.h"
 #include <RecorderOpenFace.h>
 #include <RecorderOpenFaceParameters.h>
 #include <GazeEstimation.h>
 #include <FaceAnalyser.h>
 
+#include <future>
+#include <chrono>
+
 #define INFO_STREAM( stream ) \
 std::cout << stream << std::endl
 
@@ -110,7 +114,8 @@ void RemoveOverlapingModels(std::vector<LandmarkDetector::CLNF>& face_models, st
 
 }
 
-void NonOverlapingDetections(const std::vector<LandmarkDetector::CLNF>& clnf_models, std::vector<cv::Rect_<float> >& face_detections)
+// Detections made on an earlier frame (when detecting in the background) can be passed with a lower overlap threshold, as both the face and the tracker might have moved since
+void NonOverlapingDetections(const std::vector<LandmarkDetector::CLNF>& clnf_models, std::vector<cv::Rect_<float> >& face_detections, double overlap_threshold = 0.5)
 {
 
 	// Go over the model and eliminate detections that are not informative (there already is a tracker there)
@@ -123,7 +128,7 @@ void NonOverlapingDetections(const std::vector<LandmarkDetector::CLNF>& clnf_mod
 		for (int detection = face_detections.size() - 1; detection >= 0; --detection)
 		{
 			// If the model is already tracking what we're detecting ignore the detection, this is determined by amount of overlap
-			if (IOU(model_rect, face_detections[detection]) > 0.5)
+			if (IOU(model_rect, face_detections[detection]) > overlap_threshold)
 			{
 				face_detections.erase(face_detections.begin() + detection);
 			}
@@ -131,6 +136,29 @@ void NonOverlapingDetections(const std::vector<LandmarkDetector::CLNF>& clnf_mod
 	}
 }
 
+// Finding the faces in a frame using the face detector chosen in the parameters
+std::vector<cv::Rect_<float> > DetectNewFaces(const cv::Mat& rgb_image, const cv::Mat_<uchar>& grayscale_image, LandmarkDetector::CLNF& clnf_model, const LandmarkDetector::FaceModelParameters& det_params)
+{
+	std::vector<cv::Rect_<float> > face_detections;
+
+	if (det_params.curr_face_detector == LandmarkDetector::FaceModelParameters::HOG_SVM_DETECTOR)
+	{
+		std::vector<float> confidences;
+		LandmarkDetector::DetectFacesHOG(face_detections, grayscale_image, clnf_model.face_detector_HOG, confidences);
+	}
+	else if (det_params.curr_face_detector == LandmarkDetector::FaceModelParameters::HAAR_DETECTOR)
+	{
+		LandmarkDetector::DetectFaces(face_detections, grayscale_image, clnf_model.face_detector_HAAR);
+	}
+	else
+	{
+		std::vector<float> confidences;
+		LandmarkDetector::DetectFacesMTCNN(face_detections, rgb_image, clnf_model.face_detector_MTCNN, confidences);
+	}
+
+	return face_detections;
+}
+
 int main(int argc, char **argv)
 {
 
@@ -180,6 +208,11 @@ int main(int argc, char **argv)
 		det_parameters[0].curr_face_detector = LandmarkDetector::FaceModelParameters::HOG_SVM_DETECTOR;
 	}
 
+	// The background face detection has its own copy of the detectors (the landmark models are shared), so that it does not interfere with tracking
+	LandmarkDetector::CLNF detector_model(face_model);
+
+	int detect_every = std::max(1, det_parameters[0].detect_every_n_frames);
+
 	face_models.reserve(num_faces_max);
 
 	face_models.push_back(face_model);
@@ -256,6 +289,10 @@ int main(int argc, char **argv)
 		// For reporting progress
 		double reported_completion = 0;
 
+		// Face detection running in the background and the frame it was started on
+		std::future<std::vector<cv::Rect_<float> > > pending_detection;
+		int last_detection_frame = -detect_every;
+
 		INFO_STREAM("Starting tracking");
 		while (!rgb_image.empty())
 		{
@@ -274,36 +311,51 @@ int main(int argc, char **argv)
 				}
 			}
 
-			// Get the detections (every 8th frame and when there are free models available for tracking)
-			if (frame_count % 8 == 0 && !all_models_active)
+			bool detections_stale = false;
+
+			if (!det_parameters[0].detect_async)
 			{
-				if (det_parameters[0].curr_face_detector == LandmarkDetector::FaceModelParameters::HOG_SVM_DETECTOR)
+				// Get the detections (every detect_every frames and when there are free models available for tracking)
+				if (frame_count % detect_every == 0 && !all_models_active)
 				{
-					std::vector<float> confidences;
-					LandmarkDetector::DetectFacesHOG(face_detections, grayscale_image, face_models[0].face_detector_HOG, confidences);
+					face_detections = DetectNewFaces(rgb_image, grayscale_image, face_models[0], det_parameters[0]);
 				}
-				else if (det_parameters[0].curr_face_detector == LandmarkDetector::FaceModelParameters::HAAR_DETECTOR)
+			}
+			else
+			{
+				// Pick up the faces found in the background, these come from an earlier frame
+				if (pending_detection.valid() && pending_detection.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
 				{
-					LandmarkDetector::DetectFaces(face_detections, grayscale_image, face_models[0].face_detector_HAAR);
+					face_detections = pending_detection.get();
+					detections_stale = true;
 				}
-				else
+
+				// Start looking for new faces in the current frame, while tracking carries on
+				if (!pending_detection.valid() && !all_models_active && frame_count - last_detection_frame >= detect_every)
 				{
-					std::vector<float> confidences;
-					LandmarkDetector::DetectFacesMTCNN(face_detections, rgb_image, face_models[0].face_detector_MTCNN, confidences);
+					cv::Mat detection_image = rgb_image;
+					cv::Mat_<uchar> detection_grayscale = grayscale_image;
+					LandmarkDetector::CLNF* detection_model = &detector_model;
+					LandmarkDetector::FaceModelParameters detection_params = det_parameters[0];
+
+					pending_detection = std::async(std::launch::async, [detection_image, detection_grayscale, detection_model, detection_params]() {
+						return DetectNewFaces(detection_image, detection_grayscale, *detection_model, detection_params);
+					});
+					last_detection_frame = frame_count;
 				}
-
 			}
 
 			// Keep only non overlapping detections (so as not to start tracking where the face is already tracked)
-			NonOverlapingDetections(face_models, face_detections);
+			NonOverlapingDetections(face_models, face_detections, detections_stale ? 0.3 : 0.5);
 			std::vector<bool> face_detections_used(face_detections.size(), false);
 
-			// Go through every model and update the tracking
+			// Tracked models are validated together in one batch after fitting (reinitialised ones are validated during detection)
+			std::vector<int> validate_model(face_models.size(), 0);
+
+			// Hand the new detections to the free models first, so that all of the models can then be fit independently
+			std::vector<int> model_detections(face_models.size(), -1);
 			for (unsigned int model = 0; model < face_models.size(); ++model)
 			{
-
-				bool detection_success = false;
-
 				// If the current model has failed more than 4 times in a row, remove it
 				if (face_models[model].failures_in_a_row > 4)
 				{
@@ -321,27 +373,47 @@ int main(int argc, char **argv)
 						if (!face_detections_used[detection_ind])
 						{
 							face_detections_used[detection_ind] = true;
-
-							// Reinitialise the model
-							face_models[model].Reset();
-
-							// This ensures that a wider window is used for the initial landmark localisation
-							face_models[model].detection_success = false;
-							detection_success = LandmarkDetector::DetectLandmarksInVideo(rgb_image, face_detections[detection_ind], face_models[model], det_parameters[model], grayscale_image);
+							model_detections[model] = (int)detection_ind;
 
 							// This activates the model
 							active_models[model] = true;
 
-							// break out of the loop as the tracker has been reinitialised
+							// break out of the loop as the tracker will be reinitialised
 							break;
 						}
 
 					}
 				}
-				else
+			}
+
+			// Go through every model and update the tracking, the faces are fit in parallel
+			LandmarkDetector::TaskScheduler::Instance().ParallelFor(cv::Range(0, (int)face_models.size()), [&](const cv::Range& range) {
+				for (int model = range.start; model < range.end; ++model)
 				{
-					// The actual facial landmark detection / tracking
-					detection_success = LandmarkDetector::DetectLandmarksInVideo(rgb_image, face_models[model], det_parameters[model], grayscale_image);
+					if (model_detections[model] != -1)
+					{
+						// Reinitialise the model
+						face_models[model].Reset();
+
+						// This ensures that a wider window is used for the initial landmark localisation
+						face_models[model].detection_success = false;
+						LandmarkDetector::DetectLandmarksInVideo(rgb_image, face_detections[model_detections[model]], face_models[model], det_parameters[model], grayscale_image);
+					}
+					else if (active_models[model])
+					{
+						// The actual facial landmark detection / tracking, if the fit is validated on every frame this is done for all of the tracked models in a batch
+						validate_model[model] = LandmarkDetector::DetectLandmarksInVideoDeferValidation(rgb_image, face_models[model], det_parameters[model], grayscale_image);
+					}
+				}
+			});
+
+			std::vector<bool> models_to_validate(validate_model.begin(), validate_model.end());
+			LandmarkDetector::ValidateLandmarks(face_models, models_to_validate, grayscale_image, det_parameters[0]);
+			for (size_t model = 0; model < face_models.size(); ++model)
+			{
+				if (models_to_validate[model])
+				{
+					LandmarkDetector::CompleteDeferredValidation(grayscale_image, face_models[model], det_parameters[model]);
 				}
 			}
 
@@ -361,17 +433,13 @@ int main(int argc, char **argv)
 				if (active_models[model])
 				{
 
-					// Estimate head pose and eye gaze				
-					cv::Vec6d pose_estimate = LandmarkDetector::GetPose(face_models[model], sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
-
-					cv::Point3f gaze_direction0(0, 0, 0); cv::Point3f gaze_direction1(0, 0, 0); cv::Vec2d gaze_angle(0, 0);
+					// Everything derived from the fit (pose, 3D shape, eye landmarks and gaze) is computed once and shared by the visualization and the recording
+					LandmarkDetector::FaceResults face_results(face_models[model], sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
 
 					// Detect eye gazes
 					if (face_models[model].detection_success && face_model.eye_model)
 					{
-						GazeAnalysis::EstimateGaze(face_models[model], gaze_direction0, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy, true);
-						GazeAnalysis::EstimateGaze(face_models[model], gaze_direction1, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy, false);
-						gaze_angle = GazeAnalysis::GetGazeAngle(gaze_direction0, gaze_direction1);
+						GazeAnalysis::EstimateGaze(face_results);
 					}
 
 					// Face analysis step
@@ -390,17 +458,17 @@ int main(int argc, char **argv)
 					visualizer.SetObservationFaceAlign(sim_warped_img);
 					visualizer.SetObservationHOG(hog_descriptor, num_hog_rows, num_hog_cols);
 					visualizer.SetObservationLandmarks(face_models[model].detected_landmarks, face_models[model].detection_certainty);
-					visualizer.SetObservationPose(LandmarkDetector::GetPose(face_models[model], sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy), face_models[model].detection_certainty);
-					visualizer.SetObservationGaze(gaze_direction0, gaze_direction1, LandmarkDetector::CalculateAllEyeLandmarks(face_models[model]), LandmarkDetector::Calculate3DEyeLandmarks(face_models[model], sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy), face_models[model].detection_certainty);
+					visualizer.SetObservationPose(face_results.Pose(), face_models[model].detection_certainty);
+					visualizer.SetObservationGaze(face_results.GazeDirection0(), face_results.GazeDirection1(), face_results.EyeLandmarks2D(), face_results.EyeLandmarks3D(), face_models[model].detection_certainty);
 					visualizer.SetObservationActionUnits(face_analyser.GetCurrentAUsReg(), face_analyser.GetCurrentAUsClass());
 
 					// Output features
 					open_face_rec.SetObservationHOG(face_models[model].detection_success, hog_descriptor, num_hog_rows, num_hog_cols, 31); // The number of channels in HOG is fixed at the moment, as using FHOG
 					open_face_rec.SetObservationActionUnits(face_analyser.GetCurrentAUsReg(), face_analyser.GetCurrentAUsClass());
-					open_face_rec.SetObservationLandmarks(face_models[model].detected_landmarks, face_models[model].GetShape(sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy),
+					open_face_rec.SetObservationLandmarks(face_models[model].detected_landmarks, face_results.Shape3D(),
 						face_models[model].params_global, face_models[model].params_local, face_models[model].detection_certainty, face_models[model].detection_success);
-					open_face_rec.SetObservationPose(pose_estimate);
-					open_face_rec.SetObservationGaze(gaze_direction0, gaze_direction1, gaze_angle, LandmarkDetector::CalculateAllEyeLandmarks(face_models[model]), LandmarkDetector::Calculate3DEyeLandmarks(face_models[model], sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy));
+					open_face_rec.SetObservationPose(face_results.Pose());
+					open_face_rec.SetObservationGaze(face_results.GazeDirection0(), face_results.GazeDirection1(), face_results.GazeAngle(), face_results.EyeLandmarks2D(), face_results.EyeLandmarks3D());
 					open_face_rec.SetObservationFaceAlign(sim_warped_img);
 					open_face_rec.SetObservationFaceID(model);
 					open_face_rec.SetObservationTimestamp(sequence_reader.time_stamp);
@@ -412,8 +480,11 @@ int main(int argc, char **argv)
 
 			visualizer.SetFps(fps_tracker.GetFPS());
 
-			// Record frame
-			open_face_rec.SetObservationVisualization(visualizer.GetVisImage());
+			// Record frame, the visualization is only drawn if it is going to be recorded
+			if (recording_params.outputTracked())
+			{
+				open_face_rec.SetObservationVisualization(visualizer.GetVisImage());
+			}
 			open_face_rec.WriteObservationTracked();
 
 			// show visualization and detect key presses
@@ -455,6 +526,12 @@ int main(int argc, char **argv)
 
 		frame_count = 0;
 
+		// Do not carry the detections over to the next video
+		if (pending_detection.valid())
+		{
+			pending_detection.wait();
+		}
+
 		// Reset the model, for the next video
 		for (size_t model = 0; model < face_models.size(); ++model)
 		{
@@ -46,6 +46,16 @@
 #include <SequenceCapture.h>
 #include <Visualizer.h>
 #include <VisualizationUtils.h>
+#include <ServerJobs.h>
+
+// System includes
+#include <algorithm>
+#include <iostream>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #ifndef CONFIG_DIR
 #define CONFIG_DIR "~"
@@ -81,6 +91,465 @@ std::vector<std::string> get_arguments(int argc, char **argv)
 	return arguments;
 }
 
+// Keyframe mode, tracking and Action Unit analysis are only run on every keyframe_every frame (-keyframe_every <n>), or earlier if the image
+// changes by more than keyframe_motion in mean absolute intensity (-keyframe_motion <t>), the results in between keyframes are interpolated
+void get_keyframe_params(const std::vector<std::string>& arguments, int& keyframe_every, double& keyframe_motion)
+{
+	keyframe_every = 1;
+	keyframe_motion = 0;
+
+	for (size_t i = 0; i + 1 < arguments.size(); ++i)
+	{
+		if (arguments[i].compare("-keyframe_every") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> keyframe_every;
+			i++;
+		}
+		else if (arguments[i].compare("-keyframe_motion") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> keyframe_motion;
+			i++;
+		}
+	}
+}
+
+// Everything that is visualized and recorded about a frame
+struct FrameObservation
+{
+	cv::Mat_<float> landmarks_2D;
+	cv::Mat_<float> landmarks_3D;
+	cv::Vec6f params_global;
+	cv::Mat_<float> params_local;
+	double confidence;
+	bool success;
+	cv::Mat_<int> visibilities;
+
+	cv::Vec6d pose;
+
+	cv::Point3f gaze_direction0;
+	cv::Point3f gaze_direction1;
+	cv::Vec2d gaze_angle;
+	std::vector<cv::Point2f> eye_landmarks_2D;
+	std::vector<cv::Point3f> eye_landmarks_3D;
+
+	// In the order of the FaceAnalyser AU schemas
+	std::vector<double> aus_reg;
+	std::vector<double> aus_class;
+};
+
+// Interpolating the observation of a frame in between two keyframes, alpha is the distance from the first keyframe (0 to 1)
+FrameObservation InterpolateObservation(const FrameObservation& first, const FrameObservation& second, double alpha)
+{
+	// Can't interpolate if tracking failed on one of the keyframes
+	if (!first.success || !second.success)
+	{
+		FrameObservation failed = first.success ? second : first;
+		failed.success = false;
+		return failed;
+	}
+
+	FrameObservation interp = alpha < 0.5 ? first : second;
+
+	// The copied matrices share their data with the keyframe, so the interpolated ones need their own to not overwrite it
+	interp.landmarks_2D = cv::Mat_<float>();
+	interp.landmarks_3D = cv::Mat_<float>();
+	interp.params_local = cv::Mat_<float>();
+
+	cv::addWeighted(first.landmarks_2D, 1.0 - alpha, second.landmarks_2D, alpha, 0, interp.landmarks_2D);
+	cv::addWeighted(first.landmarks_3D, 1.0 - alpha, second.landmarks_3D, alpha, 0, interp.landmarks_3D);
+	cv::addWeighted(first.params_local, 1.0 - alpha, second.params_local, alpha, 0, interp.params_local);
+	interp.params_global = first.params_global * (1.0 - alpha) + second.params_global * alpha;
+	interp.confidence = (1.0 - alpha) * first.confidence + alpha * second.confidence;
+
+	interp.pose = first.pose * (1.0 - alpha) + second.pose * alpha;
+
+	interp.gaze_direction0 = first.gaze_direction0 * (1.0 - alpha) + second.gaze_direction0 * alpha;
+	interp.gaze_direction1 = first.gaze_direction1 * (1.0 - alpha) + second.gaze_direction1 * alpha;
+	if (cv::norm(interp.gaze_direction0) > 0)
+		interp.gaze_direction0 = interp.gaze_direction0 / cv::norm(interp.gaze_direction0);
+	if (cv::norm(interp.gaze_direction1) > 0)
+		interp.gaze_direction1 = interp.gaze_direction1 / cv::norm(interp.gaze_direction1);
+	interp.gaze_angle = first.gaze_angle * (1.0 - alpha) + second.gaze_angle * alpha;
+
+	if (first.eye_landmarks_2D.size() == second.eye_landmarks_2D.size())
+	{
+		for (size_t i = 0; i < interp.eye_landmarks_2D.size(); ++i)
+		{
+			interp.eye_landmarks_2D[i] = first.eye_landmarks_2D[i] * (1.0 - alpha) + second.eye_landmarks_2D[i] * alpha;
+		}
+	}
+	if (first.eye_landmarks_3D.size() == second.eye_landmarks_3D.size())
+	{
+		for (size_t i = 0; i < interp.eye_landmarks_3D.size(); ++i)
+		{
+			interp.eye_landmarks_3D[i] = first.eye_landmarks_3D[i] * (1.0 - alpha) + second.eye_landmarks_3D[i] * alpha;
+		}
+	}
+
+	// AU intensities are interpolated, while occurrences are taken from the closer keyframe
+	if (first.aus_reg.size() == second.aus_reg.size())
+	{
+		for (size_t i = 0; i < interp.aus_reg.size(); ++i)
+		{
+			interp.aus_reg[i] = (1.0 - alpha) * first.aus_reg[i] + alpha * second.aus_reg[i];
+		}
+	}
+
+	return interp;
+}
+
+// Mean absolute intensity change between two downsampled frames, for picking keyframes when there is a lot of motion
+double FrameMotion(const cv::Mat_<uchar>& small_frame, const cv::Mat_<uchar>& small_keyframe)
+{
+	if (small_keyframe.empty() || small_frame.size() != small_keyframe.size())
+		return 0;
+
+	return cv::norm(small_frame, small_keyframe, cv::NORM_L1) / (double)small_frame.total();
+}
+
+// Multi-stream mode (-streams <n>), up to n of the input sequences are processed at once by a fixed pool of workers (-stream_workers <w>,
+// by default the number of cores), the models are loaded once and every stream gets its own copy of them, so memory grows with the number of streams
+void get_stream_params(std::vector<std::string>& arguments, int& num_streams, int& num_workers, int& capture_memory, int& decode_threads)
+{
+	num_streams = 0;
+	num_workers = 0;
+	capture_memory = Utilities::SequenceCapture::CAPTURE_CAPACITY;
+	decode_threads = 1;
+
+	bool* valid = new bool[arguments.size()];
+
+	for (size_t i = 0; i < arguments.size(); ++i)
+	{
+		valid[i] = true;
+	}
+
+	for (size_t i = 0; i + 1 < arguments.size(); ++i)
+	{
+		if (arguments[i].compare("-streams") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> num_streams;
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-stream_workers") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> num_workers;
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-capture_memory") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> capture_memory;
+			i++;
+		}
+		else if (arguments[i].compare("-decode_threads") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> decode_threads;
+			i++;
+		}
+	}
+
+	// In multi-stream mode the capture options are handed to each stream separately
+	if (num_streams > 0)
+	{
+		for (size_t i = 0; i + 1 < arguments.size(); ++i)
+		{
+			if (arguments[i].compare("-capture_memory") == 0 || arguments[i].compare("-decode_threads") == 0)
+			{
+				valid[i] = false;
+				valid[i + 1] = false;
+				i++;
+			}
+		}
+	}
+
+	for (int i = (int)arguments.size() - 1; i >= 0; --i)
+	{
+		if (!valid[i])
+		{
+			arguments.erase(arguments.begin() + i);
+		}
+	}
+
+	delete[] valid;
+
+	if (num_workers <= 0)
+	{
+		num_workers = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+}
+
+// A sequence being processed in multi-stream mode, it has its own tracking, analysis and recording state. The models keep per sequence state,
+// so they are copied for every stream: the CEN patch experts and the AU regressors share their weights with the loaded models, but the PDM,
+// the CCNF and SVR patch experts (of the CLNF and eye models) and the validator are cloned, and the running medians of the AU analysis
+// take up about 18 MB (HOG) per head orientation the stream sees
+struct StreamState
+{
+	Utilities::SequenceCapture sequence_reader;
+	LandmarkDetector::CLNF face_model;
+	LandmarkDetector::FaceModelParameters det_parameters;
+	FaceAnalysis::FaceAnalyser face_analyser;
+	Utilities::Visualizer visualizer;
+
+	std::unique_ptr<Utilities::RecorderOpenFaceParameters> recording_params;
+	std::unique_ptr<Utilities::RecorderOpenFace> open_face_rec;
+
+	cv::Mat captured_image;
+
+	StreamState(const LandmarkDetector::CLNF& face_model, const LandmarkDetector::FaceModelParameters& det_parameters, const FaceAnalysis::FaceAnalyser& face_analyser) :
+		face_model(face_model), det_parameters(det_parameters), face_analyser(face_analyser), visualizer(false, false, false, false)
+	{
+	}
+};
+
+// Tracking, gaze and AU analysis of the current frame of a stream and recording the results, followed by grabbing its next frame
+void ProcessStreamFrame(StreamState& stream)
+{
+	Utilities::SequenceCapture& sequence_reader = stream.sequence_reader;
+	LandmarkDetector::CLNF& face_model = stream.face_model;
+	Utilities::RecorderOpenFaceParameters& recording_params = *stream.recording_params;
+
+	cv::Mat_<uchar> grayscale_image = sequence_reader.GetGrayFrame();
+
+	// The actual facial landmark detection / tracking
+	bool detection_success = LandmarkDetector::DetectLandmarksInVideo(stream.captured_image, face_model, stream.det_parameters, grayscale_image);
+
+	// Everything derived from the fit (pose, 3D shape, eye landmarks and gaze) is computed once and shared by the visualization and the recording
+	LandmarkDetector::FaceResults face_results(face_model, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
+
+	// Gaze tracking, absolute gaze direction
+	if (detection_success && face_model.eye_model)
+	{
+		GazeAnalysis::EstimateGaze(face_results);
+	}
+
+	// Do face alignment
+	cv::Mat sim_warped_img;
+	cv::Mat_<double> hog_descriptor; int num_hog_rows = 0, num_hog_cols = 0;
+
+	// Perform AU detection and HOG feature extraction, as this can be expensive only compute it if needed by output
+	if (recording_params.outputAlignedFaces() || recording_params.outputHOG() || recording_params.outputAUs())
+	{
+		stream.face_analyser.AddNextFrame(stream.captured_image, face_model.detected_landmarks, face_model.detection_success, sequence_reader.time_stamp, sequence_reader.IsWebcam());
+		stream.face_analyser.GetLatestAlignedFace(sim_warped_img);
+		stream.face_analyser.GetLatestHOG(hog_descriptor, num_hog_rows, num_hog_cols);
+	}
+
+	// The tracked video is only drawn when recorded, the streams are never displayed
+	if (recording_params.outputTracked())
+	{
+		stream.visualizer.SetImage(stream.captured_image, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
+		stream.visualizer.SetObservationLandmarks(face_model.detected_landmarks, face_model.detection_certainty, face_results.Visibilities());
+		stream.visualizer.SetObservationPose(face_results.Pose(), face_model.detection_certainty);
+		stream.visualizer.SetObservationGaze(face_results.GazeDirection0(), face_results.GazeDirection1(), face_results.EyeLandmarks2D(), face_results.EyeLandmarks3D(), face_model.detection_certainty);
+		stream.open_face_rec->SetObservationVisualization(stream.visualizer.GetVisImage());
+	}
+
+	// Setting up the recorder output
+	Utilities::RecorderOpenFace& open_face_rec = *stream.open_face_rec;
+	open_face_rec.SetObservationHOG(detection_success, hog_descriptor, num_hog_rows, num_hog_cols, 31); // The number of channels in HOG is fixed at the moment, as using FHOG
+	open_face_rec.SetObservationActionUnits(stream.face_analyser.GetCurrentAUsReg(), stream.face_analyser.GetCurrentAUsClass());
+	open_face_rec.SetObservationLandmarks(face_model.detected_landmarks, face_results.Shape3D(),
+		face_model.params_global, face_model.params_local, face_model.detection_certainty, detection_success);
+	open_face_rec.SetObservationPose(face_results.Pose());
+	open_face_rec.SetObservationGaze(face_results.GazeDirection0(), face_results.GazeDirection1(), face_results.GazeAngle(), face_results.EyeLandmarks2D(), face_results.EyeLandmarks3D());
+	open_face_rec.SetObservationTimestamp(sequence_reader.time_stamp);
+	open_face_rec.SetObservationFaceID(0);
+	open_face_rec.SetObservationFrameNumber(sequence_reader.GetFrameNumber());
+	open_face_rec.SetObservationFaceAlign(sim_warped_img);
+	open_face_rec.WriteObservation();
+	open_face_rec.WriteObservationTracked();
+
+	// Grabbing the next frame in the sequence
+	stream.captured_image = sequence_reader.GetNextFrame();
+}
+
+// Moving the next input (-f, -fdir or -device) out of the arguments into the arguments of a new stream, these get all of the other options
+// but none of the other inputs, and the output name (-of) goes with the first input taken, as it would when the streams share the arguments
+bool take_next_input(std::vector<std::string>& arguments, std::vector<std::string>& stream_arguments)
+{
+	auto is_input = [](const std::string& argument) { return argument.compare("-f") == 0 || argument.compare("-fdir") == 0 || argument.compare("-device") == 0; };
+
+	size_t input = 0;
+	while (input + 1 < arguments.size() && !is_input(arguments[input]))
+	{
+		input++;
+	}
+	if (input + 1 >= arguments.size())
+	{
+		return false;
+	}
+
+	stream_arguments.clear();
+	for (size_t i = 0; i < arguments.size(); ++i)
+	{
+		if (i != input && i + 1 < arguments.size() && is_input(arguments[i]))
+		{
+			i++;
+			continue;
+		}
+		stream_arguments.push_back(arguments[i]);
+	}
+
+	arguments.erase(arguments.begin() + input, arguments.begin() + input + 2);
+	std::vector<std::string>::iterator output_name = std::find(arguments.begin(), arguments.end(), "-of");
+	if (output_name != arguments.end() && output_name + 1 != arguments.end())
+	{
+		arguments.erase(output_name, output_name + 2);
+	}
+	return true;
+}
+
+// Multi-stream processing, the open streams are handed to the workers in turns a frame at a time, so that every stream progresses at the same rate,
+// a new input is opened whenever a stream finishes, and each stream only decodes ahead as much as its share of the capture memory allows
+void RunStreams(std::vector<std::string>& arguments, const LandmarkDetector::CLNF& face_model, const LandmarkDetector::FaceModelParameters& det_parameters,
+	const FaceAnalysis::FaceAnalyser& face_analyser, int num_streams, int num_workers, int capture_memory, int decode_threads)
+{
+	std::mutex schedule_mutex;
+	std::condition_variable schedule_cond;
+
+	// The streams waiting for a worker, in the order they will be processed
+	std::deque<StreamState*> ready_streams;
+	int open_streams = 0;
+	int opening_streams = 0;
+	bool inputs_left = true;
+
+	int stream_capture_memory = std::max(1, capture_memory / num_streams);
+
+	// Opening an input as a stream, this copies the models and opens the input and output files, so it is done without holding the lock
+	auto open_stream = [&](std::vector<std::string>& stream_arguments) -> StreamState*
+	{
+		StreamState* stream = new StreamState(face_model, det_parameters, face_analyser);
+
+		stream_arguments.push_back("-capture_memory");
+		stream_arguments.push_back(std::to_string(stream_capture_memory));
+		stream_arguments.push_back("-decode_threads");
+		stream_arguments.push_back(std::to_string(decode_threads));
+
+		if (!stream->sequence_reader.Open(stream_arguments))
+		{
+			std::cout << "Error: Could not open the input" << std::endl;
+			delete stream;
+			return nullptr;
+		}
+
+		stream->recording_params.reset(new Utilities::RecorderOpenFaceParameters(stream_arguments, true, stream->sequence_reader.IsWebcam(),
+			stream->sequence_reader.fx, stream->sequence_reader.fy, stream->sequence_reader.cx, stream->sequence_reader.cy, stream->sequence_reader.fps));
+		if (!stream->face_model.eye_model)
+		{
+			stream->recording_params->setOutputGaze(false);
+		}
+		stream->open_face_rec.reset(new Utilities::RecorderOpenFace(stream->sequence_reader.name, *stream->recording_params, stream_arguments));
+
+		INFO_STREAM("Opened stream " << stream->sequence_reader.name);
+
+		stream->captured_image = stream->sequence_reader.GetNextFrame();
+
+		return stream;
+	};
+
+	auto worker = [&]()
+	{
+		std::unique_lock<std::mutex> lock(schedule_mutex);
+		while (true)
+		{
+			// Only taking the input out of the arguments and adding the stream to the ready ones needs the lock
+			if (inputs_left && open_streams + opening_streams < num_streams)
+			{
+				std::vector<std::string> stream_arguments;
+				if (!take_next_input(arguments, stream_arguments))
+				{
+					inputs_left = false;
+					continue;
+				}
+				opening_streams++;
+				lock.unlock();
+
+				StreamState* stream = open_stream(stream_arguments);
+
+				lock.lock();
+				opening_streams--;
+				if (stream)
+				{
+					ready_streams.push_back(stream);
+					open_streams++;
+				}
+				schedule_cond.notify_all();
+				continue;
+			}
+
+			if (ready_streams.empty())
+			{
+				if (open_streams == 0 && opening_streams == 0 && !inputs_left)
+				{
+					break;
+				}
+				schedule_cond.wait(lock);
+				continue;
+			}
+
+			StreamState* stream = ready_streams.front();
+			ready_streams.pop_front();
+			lock.unlock();
+
+			bool finished = stream->captured_image.empty();
+			if (!finished)
+			{
+				ProcessStreamFrame(*stream);
+				finished = stream->captured_image.empty();
+			}
+
+			if (finished)
+			{
+				if (stream->sequence_reader.IsWebcam() && stream->sequence_reader.live_mode)
+				{
+					INFO_STREAM("Frames dropped in live mode (" << stream->sequence_reader.name << "): " << stream->sequence_reader.GetDroppedFrames());
+				}
+
+				stream->open_face_rec->Close();
+				stream->sequence_reader.Close();
+
+				if (stream->recording_params->outputAUs())
+				{
+					stream->face_analyser.PostprocessOutputFile(stream->open_face_rec->GetCSVFile());
+				}
+
+				INFO_STREAM("Finished stream " << stream->sequence_reader.name);
+				delete stream;
+			}
+
+			lock.lock();
+			if (finished)
+			{
+				open_streams--;
+			}
+			else
+			{
+				ready_streams.push_back(stream);
+			}
+			schedule_cond.notify_all();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (int i = 0; i < num_workers; ++i)
+	{
+		workers.push_back(std::thread(worker));
+	}
+	for (size_t i = 0; i < workers.size(); ++i)
+	{
+		workers[i].join();
+	}
+}
+
 int main(int argc, char **argv)
 {
 
@@ -94,6 +563,16 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	bool server_mode = std::find(arguments.begin(), arguments.end(), "-server") != arguments.end();
+
+	// In server mode the standard output only carries the replies to the jobs, all the other messages (model loading, progress, and the ones
+	// from the libraries) go to the standard error
+	std::ostream protocol(std::cout.rdbuf());
+	if (server_mode)
+	{
+		std::cout.rdbuf(std::cerr.rdbuf());
+	}
+
 	// Load the modules that are being used for tracking and face analysis
 	// Load face landmark detector
 	LandmarkDetector::FaceModelParameters det_parameters(arguments);
@@ -120,6 +599,19 @@ int main(int argc, char **argv)
 		std::cout << "WARNING: no Action Unit models found" << std::endl;
 	}
 
+	int num_streams, num_stream_workers, stream_capture_memory, stream_decode_threads;
+	get_stream_params(arguments, num_streams, num_stream_workers, stream_capture_memory, stream_decode_threads);
+
+	if (num_streams > 0)
+	{
+		RunStreams(arguments, face_model, det_parameters, face_analyser, num_streams, num_stream_workers, stream_capture_memory, stream_decode_threads);
+		return 0;
+	}
+
+	int keyframe_every;
+	double keyframe_motion;
+	get_keyframe_params(arguments, keyframe_every, keyframe_motion);
+
 	Utilities::SequenceCapture sequence_reader;
 
 	// A utility for visualizing the results
@@ -129,145 +621,330 @@ int main(int argc, char **argv)
 	Utilities::FpsTracker fps_tracker;
 	fps_tracker.AddFrame();
 
-	while (true) // this is not a for loop as we might also be reading from a webcam
-	{
-
-		// The sequence reader chooses what to open based on command line arguments provided
-		if (!sequence_reader.Open(arguments))
-			break;
-
-		INFO_STREAM("Device or file opened");
+	// In server mode every job is answered with an OUTPUT line per processed sequence (the CSV file), ERROR lines for inputs that
+	// could not be opened or failed, and a DONE line once the job is finished
+	bool job_active = false;
+	std::string executable = arguments[0];
 
-		if (sequence_reader.IsWebcam())
-		{
-			INFO_STREAM("WARNING: using a webcam in feature extraction, Action Unit predictions will not be as accurate in real-time webcam mode");
-			INFO_STREAM("WARNING: using a webcam in feature extraction, forcing visualization of tracking to allow quitting the application (press q)");
-			visualizer.vis_track = true;
-		}
+	// A failure skips the rest of the job (the DONE reply follows once there is no input left), and the models start afresh for the next one
+	auto abandon_job = [&]()
+	{
+		sequence_reader.Close();
+		face_analyser.Reset();
+		face_model.Reset();
+		arguments.assign(1, executable);
+	};
 
-		cv::Mat captured_image;
+	if (server_mode)
+	{
+		protocol << "READY" << std::endl;
+	}
 
-		Utilities::RecorderOpenFaceParameters recording_params(arguments, true, sequence_reader.IsWebcam(),
-			sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy, sequence_reader.fps);
-		if (!face_model.eye_model)
+	while (true) // this is not a for loop as we might also be reading from a webcam
+	{
+		// A bad job (e.g. a corrupt video) should not stop the server
+		try
 		{
-			recording_params.setOutputGaze(false);
-		}
-		Utilities::RecorderOpenFace open_face_rec(sequence_reader.name, recording_params, arguments);
 
-		if (recording_params.outputGaze() && !face_model.eye_model)
-			std::cout << "WARNING: no eye model defined, but outputting gaze" << std::endl;
+			// The sequence reader chooses what to open based on command line arguments provided
+			if (!sequence_reader.Open(arguments))
+			{
+				if (!server_mode)
+					break;
 
-		captured_image = sequence_reader.GetNextFrame();
+				if (!sequence_reader.no_input_specified)
+				{
+					protocol << "ERROR Could not open the input" << std::endl;
+					continue;
+				}
 
-		// For reporting progress
-		double reported_completion = 0;
+				if (job_active)
+				{
+					protocol << "DONE" << std::endl;
+				}
 
-		INFO_STREAM("Starting tracking");
-		while (!captured_image.empty())
-		{
-			// Converting to grayscale
-			cv::Mat_<uchar> grayscale_image = sequence_reader.GetGrayFrame();
+				// Wait for the next job
+				if (!Utilities::ReadJobArguments(std::cin, arguments, executable))
+					break;
 
+				job_active = true;
+				get_keyframe_params(arguments, keyframe_every, keyframe_motion);
+				continue;
+			}
 
-			// The actual facial landmark detection / tracking
-			bool detection_success = LandmarkDetector::DetectLandmarksInVideo(captured_image, face_model, det_parameters, grayscale_image);
-			
-			// Gaze tracking, absolute gaze direction
-			cv::Point3f gazeDirection0(0, 0, 0); cv::Point3f gazeDirection1(0, 0, 0); cv::Vec2d gazeAngle(0, 0);
+			INFO_STREAM("Device or file opened");
 
-			if (detection_success && face_model.eye_model)
+			if (sequence_reader.IsWebcam())
 			{
-				GazeAnalysis::EstimateGaze(face_model, gazeDirection0, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy, true);
-				GazeAnalysis::EstimateGaze(face_model, gazeDirection1, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy, false);
-				gazeAngle = GazeAnalysis::GetGazeAngle(gazeDirection0, gazeDirection1);
+				INFO_STREAM("WARNING: using a webcam in feature extraction, Action Unit predictions will not be as accurate in real-time webcam mode");
+				INFO_STREAM("WARNING: using a webcam in feature extraction, forcing visualization of tracking to allow quitting the application (press q)");
+				visualizer.vis_track = true;
 			}
-			
-			// Do face alignment
-			cv::Mat sim_warped_img;
-			cv::Mat_<double> hog_descriptor; int num_hog_rows = 0, num_hog_cols = 0;
 
-			// Perform AU detection and HOG feature extraction, as this can be expensive only compute it if needed by output or visualization
-			if (recording_params.outputAlignedFaces() || recording_params.outputHOG() || recording_params.outputAUs() || visualizer.vis_align || visualizer.vis_hog || visualizer.vis_aus)
+			cv::Mat captured_image;
+
+			Utilities::RecorderOpenFaceParameters recording_params(arguments, true, sequence_reader.IsWebcam(),
+				sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy, sequence_reader.fps);
+			if (!face_model.eye_model)
 			{
-				face_analyser.AddNextFrame(captured_image, face_model.detected_landmarks, face_model.detection_success, sequence_reader.time_stamp, sequence_reader.IsWebcam());
-				face_analyser.GetLatestAlignedFace(sim_warped_img);
-				face_analyser.GetLatestHOG(hog_descriptor, num_hog_rows, num_hog_cols);
+				recording_params.setOutputGaze(false);
 			}
-			
-			// Work out the pose of the head from the tracked model
-			cv::Vec6d pose_estimate = LandmarkDetector::GetPose(face_model, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
-
-			// Keeping track of FPS
-			fps_tracker.AddFrame();
-
-			// Displaying the tracking visualizations
-			visualizer.SetImage(captured_image, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
-			visualizer.SetObservationFaceAlign(sim_warped_img);
-			visualizer.SetObservationHOG(hog_descriptor, num_hog_rows, num_hog_cols);
-			visualizer.SetObservationLandmarks(face_model.detected_landmarks, face_model.detection_certainty, face_model.GetVisibilities());
-			visualizer.SetObservationPose(pose_estimate, face_model.detection_certainty);
-			visualizer.SetObservationGaze(gazeDirection0, gazeDirection1, LandmarkDetector::CalculateAllEyeLandmarks(face_model), LandmarkDetector::Calculate3DEyeLandmarks(face_model, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy), face_model.detection_certainty);
-			visualizer.SetObservationActionUnits(face_analyser.GetCurrentAUsReg(), face_analyser.GetCurrentAUsClass());
-			visualizer.SetFps(fps_tracker.GetFPS());
-
-			// detect key presses
-			char character_press = visualizer.ShowObservation();
-			
-			// quit processing the current sequence (useful when in Webcam mode)
-			if (character_press == 'q')
+			if (keyframe_every > 1)
 			{
-				break;
+				recording_params.setOutputInterpolated(true);
 			}
+			Utilities::RecorderOpenFace open_face_rec(sequence_reader.name, recording_params, arguments);
+
+			if (recording_params.outputGaze() && !face_model.eye_model)
+				std::cout << "WARNING: no eye model defined, but outputting gaze" << std::endl;
+
+			captured_image = sequence_reader.GetNextFrame();
+
+			// For reporting progress
+			double reported_completion = 0;
+
+			// Keyframe mode state, the last keyframe and the frames waiting for the next one (RGB, grayscale, timestamp and frame number)
+			FrameObservation last_keyframe;
+			bool have_keyframe = false;
+			cv::Mat_<uchar> last_keyframe_small;
+			std::vector<std::tuple<cv::Mat, cv::Mat_<uchar>, double, int> > pending_frames;
+			cv::Mat_<double> last_hog_descriptor; int last_num_hog_rows = 0, last_num_hog_cols = 0;
+
+			// Visualizing and recording a frame, returns the key pressed
+			auto record_frame = [&](const cv::Mat& image, const FrameObservation& observation, double time_stamp, int frame_number, bool interpolated,
+				const cv::Mat& sim_warped_img, const cv::Mat_<double>& hog_descriptor, int num_hog_rows, int num_hog_cols)
+			{
+				// Keeping track of FPS
+				fps_tracker.AddFrame();
+
+				// Displaying the tracking visualizations
+				visualizer.SetImage(image, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
+				visualizer.SetObservationFaceAlign(sim_warped_img);
+				visualizer.SetObservationHOG(hog_descriptor, num_hog_rows, num_hog_cols);
+				visualizer.SetObservationLandmarks(observation.landmarks_2D, observation.confidence, observation.visibilities);
+				visualizer.SetObservationPose(observation.pose, observation.confidence);
+				visualizer.SetObservationGaze(observation.gaze_direction0, observation.gaze_direction1, observation.eye_landmarks_2D, observation.eye_landmarks_3D, observation.confidence);
+				Utilities::AUView aus_reg(face_analyser.GetAURegSchema(), observation.aus_reg);
+				Utilities::AUView aus_class(face_analyser.GetAUClassSchema(), observation.aus_class);
+				visualizer.SetObservationActionUnits(aus_reg, aus_class);
+				visualizer.SetFps(fps_tracker.GetFPS());
+
+				// detect key presses
+				char character_press = visualizer.ShowObservation();
+
+				// quit processing the current sequence (useful when in Webcam mode)
+				if (character_press == 'q')
+				{
+					return character_press;
+				}
+
+				// Setting up the recorder output
+				open_face_rec.SetObservationHOG(observation.success && !interpolated, hog_descriptor, num_hog_rows, num_hog_cols, 31); // The number of channels in HOG is fixed at the moment, as using FHOG
+				if (recording_params.outputTracked())
+				{
+					open_face_rec.SetObservationVisualization(visualizer.GetVisImage());
+				}
+				open_face_rec.SetObservationActionUnits(aus_reg, aus_class);
+				open_face_rec.SetObservationLandmarks(observation.landmarks_2D, observation.landmarks_3D, observation.params_global, observation.params_local, observation.confidence, observation.success);
+				open_face_rec.SetObservationPose(observation.pose);
+				open_face_rec.SetObservationGaze(observation.gaze_direction0, observation.gaze_direction1, observation.gaze_angle, observation.eye_landmarks_2D, observation.eye_landmarks_3D);
+				open_face_rec.SetObservationTimestamp(time_stamp);
+				open_face_rec.SetObservationFaceID(0);
+				open_face_rec.SetObservationFrameNumber(frame_number);
+				open_face_rec.SetObservationFaceAlign(sim_warped_img);
+				open_face_rec.SetObservationInterpolated(interpolated);
+				open_face_rec.WriteObservation();
+				open_face_rec.WriteObservationTracked();
+
+				return character_press;
+			};
+
+			// Tracking, gaze and AU analysis of a frame (every frame if not in keyframe mode), followed by recording the frames that were waiting for it
+			auto process_frame = [&](const cv::Mat& image, cv::Mat_<uchar>& grayscale_image, double time_stamp, int frame_number)
+			{
+				// The actual facial landmark detection / tracking
+				bool detection_success = LandmarkDetector::DetectLandmarksInVideo(image, face_model, det_parameters, grayscale_image);
+
+				FrameObservation observation;
+
+				// Everything derived from the fit (pose, 3D shape, eye landmarks and gaze) is computed once
+				LandmarkDetector::FaceResults face_results(face_model, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
+
+				// Gaze tracking, absolute gaze direction
+				if (detection_success && face_model.eye_model)
+				{
+					GazeAnalysis::EstimateGaze(face_results);
+				}
+				observation.gaze_direction0 = face_results.GazeDirection0(); observation.gaze_direction1 = face_results.GazeDirection1(); observation.gaze_angle = face_results.GazeAngle();
+
+				// Do face alignment
+				cv::Mat sim_warped_img;
+				cv::Mat_<double> hog_descriptor; int num_hog_rows = 0, num_hog_cols = 0;
+
+				// Perform AU detection and HOG feature extraction, as this can be expensive only compute it if needed by output or visualization
+				if (recording_params.outputAlignedFaces() || recording_params.outputHOG() || recording_params.outputAUs() || visualizer.vis_align || visualizer.vis_hog || visualizer.vis_aus)
+				{
+					face_analyser.AddNextFrame(image, face_model.detected_landmarks, face_model.detection_success, time_stamp, sequence_reader.IsWebcam());
+					face_analyser.GetLatestAlignedFace(sim_warped_img);
+					face_analyser.GetLatestHOG(hog_descriptor, num_hog_rows, num_hog_cols);
+				}
+
+				// Work out the pose of the head from the tracked model
+				observation.pose = face_results.Pose();
+
+				observation.landmarks_2D = face_model.detected_landmarks.clone();
+				observation.landmarks_3D = face_results.Shape3D();
+				observation.params_global = face_model.params_global;
+				observation.params_local = face_model.params_local.clone();
+				observation.confidence = face_model.detection_certainty;
+				observation.success = detection_success;
+				observation.visibilities = face_results.Visibilities();
+				observation.eye_landmarks_2D = face_results.EyeLandmarks2D();
+				observation.eye_landmarks_3D = face_results.EyeLandmarks3D();
+				Utilities::AUView aus_reg = face_analyser.GetCurrentAUsReg();
+				Utilities::AUView aus_class = face_analyser.GetCurrentAUsClass();
+				observation.aus_reg.assign(aus_reg.data(), aus_reg.data() + aus_reg.size());
+				observation.aus_class.assign(aus_class.data(), aus_class.data() + aus_class.size());
+
+				// The frames in between the keyframes are interpolated (there are no aligned faces or HOG features for them)
+				char character_press = '\0';
+				for (size_t i = 0; i < pending_frames.size() && character_press != 'q'; ++i)
+				{
+					double alpha = (double)(i + 1) / (double)(pending_frames.size() + 1);
+					FrameObservation interpolated = InterpolateObservation(last_keyframe, observation, alpha);
+
+					cv::Mat_<double> empty_hog = cv::Mat_<double>::zeros(last_hog_descriptor.size());
+					character_press = record_frame(std::get<0>(pending_frames[i]), interpolated, std::get<2>(pending_frames[i]), std::get<3>(pending_frames[i]), true,
+						cv::Mat(), empty_hog, last_num_hog_rows, last_num_hog_cols);
+				}
+				pending_frames.clear();
 
-			// Setting up the recorder output
-			open_face_rec.SetObservationHOG(detection_success, hog_descriptor, num_hog_rows, num_hog_cols, 31); // The number of channels in HOG is fixed at the moment, as using FHOG
-			open_face_rec.SetObservationVisualization(visualizer.GetVisImage());
-			open_face_rec.SetObservationActionUnits(face_analyser.GetCurrentAUsReg(), face_analyser.GetCurrentAUsClass());
-			open_face_rec.SetObservationLandmarks(face_model.detected_landmarks, face_model.GetShape(sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy),
-				face_model.params_global, face_model.params_local, face_model.detection_certainty, detection_success);
-			open_face_rec.SetObservationPose(pose_estimate);
-			open_face_rec.SetObservationGaze(gazeDirection0, gazeDirection1, gazeAngle, LandmarkDetector::CalculateAllEyeLandmarks(face_model), LandmarkDetector::Calculate3DEyeLandmarks(face_model, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy));
-			open_face_rec.SetObservationTimestamp(sequence_reader.time_stamp);
-			open_face_rec.SetObservationFaceID(0);
-			open_face_rec.SetObservationFrameNumber(sequence_reader.GetFrameNumber());
-			open_face_rec.SetObservationFaceAlign(sim_warped_img);
-			open_face_rec.WriteObservation();
-			open_face_rec.WriteObservationTracked();
-			
-			// Reporting progress
-			if (sequence_reader.GetProgress() >= reported_completion / 10.0)
+				if (character_press != 'q')
+				{
+					character_press = record_frame(image, observation, time_stamp, frame_number, false, sim_warped_img, hog_descriptor, num_hog_rows, num_hog_cols);
+				}
+
+				last_keyframe = observation;
+				have_keyframe = true;
+				last_hog_descriptor = hog_descriptor; last_num_hog_rows = num_hog_rows; last_num_hog_cols = num_hog_cols;
+
+				return character_press;
+			};
+
+			INFO_STREAM("Starting tracking");
+			while (!captured_image.empty())
 			{
-				std::cout << reported_completion * 10 << "% ";
-				if (reported_completion == 10)
+				// Converting to grayscale
+				cv::Mat_<uchar> grayscale_image = sequence_reader.GetGrayFrame();
+
+				bool keyframe = true;
+
+				if (keyframe_every > 1)
 				{
-					std::cout << std::endl;
+					// Keep tracking every frame until the face is found
+					keyframe = !have_keyframe || !last_keyframe.success || (int)pending_frames.size() + 1 >= keyframe_every;
+
+					cv::Mat_<uchar> small_frame;
+					if (keyframe_motion > 0)
+					{
+						cv::resize(grayscale_image, small_frame, cv::Size(), 0.125, 0.125, cv::INTER_AREA);
+						keyframe = keyframe || FrameMotion(small_frame, last_keyframe_small) > keyframe_motion;
+					}
+
+					if (keyframe)
+					{
+						last_keyframe_small = small_frame;
+					}
+					else
+					{
+						pending_frames.push_back(std::make_tuple(captured_image, grayscale_image, sequence_reader.time_stamp, (int)sequence_reader.GetFrameNumber()));
+					}
 				}
-				reported_completion = reported_completion + 1;
+
+				if (keyframe)
+				{
+					char character_press = process_frame(captured_image, grayscale_image, sequence_reader.time_stamp, (int)sequence_reader.GetFrameNumber());
+
+					// quit processing the current sequence (useful when in Webcam mode)
+					if (character_press == 'q')
+					{
+						pending_frames.clear();
+						break;
+					}
+				}
+
+				// Reporting progress
+				if (sequence_reader.GetProgress() >= reported_completion / 10.0)
+				{
+					std::cout << reported_completion * 10 << "% ";
+					if (reported_completion == 10)
+					{
+						std::cout << std::endl;
+					}
+					reported_completion = reported_completion + 1;
+				}
+
+				// Grabbing the next frame in the sequence
+				captured_image = sequence_reader.GetNextFrame();
+
 			}
 
-			// Grabbing the next frame in the sequence
-			captured_image = sequence_reader.GetNextFrame();
+			// The last frame is always a keyframe, so that there is nothing to extrapolate
+			if (!pending_frames.empty())
+			{
+				std::tuple<cv::Mat, cv::Mat_<uchar>, double, int> last_frame = pending_frames.back();
+				pending_frames.pop_back();
+				process_frame(std::get<0>(last_frame), std::get<1>(last_frame), std::get<2>(last_frame), std::get<3>(last_frame));
+			}
 
-		}
+			if (sequence_reader.IsWebcam() && sequence_reader.live_mode)
+			{
+				INFO_STREAM("Frames dropped in live mode: " << sequence_reader.GetDroppedFrames());
+			}
 
-		INFO_STREAM("Closing output recorder");
-		open_face_rec.Close();
-		INFO_STREAM("Closing input reader");
-		sequence_reader.Close();
-		INFO_STREAM("Closed successfully");
+			INFO_STREAM("Closing output recorder");
+			open_face_rec.Close();
+			INFO_STREAM("Closing input reader");
+			sequence_reader.Close();
+			INFO_STREAM("Closed successfully");
+
+			if (recording_params.outputAUs())
+			{
+				INFO_STREAM("Postprocessing the Action Unit predictions");
+				face_analyser.PostprocessOutputFile(open_face_rec.GetCSVFile());
+			}
 
-		if (recording_params.outputAUs())
+			if (server_mode)
+			{
+				protocol << "OUTPUT " << open_face_rec.GetCSVFile() << std::endl;
+			}
+
+			// Reset the models for the next video
+			face_analyser.Reset();
+			face_model.Reset();
+		}
+		catch (const std::exception& e)
 		{
-			INFO_STREAM("Postprocessing the Action Unit predictions");
-			face_analyser.PostprocessOutputFile(open_face_rec.GetCSVFile());
+			if (!server_mode)
+				throw;
+
+			// The message has to fit on the line
+			std::string message = e.what();
+			std::replace(message.begin(), message.end(), '\n', ' ');
+			protocol << "ERROR " << message << std::endl;
+			abandon_job();
 		}
+		catch (...)
+		{
+			if (!server_mode)
+				throw;
 
-		// Reset the models for the next video
-		face_analyser.Reset();
-		face_model.Reset();
+			protocol << "ERROR Unknown error" << std::endl;
+			abandon_job();
+		}
 
 	}
 
+	std::cout.rdbuf(protocol.rdbuf());
 	return 0;
 }
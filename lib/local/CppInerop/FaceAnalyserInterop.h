@@ -152,14 +152,14 @@ public:
 		auto au_intensities = gcnew Dictionary<System::String^, double>();
 		auto au_occurences = gcnew Dictionary<System::String^, double>();
 
-		for (auto p : AU_predictions_intensity)
+		for (int id = 0; id < (int)AU_predictions_intensity.size(); ++id)
 		{
-			au_intensities->Add(gcnew System::String(p.first.c_str()), p.second);
+			au_intensities->Add(gcnew System::String(AU_predictions_intensity.Name(id).c_str()), AU_predictions_intensity[id]);
 		}
 
-		for (auto p : AU_predictions_occurence)
+		for (int id = 0; id < (int)AU_predictions_occurence.size(); ++id)
 		{
-			au_occurences->Add(gcnew System::String(p.first.c_str()), p.second);
+			au_occurences->Add(gcnew System::String(AU_predictions_occurence.Name(id).c_str()), AU_predictions_occurence[id]);
 		}
 
 		return gcnew System::Tuple<Dictionary<System::String^, double>^, Dictionary<System::String^, double>^>(au_intensities, au_occurences);
@@ -201,9 +201,9 @@ public:
 		auto classes = face_analyser->GetCurrentAUsClass();
 		auto au_classes = gcnew Dictionary<System::String^, double>();
 
-		for(auto p: classes)
+		for(int id = 0; id < (int)classes.size(); ++id)
 		{
-			au_classes->Add(gcnew System::String(p.first.c_str()), p.second);
+			au_classes->Add(gcnew System::String(classes.Name(id).c_str()), classes[id]);
 		}
 		return au_classes;
 	}
@@ -213,9 +213,9 @@ public:
 		auto preds = face_analyser->GetCurrentAUsReg();
 		auto au_preds = gcnew Dictionary<System::String^, double>();
 
-		for(auto p: preds)
+		for(int id = 0; id < (int)preds.size(); ++id)
 		{
-			au_preds->Add(gcnew System::String(p.first.c_str()), p.second);
+			au_preds->Add(gcnew System::String(preds.Name(id).c_str()), preds[id]);
 		}
 		return au_preds;
 	}
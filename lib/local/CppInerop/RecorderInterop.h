@@ -162,24 +162,28 @@ namespace UtilitiesOF {
 
 		void SetObservationActionUnits(Dictionary<System::String^, double>^ au_regs, Dictionary<System::String^, double>^ au_class)
 		{
-			std::vector<std::pair<std::string, double> > au_regs_std;
+			// The recorder only keeps a copy of the schemas if they changed
+			std::vector<std::string> au_regs_names;
+			std::vector<double> au_regs_std;
 			auto enum_reg = au_regs->GetEnumerator();
 			while (enum_reg.MoveNext())
 			{
-				std::string au_name = msclr::interop::marshal_as<std::string>(enum_reg.Current.Key);
-				double value = (double)enum_reg.Current.Value;
-				au_regs_std.push_back(std::pair<std::string, double>(au_name, value));
+				au_regs_names.push_back(msclr::interop::marshal_as<std::string>(enum_reg.Current.Key));
+				au_regs_std.push_back((double)enum_reg.Current.Value);
 			}
 
-			std::vector<std::pair<std::string, double> > au_class_std;
+			std::vector<std::string> au_class_names;
+			std::vector<double> au_class_std;
 			auto enum_class = au_class->GetEnumerator();
 			while (enum_class.MoveNext())
 			{
-				std::string au_name = msclr::interop::marshal_as<std::string>(enum_class.Current.Key);
-				double value = (double)enum_class.Current.Value;
-				au_class_std.push_back(std::pair<std::string, double>(au_name, value));
+				au_class_names.push_back(msclr::interop::marshal_as<std::string>(enum_class.Current.Key));
+				au_class_std.push_back((double)enum_class.Current.Value);
 			} 
-			m_recorder->SetObservationActionUnits(au_regs_std, au_class_std);
+
+			Utilities::AUSchema au_regs_schema(au_regs_names);
+			Utilities::AUSchema au_class_schema(au_class_names);
+			m_recorder->SetObservationActionUnits(Utilities::AUView(au_regs_schema, au_regs_std), Utilities::AUView(au_class_schema, au_class_std));
 		}
 
 		void SetObservationFaceAlign(OpenCVWrappers::RawImage^ aligned_face_image)
@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef AU_HISTORY_H
+#define AU_HISTORY_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+
+namespace FaceAnalysis
+{
+
+//===========================================================================
+// History of the per frame AU predictions of a sequence (together with the frame timestamps and tracking success), used for the offline post-processing.
+// Values are addressed by frame and by AU id (the position of the AU in the model), and are kept as float in blocks of frames, within a block
+// the values of an AU are contiguous. For very long sequences the full blocks can be spilled to a temporary file, so the memory used stays constant.
+class AUHistory{
+
+public:
+
+	// The number of frames in a block, a block is also the unit that is spilled to disk
+	static const int BLOCK_FRAMES = 4096;
+
+	AUHistory();
+	~AUHistory();
+
+	// The history belongs to a single sequence, so it can not be copied
+	AUHistory(const AUHistory& other) = delete;
+	AUHistory& operator=(const AUHistory& other) = delete;
+
+	// Set the number of AUs per frame, this clears the history
+	void Reset(int num_aus);
+
+	// Full blocks will be moved to a temporary file in this directory, empty keeps everything in memory (the default)
+	void SetSpillDirectory(const std::string& directory);
+	std::string GetSpillDirectory() const { return spill_directory; }
+
+	// Add the next frame, values has the prediction for every AU id
+	void Append(double timestamp, bool success, const std::vector<float>& values);
+
+	// Change a prediction of an earlier frame (used when the initial frames are predicted again)
+	void Set(size_t frame, int au_id, float value);
+
+	size_t NumberOfFrames() const { return num_frames; }
+	int NumberOfAUs() const { return num_aus; }
+
+	// The predictions of an AU across all of the frames
+	void GetPredictions(int au_id, std::vector<double>& predictions);
+
+	void GetTimestamps(std::vector<double>& timestamps);
+	void GetSuccesses(std::vector<bool>& successes);
+
+private:
+
+	struct Block
+	{
+		std::vector<double> timestamps;
+		std::vector<unsigned char> successes;
+
+		// BLOCK_FRAMES values per AU, one AU after the other
+		std::vector<float> predictions;
+
+		// Once spilled the vectors above are empty and the block is read from the file when needed
+		bool spilled = false;
+	};
+
+	// Size of a block in the spill file
+	std::streamoff BlockBytes() const;
+
+	// Write the block to the spill file and free its memory
+	void Spill(size_t block_id);
+
+	// Read parts of a spilled block back, if that fails the data is zeroed and false returned
+	bool ReadSpilled(size_t block_id, std::streamoff offset, char* data, std::streamsize size);
+
+	// Report a failed read or write of the spill file (only the first one is reported) and clear the stream state
+	void SpillFileError(const std::string& message);
+
+	int num_aus;
+	size_t num_frames;
+
+	std::vector<Block> blocks;
+
+	std::string spill_directory;
+	std::string spill_location;
+	std::fstream spill_file;
+	bool spill_error_reported;
+
+};
+  //===========================================================================
+}
+#endif // AU_HISTORY_H
@@ -50,6 +50,10 @@
 #include "SVM_dynamic_lin.h"
 #include "PDM.h"
 #include "FaceAnalyserParameters.h"
+#include "AUHistory.h"
+
+#include <FramePool.h>
+#include <AUSchema.h>
 
 namespace FaceAnalysis
 {
@@ -64,14 +68,17 @@ public:
 	// Constructor for FaceAnalyser using the parameters structure
 	FaceAnalyser(const FaceAnalysis::FaceAnalyserParameters& face_analyser_params);
 
+	// A copy constructor, the copy shares the AU models with the original but has its own tracking state (useful for analysing several sequences at once)
+	FaceAnalyser(const FaceAnalyser& other);
+
 	void AddNextFrame(const cv::Mat& frame, const cv::Mat_<float>& detected_landmarks, bool success, double timestamp_seconds, bool online = false);
 
 	double GetCurrentTimeSeconds();
 	
-	// Grab the current predictions about AUs from the face analyser
-	std::vector<std::pair<std::string, double>> GetCurrentAUsClass() const; // AU presence
-	std::vector<std::pair<std::string, double>> GetCurrentAUsReg() const;   // AU intensity
-	std::vector<std::pair<std::string, double>> GetCurrentAUsCombined() const; // Both presense and intensity
+	// Grab the current predictions about AUs from the face analyser, the views are valid until the next frame is added
+	Utilities::AUView GetCurrentAUsClass() const; // AU presence
+	Utilities::AUView GetCurrentAUsReg() const;   // AU intensity
+	Utilities::AUView GetCurrentAUsCombined() const; // Both presense and intensity
 
 	// A standalone call for predicting AUs and computing face texture features from a static image
 	void PredictStaticAUsAndComputeFeatures(const cv::Mat& frame, const cv::Mat_<float>& detected_landmarks);
@@ -91,6 +98,10 @@ public:
 	std::vector<std::string> GetAUClassNames() const; // Presence
 	std::vector<std::string> GetAURegNames() const; // Intensity
 
+	// The AUs being predicted, fixed once the model is loaded (the ids index the current predictions)
+	const Utilities::AUSchema& GetAUClassSchema() const { return au_schema_class; } // Presence
+	const Utilities::AUSchema& GetAURegSchema() const { return au_schema_reg; } // Intensity
+
 	// Identify if models are static or dynamic (useful for correction and shifting)
 	std::vector<bool> GetDynamicAUClass() const; // Presence
 	std::vector<std::pair<std::string, bool>> GetDynamicAUReg() const; // Intensity
@@ -109,17 +120,21 @@ private:
 	// Point distribution model coddesponding to the current Face Analyser
 	LandmarkDetector::PDM pdm;
 
-	// Where the predictions are kept
-	std::vector<std::pair<std::string, double>> AU_predictions_reg;
-	std::vector<std::pair<std::string, double>> AU_predictions_class;
+	// The AUs predicted, in the GetAURegNames and GetAUClassNames order
+	Utilities::AUSchema au_schema_reg;
+	Utilities::AUSchema au_schema_class;
+	Utilities::AUSchema au_schema_combined;
 
-	std::vector<std::pair<std::string, double>> AU_predictions_combined;
+	// Where the predictions are kept, indexed by the AU id in the corresponding schema
+	std::vector<double> AU_predictions_reg;
+	std::vector<double> AU_predictions_class;
 
-	// Keeping track of AU predictions over time (useful for post-processing)
-	std::vector<double> timestamps;
-	std::map<std::string, std::vector<double>> AU_predictions_reg_all_hist;
-	std::map<std::string, std::vector<double>> AU_predictions_class_all_hist;
-	std::vector<bool> valid_preds;
+	std::vector<double> AU_predictions_combined;
+
+	// Keeping track of AU predictions over time (useful for post-processing), the intensity AUs come first (in the GetAURegNames order)
+	// followed by the presence ones (in the GetAUClassNames order)
+	AUHistory AU_predictions_all_hist;
+	int num_au_reg_hist;
 
 	int frames_tracking;
 
@@ -129,6 +144,9 @@ private:
 	// Cache of intermediate images
 	cv::Mat aligned_face_for_au;
 	cv::Mat aligned_face_for_output;
+
+	// The aligned faces handed out for recording are recycled once written
+	Utilities::FramePool aligned_face_pool;
 	bool out_grayscale;
 
 	// Private members to be used for predictions
@@ -157,6 +175,10 @@ private:
 	std::vector<int> hog_hist_sum;
 	int view_used;
 
+	// The PDM fit of the previous frame (empty if it was not tracked), used to warm start the fit of the next one
+	cv::Vec6f prev_params_global;
+	cv::Mat_<float> prev_params_local;
+
 	// The geometry descriptor (rigid followed by non-rigid shape parameters from CLNF)
 	cv::Mat_<double> geom_descriptor_frame;
 	cv::Mat_<double> geom_descriptor_median;
@@ -170,12 +192,12 @@ private:
 	// Using the bounding box of previous analysed frame to determine if a reset is needed
 	cv::Rect_<double> face_bounding_box;
 	
-	// The AU predictions internally
-	std::vector<std::pair<std::string, double>> PredictCurrentAUs(int view);
-	std::vector<std::pair<std::string, double>> PredictCurrentAUsClass(int view);
+	// The AU predictions internally (in the schema order, empty if there is no descriptor yet), the vectors are reused across frames
+	void PredictCurrentAUs(std::vector<double>& predictions, int view);
+	void PredictCurrentAUsClass(std::vector<double>& predictions, int view);
 
-	// special step for online (rather than offline AU prediction)
-	std::vector<std::pair<std::string, double>> CorrectOnlineAUs(std::vector<std::pair<std::string, double>> predictions_orig, int view, bool dyn_shift = false, bool dyn_scale = false, bool update_track = true, bool clip_values = false);
+	// special step for online (rather than offline AU prediction), corrects the predictions in place
+	void CorrectOnlineAUs(std::vector<double>& predictions, int view, bool dyn_shift = false, bool dyn_scale = false, bool update_track = true, bool clip_values = false);
 
 	void Read(std::string model_loc);
 
@@ -200,7 +222,7 @@ private:
 	// The AUs predicted by the model are not always 0 calibrated to a person. That is they don't always predict 0 for a neutral expression
 	// Keeping track of the predictions we can correct for this, by assuming that at least "ratio" of frames are neutral and subtract that value of prediction, only perform the correction after min_frames
 	void UpdatePredictionTrack(cv::Mat_<int>& prediction_corr_histogram, int& prediction_correction_count, 
-		std::vector<double>& correction, const std::vector<std::pair<std::string, double>>& predictions, double ratio=0.25, int num_bins = 200, double min_val = -3, double max_val = 5, int min_frames = 10);
+		std::vector<double>& correction, const std::vector<double>& predictions, double ratio=0.25, int num_bins = 200, double min_val = -3, double max_val = 5, int min_frames = 10);
 	void GetSampleHist(cv::Mat_<int>& prediction_corr_histogram, int prediction_correction_count, 
 		std::vector<double>& sample, double ratio, int num_bins = 200, double min_val = 0, double max_val = 5);
 
@@ -233,8 +255,9 @@ private:
 
 	// Useful placeholder for renormalizing the initial frames of shorter videos
 	int max_init_frames = 3000;
-	std::vector<cv::Mat_<double>> hog_desc_frames_init;
-	std::vector<cv::Mat_<double>> geom_descriptor_frames_init;
+	// one descriptor per row, in float as they are only needed approximately
+	cv::Mat_<float> hog_desc_frames_init;
+	cv::Mat_<float> geom_descriptor_frames_init;
 	std::vector<int> views;
 	bool postprocessed = false;
 	int frames_tracking_succ = 0;
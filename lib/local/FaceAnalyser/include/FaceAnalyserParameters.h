@@ -69,6 +69,10 @@ public:
 	std::string getModelLoc() const { return std::string(model_location); }
 	std::vector<cv::Vec3d> getOrientationBins() const { return std::vector<cv::Vec3d>(orientation_bins); }
 
+	// Where the AU prediction history of long sequences is spilled to, empty if it is kept in memory
+	std::string getHistorySpillDir() const { return history_spill_dir; }
+	void setHistorySpillDir(const std::string& directory) { history_spill_dir = directory; }
+
 private:
 
 	void init();
@@ -90,6 +94,8 @@ private:
 
 	std::vector<cv::Vec3d> orientation_bins;
 
+	std::string history_spill_dir;
+
 };
 
 }
@@ -55,8 +55,8 @@ public:
 	SVM_static_lin()
 	{}
 
-	// Predict the AU from HOG appearance of the face
-	void Predict(std::vector<double>& predictions, std::vector<std::string>& names, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params);
+	// Predict the AU from HOG appearance of the face, the predictions are appended in the GetAUNames order
+	void Predict(std::vector<double>& predictions, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params);
 
 	// Reading in the model (or adding to it)
 	void Read(std::ifstream& stream, const std::vector<std::string>& au_names);
@@ -0,0 +1,279 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdafx_fa.h>
+
+#include "AUHistory.h"
+
+#include <atomic>
+
+using namespace FaceAnalysis;
+
+AUHistory::AUHistory() : num_aus(0), num_frames(0), spill_error_reported(false)
+{
+}
+
+AUHistory::~AUHistory()
+{
+	Reset(0);
+}
+
+void AUHistory::Reset(int num_aus)
+{
+	this->num_aus = num_aus;
+	num_frames = 0;
+	blocks.clear();
+	spill_error_reported = false;
+
+	// Nothing is spilled anymore, so the file can go
+	if (spill_file.is_open())
+	{
+		spill_file.close();
+	}
+	if (!spill_location.empty())
+	{
+		std::remove(spill_location.c_str());
+		spill_location.clear();
+	}
+}
+
+void AUHistory::SetSpillDirectory(const std::string& directory)
+{
+	spill_directory = directory;
+}
+
+std::streamoff AUHistory::BlockBytes() const
+{
+	return (std::streamoff)BLOCK_FRAMES * (sizeof(double) + sizeof(unsigned char) + num_aus * sizeof(float));
+}
+
+void AUHistory::Append(double timestamp, bool success, const std::vector<float>& values)
+{
+	size_t frame_in_block = num_frames % BLOCK_FRAMES;
+
+	if (frame_in_block == 0)
+	{
+		// The previous block is full, it will not grow anymore so it can be spilled
+		if (!blocks.empty() && !spill_directory.empty())
+		{
+			Spill(blocks.size() - 1);
+		}
+
+		blocks.push_back(Block());
+		Block& block = blocks.back();
+		block.timestamps.resize(BLOCK_FRAMES, 0.0);
+		block.successes.resize(BLOCK_FRAMES, 0);
+		block.predictions.resize((size_t)BLOCK_FRAMES * num_aus, 0.0f);
+	}
+
+	Block& block = blocks.back();
+	block.timestamps[frame_in_block] = timestamp;
+	block.successes[frame_in_block] = success ? 1 : 0;
+
+	int num_values = std::min((int)values.size(), num_aus);
+	for (int au = 0; au < num_values; ++au)
+	{
+		block.predictions[(size_t)au * BLOCK_FRAMES + frame_in_block] = values[au];
+	}
+
+	num_frames++;
+}
+
+void AUHistory::Set(size_t frame, int au_id, float value)
+{
+	size_t block_id = frame / BLOCK_FRAMES;
+	size_t frame_in_block = frame % BLOCK_FRAMES;
+
+	Block& block = blocks[block_id];
+	if (!block.spilled)
+	{
+		block.predictions[(size_t)au_id * BLOCK_FRAMES + frame_in_block] = value;
+	}
+	else
+	{
+		std::streamoff offset = block_id * BlockBytes() + BLOCK_FRAMES * (sizeof(double) + sizeof(unsigned char)) + ((std::streamoff)au_id * BLOCK_FRAMES + frame_in_block) * sizeof(float);
+		spill_file.seekp(offset);
+		spill_file.write((const char*)&value, sizeof(float));
+		if (!spill_file.good())
+		{
+			SpillFileError("Could not update the AU history file " + spill_location);
+		}
+	}
+}
+
+void AUHistory::GetPredictions(int au_id, std::vector<double>& predictions)
+{
+	predictions.resize(num_frames);
+
+	std::vector<float> spilled_predictions;
+
+	for (size_t block_id = 0; block_id < blocks.size(); ++block_id)
+	{
+		const float* block_predictions;
+		if (!blocks[block_id].spilled)
+		{
+			block_predictions = &blocks[block_id].predictions[(size_t)au_id * BLOCK_FRAMES];
+		}
+		else
+		{
+			// As the values of an AU are contiguous only they need to be read
+			spilled_predictions.resize(BLOCK_FRAMES);
+			ReadSpilled(block_id, BLOCK_FRAMES * (sizeof(double) + sizeof(unsigned char)) + (std::streamoff)au_id * BLOCK_FRAMES * sizeof(float), (char*)spilled_predictions.data(), BLOCK_FRAMES * sizeof(float));
+			block_predictions = spilled_predictions.data();
+		}
+
+		size_t block_start = block_id * BLOCK_FRAMES;
+		size_t block_end = std::min(block_start + BLOCK_FRAMES, num_frames);
+		for (size_t frame = block_start; frame < block_end; ++frame)
+		{
+			predictions[frame] = block_predictions[frame - block_start];
+		}
+	}
+}
+
+void AUHistory::GetTimestamps(std::vector<double>& timestamps)
+{
+	timestamps.resize(num_frames);
+
+	for (size_t block_id = 0; block_id < blocks.size(); ++block_id)
+	{
+		size_t block_start = block_id * BLOCK_FRAMES;
+		size_t block_frames = std::min(block_start + BLOCK_FRAMES, num_frames) - block_start;
+
+		if (!blocks[block_id].spilled)
+		{
+			std::copy(blocks[block_id].timestamps.begin(), blocks[block_id].timestamps.begin() + block_frames, timestamps.begin() + block_start);
+		}
+		else
+		{
+			ReadSpilled(block_id, 0, (char*)&timestamps[block_start], block_frames * sizeof(double));
+		}
+	}
+}
+
+void AUHistory::GetSuccesses(std::vector<bool>& successes)
+{
+	successes.resize(num_frames);
+
+	std::vector<unsigned char> spilled_successes;
+
+	for (size_t block_id = 0; block_id < blocks.size(); ++block_id)
+	{
+		const unsigned char* block_successes;
+		if (!blocks[block_id].spilled)
+		{
+			block_successes = blocks[block_id].successes.data();
+		}
+		else
+		{
+			spilled_successes.resize(BLOCK_FRAMES);
+			ReadSpilled(block_id, BLOCK_FRAMES * sizeof(double), (char*)spilled_successes.data(), BLOCK_FRAMES);
+			block_successes = spilled_successes.data();
+		}
+
+		size_t block_start = block_id * BLOCK_FRAMES;
+		size_t block_end = std::min(block_start + BLOCK_FRAMES, num_frames);
+		for (size_t frame = block_start; frame < block_end; ++frame)
+		{
+			successes[frame] = block_successes[frame - block_start] != 0;
+		}
+	}
+}
+
+void AUHistory::Spill(size_t block_id)
+{
+	if (!spill_file.is_open())
+	{
+		// Several analysers (and processes) can spill to the same directory
+		static std::atomic<int> spill_count(0);
+		std::stringstream name;
+		name << "au_history_" << std::hex << (size_t)this << "_" << cv::getTickCount() << "_" << spill_count++ << ".tmp";
+		spill_location = (fs::path(spill_directory) / name.str()).string();
+
+		spill_file.open(spill_location, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!spill_file.is_open())
+		{
+			std::cout << "WARNING: Could not create the AU history file " << spill_location << ", keeping the history in memory" << std::endl;
+			spill_location.clear();
+			spill_directory.clear();
+			return;
+		}
+	}
+
+	// Blocks are spilled in order, so the block goes at the end of the file
+	Block& block = blocks[block_id];
+	spill_file.seekp(block_id * BlockBytes());
+	spill_file.write((const char*)block.timestamps.data(), BLOCK_FRAMES * sizeof(double));
+	spill_file.write((const char*)block.successes.data(), BLOCK_FRAMES);
+	spill_file.write((const char*)block.predictions.data(), block.predictions.size() * sizeof(float));
+	spill_file.flush();
+
+	// If the disk is full (or the file went away) this block and the ones after it stay in memory, the blocks spilled before are still in the file
+	if (!spill_file.good())
+	{
+		SpillFileError("Could not write to the AU history file " + spill_location + ", keeping the rest of the history in memory");
+		spill_directory.clear();
+		return;
+	}
+
+	block.spilled = true;
+	std::vector<double>().swap(block.timestamps);
+	std::vector<unsigned char>().swap(block.successes);
+	std::vector<float>().swap(block.predictions);
+}
+
+bool AUHistory::ReadSpilled(size_t block_id, std::streamoff offset, char* data, std::streamsize size)
+{
+	spill_file.seekg(block_id * BlockBytes() + offset);
+	spill_file.read(data, size);
+	if (!spill_file.good() || spill_file.gcount() != size)
+	{
+		SpillFileError("Could not read from the AU history file " + spill_location + ", the missing values are set to 0");
+		std::fill(data, data + size, 0);
+		return false;
+	}
+	return true;
+}
+
+void AUHistory::SpillFileError(const std::string& message)
+{
+	if (!spill_error_reported)
+	{
+		std::cout << "WARNING: " << message << std::endl;
+		spill_error_reported = true;
+	}
+
+	// Otherwise the following reads and writes of the stream would all fail
+	spill_file.clear();
+}
@@ -91,6 +91,51 @@ FaceAnalyser::FaceAnalyser(const FaceAnalysis::FaceAnalyserParameters& face_anal
 	au_prediction_correction_histogram.resize(head_orientations.size());
 	dyn_scaling.resize(head_orientations.size());
 
+	// The AUs are fixed once the models are read, the predictions refer to them by id
+	std::vector<std::string> au_reg_names = GetAURegNames();
+	std::vector<std::string> au_class_names = GetAUClassNames();
+	au_schema_reg = Utilities::AUSchema(au_reg_names);
+	au_schema_class = Utilities::AUSchema(au_class_names);
+
+	std::vector<std::string> au_combined_names = au_reg_names;
+	au_combined_names.insert(au_combined_names.end(), au_class_names.begin(), au_class_names.end());
+	au_schema_combined = Utilities::AUSchema(au_combined_names);
+
+	// The history has a value per AU for every frame
+	num_au_reg_hist = (int)au_schema_reg.size();
+	AU_predictions_all_hist.Reset(num_au_reg_hist + (int)au_schema_class.size());
+	AU_predictions_all_hist.SetSpillDirectory(face_analyser_params.getHistorySpillDir());
+
+}
+
+// The AU regressors and classifiers are only read during prediction, so they are shared with the original, while all of the tracking state starts afresh
+FaceAnalyser::FaceAnalyser(const FaceAnalyser& other) : pdm(other.pdm), 
+	au_schema_reg(other.au_schema_reg), au_schema_class(other.au_schema_class), au_schema_combined(other.au_schema_combined),
+	dynamic(other.dynamic), out_grayscale(other.out_grayscale),
+	num_bins_hog(other.num_bins_hog), min_val_hog(other.min_val_hog), max_val_hog(other.max_val_hog), 
+	num_bins_geom(other.num_bins_geom), min_val_geom(other.min_val_geom), max_val_geom(other.max_val_geom),
+	AU_SVR_static_appearance_lin_regressors(other.AU_SVR_static_appearance_lin_regressors), AU_SVR_dynamic_appearance_lin_regressors(other.AU_SVR_dynamic_appearance_lin_regressors),
+	AU_SVM_static_appearance_lin(other.AU_SVM_static_appearance_lin), AU_SVM_dynamic_appearance_lin(other.AU_SVM_dynamic_appearance_lin),
+	triangulation(other.triangulation), align_scale_au(other.align_scale_au), align_width_au(other.align_width_au), align_height_au(other.align_height_au),
+	align_mask(other.align_mask), align_scale_out(other.align_scale_out), align_width_out(other.align_width_out), align_height_out(other.align_height_out),
+	max_init_frames(other.max_init_frames)
+{
+	frames_tracking = 0;
+
+	head_orientations = other.head_orientations;
+	hog_hist_sum.resize(head_orientations.size());
+	face_image_hist_sum.resize(head_orientations.size());
+	hog_desc_hist.resize(head_orientations.size());
+	geom_hist_sum = 0;
+	face_image_hist.resize(head_orientations.size());
+
+	au_prediction_correction_count.resize(head_orientations.size(), 0);
+	au_prediction_correction_histogram.resize(head_orientations.size());
+	dyn_scaling.resize(head_orientations.size());
+
+	num_au_reg_hist = other.num_au_reg_hist;
+	AU_predictions_all_hist.Reset(other.AU_predictions_all_hist.NumberOfAUs());
+	AU_predictions_all_hist.SetSpillDirectory(other.AU_predictions_all_hist.GetSpillDirectory());
 }
 
 // Utility for getting the names of returned AUs (presence)
@@ -190,7 +235,7 @@ void FaceAnalyser::GetLatestHOG(cv::Mat_<double>& hog_descriptor, int& num_rows,
 
 void FaceAnalyser::GetLatestAlignedFace(cv::Mat& image)
 {
-	image = this->aligned_face_for_output.clone();
+	image = aligned_face_pool.Copy(this->aligned_face_for_output);
 }
 
 void FaceAnalyser::GetLatestNeutralHOG(cv::Mat_<double>& hog_descriptor, int& num_rows, int& num_cols)
@@ -245,7 +290,7 @@ void FaceAnalyser::PredictStaticAUsAndComputeFeatures(const cv::Mat& frame, cons
 	// If the aligned face for AU matches the output requested one, just reuse it, else compute it
 	if (align_scale_out == align_scale_au && align_width_out == align_width_au && align_height_out == align_height_au && align_mask)
 	{
-		aligned_face_for_output = aligned_face_for_au.clone();
+		aligned_face_for_au.copyTo(aligned_face_for_output);
 	}
 	else
 	{
@@ -287,21 +332,18 @@ void FaceAnalyser::PredictStaticAUsAndComputeFeatures(const cv::Mat& frame, cons
 	//aligned_face_cols.convertTo(aligned_face_cols_double, CV_64F);
 	
 	// Perform AU prediction	
-	auto AU_predictions_intensity = PredictCurrentAUs(orientation_to_use);
-	auto AU_predictions_occurence = PredictCurrentAUsClass(orientation_to_use);
+	PredictCurrentAUs(AU_predictions_reg, orientation_to_use);
+	PredictCurrentAUsClass(AU_predictions_class, orientation_to_use);
 
 	// Make sure intensity is within range (0-5)
-	for (size_t au = 0; au < AU_predictions_intensity.size(); ++au)
+	for (size_t au = 0; au < AU_predictions_reg.size(); ++au)
 	{
-		if (AU_predictions_intensity[au].second < 0)
-			AU_predictions_intensity[au].second = 0;
+		if (AU_predictions_reg[au] < 0)
+			AU_predictions_reg[au] = 0;
 
-		if (AU_predictions_intensity[au].second > 5)
-			AU_predictions_intensity[au].second = 5;
+		if (AU_predictions_reg[au] > 5)
+			AU_predictions_reg[au] = 5;
 	}
-	
-	AU_predictions_reg = AU_predictions_intensity;
-	AU_predictions_class = AU_predictions_occurence;
 
 }
 
@@ -318,7 +360,13 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const cv::Mat_<float>& det
 	if(success)
 	{
 
-		pdm.CalcParams(params_global, params_local, detected_landmarks);
+		// Start from the previous frame's fit if there was one, as the face does not move much between frames
+		params_global = prev_params_global;
+		params_local = prev_params_local;
+		pdm.RefineParams(params_global, params_local, detected_landmarks);
+
+		prev_params_global = params_global;
+		prev_params_local = params_local.clone();
 
 		// The aligned face requirement for AUs
 		AlignFaceMask(aligned_face_for_au, frame, detected_landmarks, params_global, pdm, triangulation, true, align_scale_au, align_width_au, align_height_au);
@@ -326,7 +374,7 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const cv::Mat_<float>& det
 		// If the aligned face for AU matches the output requested one, just reuse it, else compute it
 		if (align_scale_out == align_scale_au && align_width_out == align_width_au && align_height_out == align_height_au && align_mask)
 		{
-			aligned_face_for_output = aligned_face_for_au.clone();
+			aligned_face_for_au.copyTo(aligned_face_for_output);
 		}
 		else
 		{
@@ -342,11 +390,15 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const cv::Mat_<float>& det
 	}
 	else
 	{
-		aligned_face_for_output = cv::Mat(align_height_out, align_width_out, CV_8UC3);
-		aligned_face_for_au = cv::Mat(align_height_au, align_width_au, CV_8UC3);
+		aligned_face_for_output.create(align_height_out, align_width_out, CV_8UC3);
+		aligned_face_for_au.create(align_height_au, align_width_au, CV_8UC3);
 		aligned_face_for_output.setTo(0);
 		aligned_face_for_au.setTo(0);
 		params_local = cv::Mat_<float>(pdm.NumberOfModes(), 1, 0.0f);
+
+		// Nothing to start the next fit from
+		prev_params_global = cv::Vec6f();
+		prev_params_local = cv::Mat_<float>();
 	}
 
 	if (aligned_face_for_output.channels() == 3 && out_grayscale)
@@ -429,60 +481,59 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const cv::Mat_<float>& det
 	}
 	
 	// Perform AU prediction	
-	AU_predictions_reg = PredictCurrentAUs(orientation_to_use);
+	PredictCurrentAUs(AU_predictions_reg, orientation_to_use);
+
+	// The historic data of this frame, the predictions come in the same order as the AU names
+	std::vector<float> AU_predictions_frame(AU_predictions_all_hist.NumberOfAUs(), 0.0f);
 
 	// Add the reg predictions to the historic data
 	for (size_t au = 0; au < AU_predictions_reg.size(); ++au)
 	{
 
-		// Find the appropriate AU (if not found add it)		
 		// Only add if the detection was successful
 		if(success)
 		{
-			AU_predictions_reg_all_hist[AU_predictions_reg[au].first].push_back(AU_predictions_reg[au].second);
+			AU_predictions_frame[au] = (float)AU_predictions_reg[au];
 		}
 		else
 		{
-			AU_predictions_reg_all_hist[AU_predictions_reg[au].first].push_back(0);
-
 			// Also invalidate AU if not successful
-			AU_predictions_reg[au].second = 0;
+			AU_predictions_reg[au] = 0;
 		}
 	}
 	
-	AU_predictions_class = PredictCurrentAUsClass(orientation_to_use);
+	PredictCurrentAUsClass(AU_predictions_class, orientation_to_use);
 
 	for (size_t au = 0; au < AU_predictions_class.size(); ++au)
 	{
 
-		// Find the appropriate AU (if not found add it)		
 		// Only add if the detection was successful
 		if(success)
 		{
-			AU_predictions_class_all_hist[AU_predictions_class[au].first].push_back(AU_predictions_class[au].second);
+			AU_predictions_frame[num_au_reg_hist + au] = (float)AU_predictions_class[au];
 		}
 		else
 		{
-			AU_predictions_class_all_hist[AU_predictions_class[au].first].push_back(0);
-
 			// Also invalidate AU if not successful
-			AU_predictions_class[au].second = 0;
+			AU_predictions_class[au] = 0;
 		}
 	}	
 
 	// A workaround for online predictions to make them a bit more accurate
-	std::vector<std::pair<std::string, double>> AU_predictions_reg_corrected;
 	if (online)
 	{
-		AU_predictions_reg_corrected = CorrectOnlineAUs(AU_predictions_reg, orientation_to_use, true, false, success, true);
-		AU_predictions_reg = AU_predictions_reg_corrected;
+		CorrectOnlineAUs(AU_predictions_reg, orientation_to_use, true, false, success, true);
 	}
 
 	// Useful for prediction corrections (calibration after the whole video is processed)
 	if (success && frames_tracking_succ - 1 < max_init_frames)
 	{
-		hog_desc_frames_init.push_back(hog_descriptor);
-		geom_descriptor_frames_init.push_back(geom_descriptor_frame);
+		cv::Mat_<float> hog_descriptor_f, geom_descriptor_f;
+		hog_descriptor.convertTo(hog_descriptor_f, CV_32F);
+		geom_descriptor_frame.convertTo(geom_descriptor_f, CV_32F);
+
+		hog_desc_frames_init.push_back(hog_descriptor_f);
+		geom_descriptor_frames_init.push_back(geom_descriptor_f);
 		views.push_back(orientation_to_use);
 	}
 
@@ -490,8 +541,7 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const cv::Mat_<float>& det
 
 	view_used = orientation_to_use;
 			
-	valid_preds.push_back(success);
-	timestamps.push_back(timestamp_seconds);
+	AU_predictions_all_hist.Append(timestamp_seconds, success, AU_predictions_frame);
 
 }
 
@@ -507,7 +557,13 @@ void FaceAnalyser::PostprocessPredictions()
 	{
 		int success_ind = 0;
 		int all_ind = 0;
-		int all_frames_size = (int)timestamps.size();
+		int all_frames_size = (int)AU_predictions_all_hist.NumberOfFrames();
+
+		std::vector<bool> valid_preds;
+		AU_predictions_all_hist.GetSuccesses(valid_preds);
+
+		// Reused for every frame
+		std::vector<double> AU_predictions_init;
 		
 		while(all_ind < all_frames_size && success_ind < max_init_frames)
 		{
@@ -515,26 +571,27 @@ void FaceAnalyser::PostprocessPredictions()
 			if(valid_preds[all_ind])
 			{
 
-				this->hog_desc_frame = hog_desc_frames_init[success_ind];
-				this->geom_descriptor_frame = geom_descriptor_frames_init[success_ind];
+				// Fresh matrices, as the current ones might be shared
+				cv::Mat_<double> hog_desc_init, geom_descriptor_init;
+				hog_desc_frames_init.row(success_ind).convertTo(hog_desc_init, CV_64F);
+				geom_descriptor_frames_init.row(success_ind).convertTo(geom_descriptor_init, CV_64F);
+				this->hog_desc_frame = hog_desc_init;
+				this->geom_descriptor_frame = geom_descriptor_init;
 
 				// Perform AU prediction	
-				auto AU_predictions_reg = PredictCurrentAUs(views[success_ind]);								
+				PredictCurrentAUs(AU_predictions_init, views[success_ind]);
 
 				// Modify the predictions to the historic data
-				for (size_t au = 0; au < AU_predictions_reg.size(); ++au)
+				for (size_t au = 0; au < AU_predictions_init.size(); ++au)
 				{
-					// Find the appropriate AU (if not found add it)		
-					AU_predictions_reg_all_hist[AU_predictions_reg[au].first][all_ind] = AU_predictions_reg[au].second;
-
+					AU_predictions_all_hist.Set(all_ind, (int)au, (float)AU_predictions_init[au]);
 				}
 
-				auto AU_predictions_class = PredictCurrentAUsClass(views[success_ind]);
+				PredictCurrentAUsClass(AU_predictions_init, views[success_ind]);
 
-				for (size_t au = 0; au < AU_predictions_class.size(); ++au)
+				for (size_t au = 0; au < AU_predictions_init.size(); ++au)
 				{
-					// Find the appropriate AU (if not found add it)		
-					AU_predictions_class_all_hist[AU_predictions_class[au].first][all_ind] = AU_predictions_class[au].second;
+					AU_predictions_all_hist.Set(all_ind, num_au_reg_hist + (int)au, (float)AU_predictions_init[au]);
 				}
 		
 				success_ind++;
@@ -554,21 +611,23 @@ void FaceAnalyser::ExtractAllPredictionsOfflineReg(std::vector<std::pair<std::st
 		PostprocessPredictions();
 	}
 
-	timestamps = this->timestamps;
+	AU_predictions_all_hist.GetTimestamps(timestamps);
 	au_predictions.clear();
 	// First extract the valid AU values and put them in a different format
 	std::vector<std::vector<double>> aus_valid;
 	std::vector<double> offsets;
-	successes = this->valid_preds;
+	AU_predictions_all_hist.GetSuccesses(successes);
 	
 	std::vector<std::string> dyn_au_names = AU_SVR_dynamic_appearance_lin_regressors.GetAUNames();
+	std::vector<std::string> au_reg_names = GetAURegNames();
 
 	// Allow these AUs to be person calirated based on expected number of neutral frames (learned from the data)
-	for(auto au_iter = AU_predictions_reg_all_hist.begin(); au_iter != AU_predictions_reg_all_hist.end(); ++au_iter)
+	for(int au_id = 0; au_id < num_au_reg_hist; ++au_id)
 	{
 		std::vector<double> au_good;
-		std::string au_name = au_iter->first;
-		std::vector<double> au_vals = au_iter->second;
+		std::string au_name = au_reg_names[au_id];
+		std::vector<double> au_vals;
+		AU_predictions_all_hist.GetPredictions(au_id, au_vals);
 		
 		au_predictions.push_back(std::pair<std::string, std::vector<double>>(au_name, au_vals));
 
@@ -675,13 +734,16 @@ void FaceAnalyser::ExtractAllPredictionsOfflineClass(std::vector<std::pair<std::
 		PostprocessPredictions();
 	}
 
-	timestamps = this->timestamps;
+	AU_predictions_all_hist.GetTimestamps(timestamps);
 	au_predictions.clear();
 
-	for(auto au_iter = AU_predictions_class_all_hist.begin(); au_iter != AU_predictions_class_all_hist.end(); ++au_iter)
+	std::vector<std::string> au_class_names = GetAUClassNames();
+
+	for(int au_id = 0; au_id < AU_predictions_all_hist.NumberOfAUs() - num_au_reg_hist; ++au_id)
 	{
-		std::string au_name = au_iter->first;
-		std::vector<double> au_vals = au_iter->second;
+		std::string au_name = au_class_names[au_id];
+		std::vector<double> au_vals;
+		AU_predictions_all_hist.GetPredictions(num_au_reg_hist + au_id, au_vals);
 		
 		// Perform a moving average of 7 frames on classifications
 		int window_size = 7;
@@ -710,7 +772,7 @@ void FaceAnalyser::ExtractAllPredictionsOfflineClass(std::vector<std::pair<std::
 
 	}
 
-	successes = this->valid_preds;
+	AU_predictions_all_hist.GetSuccesses(successes);
 }
 
 // Reset the models
@@ -718,6 +780,9 @@ void FaceAnalyser::Reset()
 {
 	frames_tracking = 0;
 
+	prev_params_global = cv::Vec6f();
+	prev_params_local = cv::Mat_<float>();
+
 	this->hog_desc_median.setTo(cv::Scalar(0));
 	this->face_image_median.setTo(cv::Scalar(0));
 
@@ -749,14 +814,12 @@ void FaceAnalyser::Reset()
 	AU_predictions_reg.clear();
 	AU_predictions_class.clear();
 	AU_predictions_combined.clear();
-	timestamps.clear();
-	AU_predictions_reg_all_hist.clear();
-	AU_predictions_class_all_hist.clear();
-	valid_preds.clear();
+	AU_predictions_all_hist.Reset(AU_predictions_all_hist.NumberOfAUs());
 
 	// Clean up the postprocessing data as well
-	hog_desc_frames_init.clear();
-	geom_descriptor_frames_init.clear();
+	hog_desc_frames_init.release();
+	geom_descriptor_frames_init.release();
+	views.clear();
 	postprocessed = false;
 	frames_tracking_succ = 0;
 }
@@ -860,45 +923,26 @@ void FaceAnalyser::ExtractMedian(cv::Mat_<int>& histogram, int hist_count, cv::M
 	}
 }
 // Apply the current predictors to the currently stored descriptors
-std::vector<std::pair<std::string, double>> FaceAnalyser::PredictCurrentAUs(int view)
+void FaceAnalyser::PredictCurrentAUs(std::vector<double>& predictions, int view)
 {
 
-	std::vector<std::pair<std::string, double>> predictions;
+	predictions.clear();
 
 	if(!hog_desc_frame.empty())
 	{
-		std::vector<std::string> svr_lin_stat_aus;
-		std::vector<double> svr_lin_stat_preds;
-
-		AU_SVR_static_appearance_lin_regressors.Predict(svr_lin_stat_preds, svr_lin_stat_aus, hog_desc_frame, geom_descriptor_frame);
-
-		for(size_t i = 0; i < svr_lin_stat_preds.size(); ++i)
-		{
-			predictions.push_back(std::pair<std::string, double>(svr_lin_stat_aus[i], svr_lin_stat_preds[i]));
-		}
+		// The static regressors come first followed by the dynamic ones, as in the schema
+		AU_SVR_static_appearance_lin_regressors.Predict(predictions, hog_desc_frame, geom_descriptor_frame);
 
-		std::vector<std::string> svr_lin_dyn_aus;
-		std::vector<double> svr_lin_dyn_preds;
-
-		AU_SVR_dynamic_appearance_lin_regressors.Predict(svr_lin_dyn_preds, svr_lin_dyn_aus, hog_desc_frame, geom_descriptor_frame,  this->hog_desc_median, this->geom_descriptor_median);
-
-		for(size_t i = 0; i < svr_lin_dyn_preds.size(); ++i)
-		{
-			predictions.push_back(std::pair<std::string, double>(svr_lin_dyn_aus[i], svr_lin_dyn_preds[i]));
-		}
+		AU_SVR_dynamic_appearance_lin_regressors.Predict(predictions, hog_desc_frame, geom_descriptor_frame,  this->hog_desc_median, this->geom_descriptor_median);
 
 	}
-
-	return predictions;
 }
 
-std::vector<std::pair<std::string, double>> FaceAnalyser::CorrectOnlineAUs(std::vector<std::pair<std::string, double>> predictions_orig, 
+void FaceAnalyser::CorrectOnlineAUs(std::vector<double>& predictions, 
 	int view, bool dyn_shift, bool dyn_scale, bool update_track, bool clip_values)
 {
 	// Correction that drags the predicion to 0 (assuming the bottom 10% of predictions are of neutral expresssions)
-	std::vector<double> correction(predictions_orig.size(), 0.0);
-
-	std::vector<std::pair<std::string, double>> predictions = predictions_orig;
+	std::vector<double> correction(predictions.size(), 0.0);
 
 	if(update_track)
 	{
@@ -909,7 +953,7 @@ std::vector<std::pair<std::string, double>> FaceAnalyser::CorrectOnlineAUs(std::
 	{
 		for(size_t i = 0; i < correction.size(); ++i)
 		{
-			predictions[i].second = predictions[i].second - correction[i];
+			predictions[i] = predictions[i] - correction[i];
 		}
 	}
 	if(dyn_scale)
@@ -924,20 +968,20 @@ std::vector<std::pair<std::string, double>> FaceAnalyser::CorrectOnlineAUs(std::
 		for(size_t i = 0; i < predictions.size(); ++i)
 		{
 			// First establish presence (assume it is maximum as we have not seen max) 
-			if(predictions[i].second > 1)
+			if(predictions[i] > 1)
 			{
-				double scaling_curr = 5.0 / predictions[i].second;
+				double scaling_curr = 5.0 / predictions[i];
 				
 				if(scaling_curr < dyn_scaling[view][i])
 				{
 					dyn_scaling[view][i] = scaling_curr;
 				}
-				predictions[i].second = predictions[i].second * dyn_scaling[view][i];
+				predictions[i] = predictions[i] * dyn_scaling[view][i];
 			}
 
-			if(predictions[i].second > 5)
+			if(predictions[i] > 5)
 			{
-				predictions[i].second = 5;
+				predictions[i] = 5;
 			}
 		}
 	}
@@ -946,61 +990,43 @@ std::vector<std::pair<std::string, double>> FaceAnalyser::CorrectOnlineAUs(std::
 	{
 		for(size_t i = 0; i < correction.size(); ++i)
 		{
-			if(predictions[i].second < 0)
-				predictions[i].second = 0;
-			if(predictions[i].second > 5)
-				predictions[i].second = 5;
+			if(predictions[i] < 0)
+				predictions[i] = 0;
+			if(predictions[i] > 5)
+				predictions[i] = 5;
 		}
 	}
-	return predictions;
 }
 
 // Apply the current predictors to the currently stored descriptors (classification)
-std::vector<std::pair<std::string, double>> FaceAnalyser::PredictCurrentAUsClass(int view)
+void FaceAnalyser::PredictCurrentAUsClass(std::vector<double>& predictions, int view)
 {
 
-	std::vector<std::pair<std::string, double>> predictions;
+	predictions.clear();
 
 	if(!hog_desc_frame.empty())
 	{
-		std::vector<std::string> svm_lin_stat_aus;
-		std::vector<double> svm_lin_stat_preds;
-		
-		AU_SVM_static_appearance_lin.Predict(svm_lin_stat_preds, svm_lin_stat_aus, hog_desc_frame, geom_descriptor_frame);
-
-		for(size_t i = 0; i < svm_lin_stat_aus.size(); ++i)
-		{
-			predictions.push_back(std::pair<std::string, double>(svm_lin_stat_aus[i], svm_lin_stat_preds[i]));
-		}
+		// The static classifiers come first followed by the dynamic ones, as in the schema
+		AU_SVM_static_appearance_lin.Predict(predictions, hog_desc_frame, geom_descriptor_frame);
 
-		std::vector<std::string> svm_lin_dyn_aus;
-		std::vector<double> svm_lin_dyn_preds;
-
-		AU_SVM_dynamic_appearance_lin.Predict(svm_lin_dyn_preds, svm_lin_dyn_aus, hog_desc_frame, geom_descriptor_frame, this->hog_desc_median, this->geom_descriptor_median);
-
-		for(size_t i = 0; i < svm_lin_dyn_aus.size(); ++i)
-		{
-			predictions.push_back(std::pair<std::string, double>(svm_lin_dyn_aus[i], svm_lin_dyn_preds[i]));
-		}
+		AU_SVM_dynamic_appearance_lin.Predict(predictions, hog_desc_frame, geom_descriptor_frame, this->hog_desc_median, this->geom_descriptor_median);
 		
 	}
-
-	return predictions;
 }
 
-std::vector<std::pair<std::string, double>> FaceAnalyser::GetCurrentAUsClass() const
+Utilities::AUView FaceAnalyser::GetCurrentAUsClass() const
 {
-	return AU_predictions_class;
+	return Utilities::AUView(au_schema_class, AU_predictions_class);
 }
 
-std::vector<std::pair<std::string, double>> FaceAnalyser::GetCurrentAUsReg() const
+Utilities::AUView FaceAnalyser::GetCurrentAUsReg() const
 {
-	return AU_predictions_reg;
+	return Utilities::AUView(au_schema_reg, AU_predictions_reg);
 }
 
-std::vector<std::pair<std::string, double>> FaceAnalyser::GetCurrentAUsCombined() const
+Utilities::AUView FaceAnalyser::GetCurrentAUsCombined() const
 {
-	return AU_predictions_combined;
+	return Utilities::AUView(au_schema_combined, AU_predictions_combined);
 }
 
 void FaceAnalyser::Read(std::string model_loc)
@@ -1141,7 +1167,7 @@ void FaceAnalyser::ReadAU(std::string au_model_location)
 }
 
 void FaceAnalyser::UpdatePredictionTrack(cv::Mat_<int>& prediction_corr_histogram, int& prediction_correction_count, 
-	std::vector<double>& correction, const std::vector<std::pair<std::string, double>>& predictions, double ratio, int num_bins, 
+	std::vector<double>& correction, const std::vector<double>& predictions, double ratio, int num_bins, 
 	double min_val, double max_val, int min_frames)
 {
 	double length = max_val - min_val;
@@ -1159,7 +1185,7 @@ void FaceAnalyser::UpdatePredictionTrack(cv::Mat_<int>& prediction_corr_histogra
 	for(int i = 0; i < prediction_corr_histogram.rows; ++i)
 	{
 		// Find the bins corresponding to the current descriptor
-		int index = (int)((predictions[i].second - min_val)*((double)num_bins)/(length));
+		int index = (int)((predictions[i] - min_val)*((double)num_bins)/(length));
 		if(index < 0)
 		{
 			index = 0;
@@ -1339,6 +1365,60 @@ void FaceAnalyser::PostprocessOutputFile(std::string output_file)
 	}
 	int end_ind = begin_ind + num_class + num_reg;
 
+	// If some of the rows were interpolated (keyframe mode) only the other ones have predictions, the interpolated ones
+	// get the predictions interpolated from the rows around them
+	int interpolated_ind = -1;
+	for (size_t i = 0; i < tokens.size(); ++i)
+	{
+		if (tokens[i].find("interpolated") != std::string::npos)
+		{
+			interpolated_ind = (int)i;
+			break;
+		}
+	}
+
+	int num_rows = (int)output_file_contents.size() - 1;
+	std::vector<int> prediction_prev(num_rows, 0);
+	std::vector<int> prediction_next(num_rows, 0);
+	std::vector<double> prediction_alpha(num_rows, 0.0);
+
+	std::vector<int> key_rows;
+	for (int i = 0; i < num_rows; ++i)
+	{
+		bool interpolated_row = false;
+		if (interpolated_ind != -1)
+		{
+			std::vector<std::string> row_tokens;
+			split(output_file_contents[i + 1], row_tokens, ',');
+			interpolated_row = interpolated_ind < (int)row_tokens.size() && std::stoi(row_tokens[interpolated_ind]) != 0;
+		}
+		if (!interpolated_row)
+		{
+			key_rows.push_back(i);
+		}
+	}
+
+	int num_predictions = (int)std::min(key_rows.size(), successes.size());
+	for (int i = 0, k = 0; i < num_rows && num_predictions > 0; ++i)
+	{
+		// Advance to the last prediction at or before this row
+		while (k + 1 < num_predictions && key_rows[k + 1] <= i)
+			k++;
+
+		if (i <= key_rows[k] || k + 1 >= num_predictions)
+		{
+			// Before the first analysed row, after the last one, or an analysed row itself
+			prediction_prev[i] = k;
+			prediction_next[i] = k;
+		}
+		else
+		{
+			prediction_prev[i] = k;
+			prediction_next[i] = k + 1;
+			prediction_alpha[i] = (double)(i - key_rows[k]) / (double)(key_rows[k + 1] - key_rows[k]);
+		}
+	}
+
 	// Now overwrite the whole file
 	std::ofstream outfile(output_file, std::ios_base::out);
 	// Write the header
@@ -1361,13 +1441,20 @@ void FaceAnalyser::PostprocessOutputFile(std::string output_file)
 		{
 			if (t >= begin_ind && t < end_ind)
 			{
+				int prev = prediction_prev[i - 1];
+				int next = prediction_next[i - 1];
+				double alpha = prediction_alpha[i - 1];
+
 				if (t - begin_ind < num_reg)
 				{
-					outfile << ", " << predictions_reg[inds_reg[t - begin_ind]].second[i - 1];
+					const std::vector<double>& prediction = predictions_reg[inds_reg[t - begin_ind]].second;
+					outfile << ", " << (1.0 - alpha) * prediction[prev] + alpha * prediction[next];
 				}
 				else
 				{
-					outfile << ", " << predictions_class[inds_class[t - begin_ind - num_reg]].second[i - 1];
+					// Occurrence is taken from the closer of the two rows
+					const std::vector<double>& prediction = predictions_class[inds_class[t - begin_ind - num_reg]].second;
+					outfile << ", " << (alpha < 0.5 ? prediction[prev] : prediction[next]);
 				}
 			}
 			else
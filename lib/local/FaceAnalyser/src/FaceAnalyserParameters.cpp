@@ -103,6 +103,13 @@ FaceAnalyserParameters::FaceAnalyserParameters(std::vector<std::string> &argumen
 			size_set = true;
 			i++;
 		}
+		else if (arguments[i].compare("-au_spill_dir") == 0)
+		{
+			history_spill_dir = arguments[i + 1];
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
 	}
 
 	for (int i = (int)arguments.size() - 1; i >= 0; --i)
@@ -181,6 +188,8 @@ void FaceAnalyserParameters::init()
 
 	orientation_bins = std::vector<cv::Vec3d>();
 
+	history_spill_dir = "";
+
 }
 
 // Use getters and setters for these as they might need to reload models and make sure the scale and size ratio makes sense
@@ -99,7 +99,7 @@ void SVM_dynamic_lin::Read(std::ifstream& stream, const std::vector<std::string>
 }
 
 // Prediction using the HOG descriptor
-void SVM_dynamic_lin::Predict(std::vector<double>& predictions, std::vector<std::string>& names, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params,  const cv::Mat_<double>& running_median,  const cv::Mat_<double>& running_median_geom)
+void SVM_dynamic_lin::Predict(std::vector<double>& predictions, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params,  const cv::Mat_<double>& running_median,  const cv::Mat_<double>& running_median_geom)
 {
 	if(AU_names.size() > 0)
 	{
@@ -130,7 +130,5 @@ void SVM_dynamic_lin::Predict(std::vector<double>& predictions, std::vector<std:
 				predictions.push_back(neg_classes[i]);
 			}
 		}
-
-		names = this->AU_names;
 	}
 }
\ No newline at end of file
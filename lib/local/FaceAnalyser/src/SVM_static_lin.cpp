@@ -99,7 +99,7 @@ void SVM_static_lin::Read(std::ifstream& stream, const std::vector<std::string>&
 }
 
 // Prediction using the HOG descriptor
-void SVM_static_lin::Predict(std::vector<double>& predictions, std::vector<std::string>& names, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params)
+void SVM_static_lin::Predict(std::vector<double>& predictions, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params)
 {
 	if(AU_names.size() > 0)
 	{
@@ -127,7 +127,5 @@ void SVM_static_lin::Predict(std::vector<double>& predictions, std::vector<std::
 				predictions.push_back(neg_classes[i]);
 			}
 		}
-
-		names = this->AU_names;
 	}
 }
\ No newline at end of file
@@ -94,7 +94,7 @@ void SVR_dynamic_lin_regressors::Read(std::ifstream& stream, const std::vector<s
 }
 
 // Prediction using the HOG descriptor
-void SVR_dynamic_lin_regressors::Predict(std::vector<double>& predictions, std::vector<std::string>& names, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params,  const cv::Mat_<double>& running_median,  const cv::Mat_<double>& running_median_geom)
+void SVR_dynamic_lin_regressors::Predict(std::vector<double>& predictions, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params,  const cv::Mat_<double>& running_median,  const cv::Mat_<double>& running_median_geom)
 {
 	if(AU_names.size() > 0)
 	{
@@ -118,7 +118,5 @@ void SVR_dynamic_lin_regressors::Predict(std::vector<double>& predictions, std::
 		{		
 			predictions.push_back(*pred_it);
 		}
-		
-		names = this->AU_names;
 	}
 }
\ No newline at end of file
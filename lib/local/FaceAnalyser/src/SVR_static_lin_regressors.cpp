@@ -88,7 +88,7 @@ void SVR_static_lin_regressors::Read(std::ifstream& stream, const std::vector<st
 }
 
 // Prediction using the HOG descriptor
-void SVR_static_lin_regressors::Predict(std::vector<double>& predictions, std::vector<std::string>& names, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params)
+void SVR_static_lin_regressors::Predict(std::vector<double>& predictions, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params)
 {
 	if(AU_names.size() > 0)
 	{
@@ -109,7 +109,5 @@ void SVR_static_lin_regressors::Predict(std::vector<double>& predictions, std::v
 		{		
 			predictions.push_back(*pred_it);
 		}
-
-		names = this->AU_names;
 	}
 }
\ No newline at end of file
@@ -36,6 +36,7 @@
 #define GAZE_ESTIMATION_H
 
 #include "LandmarkDetectorModel.h"
+#include "FaceResults.h"
 
 #include "opencv2/core/core.hpp"
 
@@ -44,6 +45,12 @@ namespace GazeAnalysis
 
 	void EstimateGaze(const LandmarkDetector::CLNF& clnf_model, cv::Point3f& gaze_absolute, float fx, float fy, float cx, float cy, bool left_eye);
 
+	// The same, but using (and sharing) the head pose and 3D shapes of the current frame results
+	void EstimateGaze(LandmarkDetector::FaceResults& face, cv::Point3f& gaze_absolute, bool left_eye);
+
+	// Estimating the gaze of both eyes and the gaze angle, these are kept in the frame results so that it is only done once per frame
+	void EstimateGaze(LandmarkDetector::FaceResults& face);
+
 	// Getting the gaze angle in radians with respect to the world coordinates (camera plane), when looking ahead straight at camera plane the gaze angle will be (0,0)
 	cv::Vec2f GetGazeAngle(cv::Point3f& gaze_vector_1, cv::Point3f& gaze_vector_2);
 	
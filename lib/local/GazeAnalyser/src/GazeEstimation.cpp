@@ -86,22 +86,17 @@ cv::Point3f GazeAnalysis::GetPupilPosition(cv::Mat_<float> eyeLdmks3d){
 
 void GazeAnalysis::EstimateGaze(const LandmarkDetector::CLNF& clnf_model, cv::Point3f& gaze_absolute, float fx, float fy, float cx, float cy, bool left_eye)
 {
-	cv::Vec6f headPose = LandmarkDetector::GetPose(clnf_model, fx, fy, cx, cy);
+	LandmarkDetector::FaceResults face(clnf_model, fx, fy, cx, cy);
+	EstimateGaze(face, gaze_absolute, left_eye);
+}
+
+void GazeAnalysis::EstimateGaze(LandmarkDetector::FaceResults& face, cv::Point3f& gaze_absolute, bool left_eye)
+{
+	cv::Vec6f headPose = face.Pose();
 	cv::Vec3f eulerAngles(headPose(3), headPose(4), headPose(5));
 	cv::Matx33f rotMat = Utilities::Euler2RotationMatrix(eulerAngles);
 
-	int part = -1;
-	for (size_t i = 0; i < clnf_model.hierarchical_models.size(); ++i)
-	{
-		if (left_eye && clnf_model.hierarchical_model_names[i].compare("left_eye_28") == 0)
-		{
-			part = i;
-		}
-		if (!left_eye && clnf_model.hierarchical_model_names[i].compare("right_eye_28") == 0)
-		{
-			part = i;
-		}
-	}
+	int part = face.PartIndex(left_eye ? "left_eye_28" : "right_eye_28");
 
 	if (part == -1)
 	{
@@ -110,13 +105,12 @@ void GazeAnalysis::EstimateGaze(const LandmarkDetector::CLNF& clnf_model, cv::Po
 		return;
 	}
 
-	cv::Mat eyeLdmks3d = clnf_model.hierarchical_models[part].GetShape(fx, fy, cx, cy);
+	cv::Mat eyeLdmks3d = face.PartShape3D(part);
 
 	cv::Point3f pupil = GetPupilPosition(eyeLdmks3d);
 	cv::Point3f rayDir = pupil / norm(pupil);
 
-	cv::Mat faceLdmks3d = clnf_model.GetShape(fx, fy, cx, cy);
-	faceLdmks3d = faceLdmks3d.t();
+	cv::Mat faceLdmks3d = face.Shape3D().t();
 
 	cv::Mat offset = (cv::Mat_<float>(3, 1) << 0, -3.5, 7.0);
 
@@ -135,6 +129,21 @@ void GazeAnalysis::EstimateGaze(const LandmarkDetector::CLNF& clnf_model, cv::Po
 	gaze_absolute = gazeVecAxis / norm(gazeVecAxis);
 }
 
+void GazeAnalysis::EstimateGaze(LandmarkDetector::FaceResults& face)
+{
+	if (face.HasGaze())
+	{
+		return;
+	}
+
+	cv::Point3f gaze_direction0, gaze_direction1;
+	EstimateGaze(face, gaze_direction0, true);
+	EstimateGaze(face, gaze_direction1, false);
+	cv::Vec2f gaze_angle = GetGazeAngle(gaze_direction0, gaze_direction1);
+
+	face.SetGaze(gaze_direction0, gaze_direction1, cv::Vec2d(gaze_angle[0], gaze_angle[1]));
+}
+
 cv::Vec2f GazeAnalysis::GetGazeAngle(cv::Point3f& gaze_vector_1, cv::Point3f& gaze_vector_2)
 {
 
@@ -104,11 +104,19 @@ public:
 	// Combined weight matrix from each neuron
 	cv::Mat_<float> weight_matrix;
 
+	// Float spectra of the zero mean and unit norm neuron weights for each of the window_sizes, one block of DFT rows per neuron in spectra_neurons.
+	// They are not changed once computed, so copies of the patch expert share them instead of cloning
+	std::vector<cv::Mat_<float> >	neuron_spectra;
+
+	// Neurons that are evaluated through the spectra (the ones with a tiny alpha are skipped, and the ones with flat weights only add a constant response)
+	std::vector<int>				spectra_neurons;
+	float							flat_neurons_response;
+
 	// How confident we are in the patch
 	double   patch_confidence;
 
 	// Default constructor
-	CCNF_patch_expert(){;}
+	CCNF_patch_expert() : flat_neurons_response(0.0f){;}
 
 	// Copy constructor		
 	CCNF_patch_expert(const CCNF_patch_expert& other);
@@ -116,12 +124,25 @@ public:
 	void Read(std::ifstream &stream, std::vector<int> window_sizes, std::vector<std::vector<cv::Mat_<float> > > sigma_components);
 
 	// actual work (can pass in an image and a potential depth image, if the CCNF is trained with depth)
+	// This is the FFT path, Patch_experts uses it by default when the expert has neuron spectra for the window size, and ResponseOpenBlas otherwise
+	// (with -autotune the faster of the two for the patch and area sizes is used instead)
 	void Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response);
 
+	// If the shared neuron spectra can be used for a response of this (square) window size
+	bool HasSpectra(int window_size) const;
+
 	void ResponseOpenBlas(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response, cv::Mat_<float> &im2col_prealloc);
 
-	// Helper function to compute relevant sigmas
+	// Helper function to compute relevant sigmas (and the neuron spectra for the same window size)
 	void ComputeSigmas(std::vector<cv::Mat_<float> > sigma_components, int window_size);
+
+private:
+
+	// Spectra of all the neurons in spectra_neurons for a particular window size, empty if the FFT path can not be used for this expert
+	cv::Mat_<float> ComputeNeuronSpectra(int window_size) const;
+
+	// Sum of the neuron responses (after the sigmoid), the area of interest spectrum and the window norms are computed once and shared by all of the neurons
+	void NeuronResponsesFFT(const cv::Mat_<float> &area_of_interest, const cv::Mat_<float> &spectra, cv::Mat_<float> &neuron_sum) const;
 	
 };
   //===========================================================================
@@ -37,6 +37,11 @@
 // OpenCV includes
 #include <opencv2/core/core.hpp>
 
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
 namespace LandmarkDetector
 {
 	//===========================================================================	
@@ -58,5 +63,58 @@ namespace LandmarkDetector
 	
 	// Convolution using matrix multiplication and OpenBLAS optimization, can also provide a pre-allocated im2col result for faster processing
 	void convolution_direct_blas(std::vector<cv::Mat_<float> >& outputs, const std::vector<cv::Mat_<float> >& input_maps, const cv::Mat_<float>& weight_matrix, int height_k, int width_k, cv::Mat_<float>& pre_alloc_im2col);
+
+	// Convolution of a batch of inputs (of the same size) with a single matrix multiplication, the im2col of every input is stacked in pre_alloc_im2col
+	void convolution_direct_blas_batch(std::vector<std::vector<cv::Mat_<float> > >& outputs, const std::vector<std::vector<cv::Mat_<float> > >& input_maps, const cv::Mat_<float>& weight_matrix, int height_k, int width_k, cv::Mat_<float>& pre_alloc_im2col);
+
+	// Perform im2col (one row per window, column major within the window), while at the same time doing contrast normalization and adding a bias term as the first column
+	void im2colContrastNormBias(const cv::Mat_<float>& input, const unsigned int width, const unsigned int height, cv::Mat_<float>& output);
+
+	//===========================================================================
+	// Choosing between the FFT and the matrix multiplication (GEMM) implementations of convolution, which one is faster depends on the
+	// kernel and input sizes as well as on the host, so when enabled both are timed the first time a combination is seen and the faster
+	// one is used from then on, the choices are stored in a file (keyed by the CPU model and thread count) so that this happens once per host
+	class ConvolutionTuner
+	{
+	public:
+
+		enum Kernel { UNKNOWN = -1, GEMM = 0, FFT = 1 };
+
+		// The tuner is shared by all of the models
+		static ConvolutionTuner& Instance();
+
+		// Turn on the tuning, the earlier choices for this host are read from the cache file and the new ones are added to it
+		void Enable(const std::string& cache_location);
+
+		bool Enabled() const { return enabled; }
+
+		// The kernel to use for a convolution (described by the key), UNKNOWN if it has not been timed yet
+		Kernel GetKernel(const std::string& key);
+
+		// Time both kernels of the convolution (unless it has been timed already) and keep the faster one, only one convolution is timed
+		// at a time and each kernel is run several times with the fastest run counting, as a single run is too noisy to pick on
+		void Tune(const std::string& key, const std::function<void()>& gemm, const std::function<void()>& fft);
+
+	private:
+
+		ConvolutionTuner() : enabled(false) { ; }
+
+		// Keep the faster kernel for the convolution
+		void SetTimings(const std::string& key, double gemm_time, double fft_time);
+
+		// How many times each kernel is timed
+		static const int TIMING_RUNS = 5;
+
+		bool enabled;
+
+		std::mutex tuner_mutex;
+		std::mutex timing_mutex;
+		std::map<std::string, Kernel> kernels;
+
+		std::string cache_location;
+
+		// The CPU model and the number of worker threads, the timings are only valid for these
+		std::string host;
+	};
 }
 #endif // CNN_UTILS_H
@@ -107,10 +107,13 @@ namespace LandmarkDetector
 
 		FaceDetectorMTCNN(const std::string& location);
 
-		// Copy constructor
+		// Copy constructor and assignment, the networks are copied but every instance keeps its own image pyramid
 		FaceDetectorMTCNN(const FaceDetectorMTCNN& other);
+		FaceDetectorMTCNN& operator=(const FaceDetectorMTCNN& other);
 
 		// Given an image, orientation and detected landmarks output the result of the appropriate regressor
+		// DetectFaces reuses the image pyramid (and the network buffers) of the instance, so an instance must not be shared between threads,
+		// give every thread its own copy instead
 		bool DetectFaces(std::vector<cv::Rect_<float> >& o_regions, const cv::Mat& input_img, 
 			std::vector<float>& o_confidences, int min_face = 60, float t1 = 0.6, float t2 = 0.7, float t3 = 0.7);
 
@@ -127,6 +130,22 @@ namespace LandmarkDetector
 		CNN PNet;
 		CNN RNet;
 		CNN ONet;
+
+		// The image pyramid is kept between calls so that its levels can be reused without reallocating them,
+		// the levels are 8-bit (each one downsampled from the previous one) and are normalised separately for PNet.
+		// It is not copied, as copied cv::Mat headers would make two instances write to the same levels
+		std::vector<cv::Mat> pyramid_levels;
+		std::vector<cv::Mat> pyramid_normalised;
+		std::vector<double> pyramid_scales;
+
+		// Build the pyramid levels for an 8-bit three channel image, the first level is at first_scale and every next one is factor times smaller
+		void BuildPyramid(const cv::Mat& img, double first_scale, double factor, int num_scales);
+
+		// Run PNet over an image in overlapping tiles (spread across threads), so that the memory needed does not grow with the image size
+		std::vector<cv::Mat_<float> > PNetInferenceTiled(const cv::Mat& img);
+
+		// Crop a proposal (zero padded outside the image) from the coarsest pyramid level that still resolves it, and resize and normalise it for RNet or ONet
+		void ExtractProposal(cv::Mat& out_img, const cv::Mat& img, const cv::Rect_<float>& box, int out_size) const;
 		
 	};
 
@@ -0,0 +1,119 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Tadas Baltrusaitis, all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#ifndef FACE_RESULTS_H
+#define FACE_RESULTS_H
+
+// System includes
+#include <string>
+#include <vector>
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+#include "LandmarkDetectorModel.h"
+
+namespace LandmarkDetector
+{
+	//===========================================================================
+	/**
+	The results derived from a CLNF model fit in the current frame (head pose, 3D shape, eye landmarks and gaze). Each of them is only computed
+	the first time it is asked for, so the executables, the visualizer and the recorder can all use them without repeating the pose solver or
+	the shape computations. It is meant to live for a single frame, the model should not be refit while it is in use.
+	*/
+	class FaceResults
+	{
+	public:
+
+		// The camera parameters are needed for the pose and the 3D shapes
+		FaceResults(const CLNF& clnf_model, float fx, float fy, float cx, float cy);
+
+		const CLNF& Model() const { return clnf_model; }
+
+		// The head pose with respect to the camera (see GetPose)
+		const cv::Vec6f& Pose();
+
+		// The landmarks in camera space (see CLNF::GetShape)
+		const cv::Mat_<float>& Shape3D();
+
+		// The landmarks of a hierarchical part model in camera space
+		const cv::Mat_<float>& PartShape3D(int part);
+
+		// The index of a hierarchical part model by its name, -1 if the model does not have it
+		int PartIndex(const std::string& part_name) const;
+
+		// Which landmarks are visible from the current view
+		const cv::Mat_<int>& Visibilities();
+
+		// The eye landmarks in the image and in camera space (see CalculateAllEyeLandmarks and Calculate3DEyeLandmarks)
+		const std::vector<cv::Point2f>& EyeLandmarks2D();
+		const std::vector<cv::Point3f>& EyeLandmarks3D();
+
+		// The gaze is estimated by the GazeAnalyser, which keeps it here so that it is done at most once per frame (zero until then)
+		bool HasGaze() const { return gaze_computed; }
+		void SetGaze(const cv::Point3f& gaze_direction0, const cv::Point3f& gaze_direction1, const cv::Vec2d& gaze_angle);
+
+		const cv::Point3f& GazeDirection0() const { return gaze_direction0; }
+		const cv::Point3f& GazeDirection1() const { return gaze_direction1; }
+		const cv::Vec2d& GazeAngle() const { return gaze_angle; }
+
+	private:
+
+		const CLNF& clnf_model;
+		float fx, fy, cx, cy;
+
+		bool pose_computed;
+		cv::Vec6f pose;
+
+		// Empty until computed
+		cv::Mat_<float> shape_3D;
+		std::vector<cv::Mat_<float> > part_shapes_3D;
+		cv::Mat_<int> visibilities;
+
+		bool eye_landmarks_2D_computed;
+		std::vector<cv::Point2f> eye_landmarks_2D;
+
+		bool eye_landmarks_3D_computed;
+		std::vector<cv::Point3f> eye_landmarks_3D;
+
+		bool gaze_computed;
+		cv::Point3f gaze_direction0;
+		cv::Point3f gaze_direction1;
+		cv::Vec2d gaze_angle;
+
+	};
+	//===========================================================================
+}
+#endif // FACE_RESULTS_H
@@ -40,5 +40,6 @@
 #include "LandmarkDetectorFunc.h"
 #include "LandmarkDetectorParameters.h"
 #include "LandmarkDetectorUtils.h"
+#include "FaceResults.h"
 
 #endif // LANDMARK_CORE_INCLUDES_H
\ No newline at end of file
@@ -93,6 +93,17 @@ public:
 	// Given an image, orientation and detected landmarks output the result of the appropriate regressor
 	float Check(const cv::Vec3d& orientation, const cv::Mat_<uchar>& intensity_img, cv::Mat_<float>& detected_landmarks);
 
+	// Validating several faces in the same image at once, the CNN is evaluated as a single batch per view
+	std::vector<float> Check(const std::vector<cv::Vec3d>& orientations, const cv::Mat_<uchar>& intensity_img, const std::vector<cv::Mat_<float> >& detected_landmarks);
+
+	// The first part of the check, warping the face described by the landmarks to the reference shape of the closest view
+	// Returns false if the face is not within the image. Not thread safe, as the warps keep their state
+	bool Warp(const cv::Vec3d& orientation, const cv::Mat_<uchar>& intensity_img, const cv::Mat_<float>& detected_landmarks, cv::Mat_<float>& warped_img, int& view_id);
+
+	// The second part of the check, running the CNN on already warped faces (as a batch per view)
+	// If thread_safe is set the pre-allocated buffers are not used, so that it can be run on a background thread
+	std::vector<float> CheckWarped(const std::vector<cv::Mat_<float> >& warped_imgs, const std::vector<int>& view_ids, bool thread_safe = false);
+
 	// Reading in the model
 	void Read(std::string location);
 			
@@ -103,8 +114,8 @@ private:
 
 	// The actual regressor application on the image
 
-	// Convolutional Neural Network
-	double CheckCNN(const cv::Mat_<float>& warped_img, int view_id);
+	// Convolutional Neural Network, applied to a batch of warped images of the same view
+	std::vector<double> CheckCNN(const std::vector<cv::Mat_<float> >& warped_imgs, int view_id, bool thread_safe);
 
 	// A normalisation helper
 	void NormaliseWarpedToVector(const cv::Mat_<float>& warped_img, cv::Mat_<float>& feature_vec, int view_id);
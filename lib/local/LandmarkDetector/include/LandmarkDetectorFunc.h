@@ -56,6 +56,13 @@ namespace LandmarkDetector
 	bool DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& clnf_model, FaceModelParameters& params, cv::Mat &grayscale_image);
 	bool DetectLandmarksInVideo(const cv::Mat &rgb_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params, cv::Mat &grayscale_image);
 
+	// Tracking in video with the validation of a tracked fit left to the caller, so that several faces can be validated in one batch (with ValidateLandmarks).
+	// Returns true if the fit is waiting for validation, the tracking state (failure count, face template) is then only updated by CompleteDeferredValidation
+	// once the validation has set detection_success. Otherwise the frame was handled in full (e.g. the fit failed, the face was detected anew, or the
+	// validation is not run on every frame) and the result is in detection_success.
+	bool DetectLandmarksInVideoDeferValidation(const cv::Mat &rgb_image, CLNF& clnf_model, FaceModelParameters& params, cv::Mat &grayscale_image);
+	void CompleteDeferredValidation(const cv::Mat_<uchar> &grayscale_image, CLNF& clnf_model, const FaceModelParameters& params);
+
 	//================================================================================================================
 	// Landmark detection in image, need to provide an image and optionally CLNF model together with parameters (default values work well)
 	// Optionally can provide a bounding box in which detection is performed (this is useful if multiple faces are to be detected in images)
@@ -65,6 +72,12 @@ namespace LandmarkDetector
 	// Providing a bounding box
 	bool DetectLandmarksInImage(const cv::Mat &rgb_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params, cv::Mat &grayscale_image);
 
+	//================================================================================================================
+	// Validating the landmarks of several models tracked in the same image in one batch (useful when tracking multiple faces),
+	// the validator of the first model is used, sets detection_certainty and detection_success of the validated models
+	//================================================================================================================
+	void ValidateLandmarks(std::vector<CLNF>& clnf_models, const std::vector<bool>& models_to_validate, const cv::Mat_<uchar> &grayscale_image, const FaceModelParameters& params);
+
 	//================================================================
 	// Helper function for getting head pose from CLNF parameters
 
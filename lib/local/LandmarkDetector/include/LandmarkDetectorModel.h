@@ -39,6 +39,9 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/objdetect.hpp>
 
+// System includes
+#include <future>
+
 // dlib dependencies for face detection
 #include <dlib/image_processing/frontal_face_detector.h>
 #include <dlib/opencv.h>
@@ -128,6 +131,14 @@ public:
 	// This is useful for knowing when to initialise and reinitialise tracking
 	int failures_in_a_row;
 
+	// Scheduling of the landmark validation when tracking in video (see validate_every_n_frames and validate_async)
+	// How many frames since the validator was last run, and the model likelihood at that point
+	int frames_since_validation;
+	float validation_likelihood;
+
+	// The validation running on a background thread (if any)
+	std::future<float> pending_validation;
+
 	// A template of a face that last succeeded with tracking (useful for large motions in video)
 	cv::Mat_<uchar> face_template;
 
@@ -161,8 +172,8 @@ public:
 	// Assignment operator for rvalues
 	CLNF & operator= (const CLNF&& other);
 
-	// Does the actual work - landmark detection
-	bool DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& params);
+	// Does the actual work - landmark detection, the validation can be skipped (if params.validate_detections is set) when the caller validates the fit itself
+	bool DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& params, bool skip_validation = false);
 	
 	// Gets the shape of the current detected landmarks in camera space (given camera calibration)
 	// Can only be called after a call to DetectLandmarksInVideo or DetectLandmarksInImage
@@ -182,6 +193,9 @@ public:
 
 	// Reading the model in
 	void Read(std::string name);
+
+	// Wait for the background validation to finish (if any) and discard it
+	void DiscardPendingValidation();
 	
 private:
 
@@ -206,8 +220,8 @@ private:
 				  const cv::Matx22f& sim_ref_to_img, int resp_size, int view_idx, bool rigid, int scale, 
 		          cv::Mat_<float>& landmark_lhoods, const FaceModelParameters& parameters, bool compute_lhood);
 
-	// Generating the weight matrix for the Weighted least squares
-	void GetWeightMatrix(cv::Mat_<float>& WeightMatrix, int scale, int view_id, const FaceModelParameters& parameters);
+	// Generating the landmark weights (the diagonal of the weight matrix) for the Weighted least squares
+	void GetWeights(cv::Mat_<float>& weights, int scale, int view_id, const FaceModelParameters& parameters);
 
   };
   //===========================================================================
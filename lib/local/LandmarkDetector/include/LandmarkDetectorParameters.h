@@ -56,6 +56,15 @@ struct FaceModelParameters
 	// Landmark detection validator boundary for correct detection, the regressor output 1 (perfect alignment) 0 (bad alignment), 
 	float validation_boundary;
 
+	// When tracking in video, how often should the validation be run, every n frames (1 validates every frame), in between the last certainty is carried forward
+	int validate_every_n_frames;
+
+	// When not validating every frame, validate anyway if the model likelihood dropped by more than this since the last validation
+	float validation_likelihood_drop;
+
+	// When tracking in video run the validation on a background thread, the result is picked up on a later frame
+	bool validate_async;
+
 	// Used when tracking is going well
 	std::vector<int> window_sizes_small;
 
@@ -88,6 +97,10 @@ struct FaceModelParameters
 	// How often should face detection be used to attempt reinitialisation, every n frames (set to negative not to reinit)
 	int reinit_video_every;
 
+	// When reinitialising after a tracking failure, first look for the face in a region this many times the size of the last bounding box around it,
+	// and only search the whole image if it is not found there (set to 0 to always search the whole image)
+	float reinit_roi_scale;
+
 	// Determining which face detector to use for (re)initialisation, HAAR is quicker but provides more false positives and is not goot for in-the-wild conditions
 	// Also HAAR detector can detect smaller faces while HOG SVM is only capable of detecting faces at least 70px across
 	// MTCNN detector is much more accurate that the other two, and is even suitable for profile faces, but it is somewhat slower
@@ -97,12 +110,22 @@ struct FaceModelParameters
 	std::string mtcnn_face_detector_location;
 	FaceDetector curr_face_detector;
 
+	// When tracking multiple faces, how often to look for new faces, every n frames (only done when there are free trackers)
+	int detect_every_n_frames;
+
+	// When tracking multiple faces run the face detection on a background thread, the new faces are picked up on a later frame
+	bool detect_async;
+
 	// Should the model be refined hierarchically (if available)
 	bool refine_hierarchical;
 
 	// Should the parameters be refined for different scales
 	bool refine_parameters;
 
+	// If set, the FFT and matrix multiplication convolutions (in the CCNF patch experts and the MTCNN face detector) are timed on this host
+	// and the faster one is used for every kernel and input size, the choices are kept in this file so the timing is done once per host
+	std::string convolution_tuning_location;
+
 	FaceModelParameters();
 
 	FaceModelParameters(std::vector<std::string> &arguments);
@@ -86,6 +86,9 @@ class PDM{
 		// Provided the landmark location compute global and local parameters best fitting it (can provide optional rotation for potentially better results)
 		void CalcParams(cv::Vec6f& out_params_global, cv::Mat_<float>& out_params_local, const cv::Mat_<float>& landmark_locations, const cv::Vec3f rotation = cv::Vec3f(0.0f));
 
+		// Provided the landmark location refine the global and local parameters to fit it, starting from the given ones (e.g. from the previous frame)
+		void RefineParams(cv::Vec6f& params_global, cv::Mat_<float>& params_local, const cv::Mat_<float>& landmark_locations);
+
 		// provided the model parameters, compute the bounding box of a face
 		void CalcBoundingBox(cv::Rect_<float>& out_bounding_box, const cv::Vec6f& params_global, const cv::Mat_<float>& params_local);
 
@@ -93,12 +96,19 @@ class PDM{
 		void ComputeRigidJacobian(const cv::Mat_<float>& params_local, const cv::Vec6f& params_global, cv::Mat_<float> &Jacob, const cv::Mat_<float> W, cv::Mat_<float> &Jacob_t_w);
 		void ComputeJacobian(const cv::Mat_<float>& params_local, const cv::Vec6f& params_global, cv::Mat_<float> &Jacobian, const cv::Mat_<float> W, cv::Mat_<float> &Jacob_t_w);
 
+		// Jacobian (2n x 6 when rigid, 2n x (6 + m) otherwise) with every row pre-multiplied by the square root of the landmark weight,
+		// the weights are a 2n x 1 vector (diagonal of the weight matrix), so the weighted Hessian is just Jacob_w' * Jacob_w
+		void ComputeWeightedJacobian(const cv::Mat_<float>& params_local, const cv::Vec6f& params_global, const cv::Mat_<float>& weights_sqrt, bool rigid, cv::Mat_<float> &Jacob_w) const;
+
 		// Given the current parameters, and the computed delta_p compute the updated parameters
 		void UpdateModelParameters(const cv::Mat_<float>& delta_p, cv::Mat_<float>& params_local, cv::Vec6f& params_global);
 
 	private:
 		// Helper utilities
 		static void Orthonormalise(cv::Matx33f &R);
+
+		// Fit the parameters to the landmark locations, starting from the provided ones
+		void FitParams(cv::Vec6f& params_global, cv::Mat_<float>& params_local, const cv::Mat_<float>& landmark_locations);
   };
   //===========================================================================
 }
@@ -67,6 +67,9 @@ class SVR_patch_expert{
 		// Discrete Fourier Transform of SVR weights, precalculated for speed (at different window sizes)
 		std::map<int, cv::Mat_<double> > weights_dfts;
 
+		// SVR weights in the im2col order (bias first), normalised and with the logistic regression slope and bias incorporated, used by the OpenBLAS response
+		cv::Mat_<float> weight_row;
+
 		// Confidence of the current patch expert (used for NU_RLMS optimisation)
 		double  confidence;
 
@@ -82,6 +85,9 @@ class SVR_patch_expert{
 		void Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response);
 		void ResponseDepth(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response);
 
+		// The same response as above computed through im2col and a matrix multiplication, the input is the raw area of interest or its gradient depending on the type
+		void ResponseOpenBlas(const cv::Mat_<float> &input, cv::Mat_<float> &response, cv::Mat_<float> &im2col_prealloc);
+
 };
 //===========================================================================
 /**
@@ -109,6 +115,9 @@ class Multi_SVR_patch_expert{
 		void Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response);
 		void ResponseDepth(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response);
 
+		// response computation through im2col and OpenBLAS, the gradient image is computed once and shared by the gradient modalities
+		void ResponseOpenBlas(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response, cv::Mat_<float> &im2col_prealloc);
+
 };
 }
 #endif // SVR_PATCH_EXPERT_H
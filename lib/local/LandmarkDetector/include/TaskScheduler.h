@@ -0,0 +1,145 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Tadas Baltrusaitis, all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+// System includes
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+namespace LandmarkDetector
+{
+	//===========================================================================
+	/**
+	A work-stealing task scheduler shared by the whole library, so that the parallel loops over faces, hierarchical part models, landmarks and
+	face detection scales compose rather than each creating their own threads. Every worker has its own queue, it takes the most recent work from it
+	and steals the oldest from others. A thread waiting for a loop to finish first helps with the tasks of that loop that have not been taken yet
+	(only of that loop, so the nesting depth is never more than that of the loops themselves) and then sleeps until the ones running elsewhere are done.
+	If the body throws, the rest of the loop is skipped and the first exception is rethrown from ParallelFor.
+	*/
+	class TaskScheduler
+	{
+
+	public:
+
+		// The scheduler used by the library
+		static TaskScheduler& Instance();
+
+		~TaskScheduler();
+
+		// Run the body over sub-ranges covering the range (same as cv::parallel_for_), returns once all of them are done
+		// (can be called from any thread, including from within a body)
+		void ParallelFor(const cv::Range& range, const std::function<void(const cv::Range&)>& body);
+
+		// Number of worker threads, 0 picks it based on the number of cores (only has an effect before the scheduler is first used)
+		void SetNumberOfWorkers(int num_workers);
+
+		int NumberOfWorkers();
+
+	private:
+
+		TaskScheduler() : num_workers(0), started(false), stopping(false), queued_tasks(0) { ; }
+
+		// The state of a running loop, it lives on the stack of the thread waiting for it
+		struct Loop
+		{
+			const std::function<void(const cv::Range&)>* body;
+
+			// The tasks not finished yet, only decremented with done_mutex held so the waiter can't return while it is being signalled
+			std::atomic<int> remaining;
+			std::mutex done_mutex;
+			std::condition_variable done_cond;
+
+			// The first exception thrown by the body, once set the tasks left are skipped
+			std::atomic<bool> failed;
+			std::exception_ptr exception;
+		};
+
+		// A range of a loop to run
+		struct Task
+		{
+			Loop* loop;
+			cv::Range range;
+		};
+
+		// The tasks created by a worker (the last one is shared by all the threads outside of the scheduler)
+		struct TaskQueue
+		{
+			std::mutex queue_mutex;
+			std::deque<Task> tasks;
+		};
+
+		void Start();
+
+		void WorkerThread(int worker_index);
+
+		// Run a single task if there is any, the own queue first and then stealing from the others, only of the given loop if there is one
+		bool RunTask(int queue_index, const Loop* only_loop = nullptr);
+
+		// Take a task out of a queue, the most recent or the oldest one
+		static bool TakeTask(TaskQueue& queue, bool most_recent, const Loop* only_loop, Task& task);
+
+		// Run the body over the task range, catching what it throws, and mark it as done
+		static void Execute(const Task& task);
+
+		int num_workers;
+		std::atomic<bool> started;
+		std::mutex start_mutex;
+
+		std::vector<std::unique_ptr<TaskQueue> > queues;
+		std::vector<std::thread> workers;
+
+		// For the workers to sleep when there is nothing to do
+		std::mutex sleep_mutex;
+		std::condition_variable sleep_cond;
+		bool stopping;
+		std::atomic<int> queued_tasks;
+
+		// Blocking copy and move, there is only one scheduler
+		TaskScheduler(const TaskScheduler& other);
+		TaskScheduler & operator= (const TaskScheduler& other);
+	};
+}
+#endif // TASK_SCHEDULER_H
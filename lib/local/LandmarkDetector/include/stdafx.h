@@ -68,6 +68,9 @@ extern "C" {
 
 	void sgemm_(char *, char *, blasint *, blasint *, blasint *, float *,
 		float  *, blasint *, float  *, blasint *, float  *, float  *, blasint *);
+
+	void ssyrk_(char *, char *, blasint *, blasint *, float *,
+		float  *, blasint *, float  *, float  *, blasint *);
 }
 
 
@@ -42,6 +42,7 @@
 
 // Local includes
 #include "LandmarkDetectorUtils.h"
+#include "CNN_utils.h"
 
 using namespace LandmarkDetector;
 
@@ -61,7 +62,8 @@ CCNF_neuron::CCNF_neuron(const CCNF_neuron& other) : weights(other.weights.clone
 }
 
 // Copy constructor		
-CCNF_patch_expert::CCNF_patch_expert(const CCNF_patch_expert& other) : neurons(other.neurons), window_sizes(other.window_sizes), betas(other.betas)
+CCNF_patch_expert::CCNF_patch_expert(const CCNF_patch_expert& other) : neurons(other.neurons), window_sizes(other.window_sizes), betas(other.betas),
+	neuron_spectra(other.neuron_spectra), spectra_neurons(other.spectra_neurons), flat_neurons_response(other.flat_neurons_response)
 {
 	this->width = other.width;
 	this->height = other.height;
@@ -69,6 +71,8 @@ CCNF_patch_expert::CCNF_patch_expert(const CCNF_patch_expert& other) : neurons(o
 	
 	this->weight_matrix = other.weight_matrix.clone();
 
+	// The neuron spectra are only read after being computed, so they are deliberately shared rather than cloned
+
 	// Copy the Sigmas in a deep way
 	for (std::vector<cv::Mat_<float> >::const_iterator it = other.Sigmas.begin(); it != other.Sigmas.end(); it++)
 	{
@@ -115,98 +119,66 @@ void CCNF_patch_expert::ComputeSigmas(std::vector<cv::Mat_<float> > sigma_compon
 
 	window_sizes.push_back(window_size);
 	Sigmas.push_back(Sigma_f);
+	neuron_spectra.push_back(ComputeNeuronSpectra(window_size));
 
 }
 
-//===========================================================================
-void CCNF_neuron::Read(std::ifstream &stream)
+// Compute the spectra of the zero mean and unit norm neuron weights, padded to the DFT size of the area of interest for the window size
+cv::Mat_<float> CCNF_patch_expert::ComputeNeuronSpectra(int window_size) const
 {
-	// Sanity check
-	int read_type;
-	stream.read ((char*)&read_type, 4);
-	assert(read_type == 2);
-
-	stream.read ((char*)&neuron_type, 4);
-	stream.read ((char*)&norm_weights, 8);
-	stream.read ((char*)&bias, 8);
-	stream.read ((char*)&alpha, 8);
-	
-	LandmarkDetector::ReadMatBin(stream, weights); 
-
-}
-
-// Perform im2col, while at the same time doing contrast normalization and adding a bias term 
-void im2colContrastNormBias(const cv::Mat_<float>& input, const unsigned int width, const unsigned int height, cv::Mat_<float>& output)
-{
-	const unsigned int m = input.rows;
-	const unsigned int n = input.cols;
-
-	// determine how many blocks there will be with a sliding window of width x height in the input
-	const unsigned int yB = m - height + 1;
-	const unsigned int xB = n - width + 1;
-
-	// Allocate the output size
-	if (output.rows != xB*yB && output.cols != width * height + 1) 
+	// Only raw patches are normalised per window, the others go through the per neuron path
+	for (size_t i = 0; i < neurons.size(); i++)
 	{
-		output = cv::Mat::ones(xB*yB, width * height + 1, CV_32F);
+		if (neurons[i].neuron_type != 0)
+		{
+			return cv::Mat_<float>();
+		}
 	}
 
-	// Iterate over the blocks
-	unsigned int rowIdx = 0;
-	for (unsigned int j = 0; j< xB; j++)
+	if (spectra_neurons.empty())
 	{
-		for (unsigned int i = 0; i< yB; i++)
-		{
+		return cv::Mat_<float>();
+	}
 
-			float* Mo = output.ptr<float>(rowIdx);
+	int dft_width = cv::getOptimalDFTSize(window_size + width - 1);
+	int dft_height = cv::getOptimalDFTSize(window_size + height - 1);
 
-			float sum = 0;
+	cv::Mat_<float> spectra(dft_height * (int)spectra_neurons.size(), dft_width, 0.0f);
 
-			for (unsigned int yy = 0; yy < height; ++yy)
-			{
-				const float* Mi = input.ptr<float>(i + yy);
-				for (unsigned int xx = 0; xx < width; ++xx)
-				{
-					unsigned int colIdx = xx*height + yy;
-					float in = Mi[j + xx];
-					sum += in;
-
-					Mo[colIdx + 1] = in;
-				}
-			}
+	for (size_t i = 0; i < spectra_neurons.size(); i++)
+	{
+		const cv::Mat_<float>& weights = neurons[spectra_neurons[i]].weights;
 
-			// Working out the mean
-			float mean = sum / (float)(width * height);
+		// Subtracting the mean and dividing by the norm here takes care of the template side of TM_CCOEFF_NORMED
+		cv::Scalar mean, std;
+		cv::meanStdDev(weights, mean, std);
+		double norm = std[0] * std::sqrt((double)(weights.rows * weights.cols));
 
-			float sum_sq = 0;
-			const unsigned int num_items = width*height + 1;
-			// Working out the sum squared and subtracting the mean
-			for (unsigned int x = 1; x < num_items; ++x)
-			{
-				float in = Mo[x] - mean;
-				Mo[x] = in;
-				sum_sq += in * in;
-			}
+		cv::Mat_<float> spectrum = spectra.rowRange(i * dft_height, (i + 1) * dft_height);
+		cv::Mat_<float> weights_normed = (weights - mean[0]) / norm;
+		weights_normed.copyTo(spectrum(cv::Rect(0, 0, weights.cols, weights.rows)));
 
-			float norm = sqrt(sum_sq);
+		cv::dft(spectrum, spectrum, 0, weights.rows);
+	}
 
-			// Avoiding division by 0
-			if (norm == 0)
-			{
-				norm = 1;
-			}
+	return spectra;
+}
 
-			// Flip multiplication to division for speed
-			norm = 1.0 / norm;
+//===========================================================================
+void CCNF_neuron::Read(std::ifstream &stream)
+{
+	// Sanity check
+	int read_type;
+	stream.read ((char*)&read_type, 4);
+	assert(read_type == 2);
 
-			for (unsigned int x = 1; x < num_items; ++x)
-			{
-				Mo[x] *= norm;
-			}
+	stream.read ((char*)&neuron_type, 4);
+	stream.read ((char*)&norm_weights, 8);
+	stream.read ((char*)&bias, 8);
+	stream.read ((char*)&alpha, 8);
+	
+	LandmarkDetector::ReadMatBin(stream, weights); 
 
-			rowIdx++;
-		}
-	}
 }
 
 //===========================================================================
@@ -328,6 +300,29 @@ void CCNF_patch_expert::Read(std::ifstream &stream, std::vector<int> window_size
 		weight_matrix.at<float>(i, 0) = neurons[i].bias;
 	}
 
+	// Work out which neurons need to be evaluated for the FFT response, a neuron with flat weights has the same normalised response everywhere
+	spectra_neurons.clear();
+	flat_neurons_response = 0.0f;
+	for (size_t i = 0; i < neurons.size(); i++)
+	{
+		// Do not bother with neuron response if the alpha is tiny and will not contribute much to overall result
+		if (neurons[i].alpha <= 1e-4)
+		{
+			continue;
+		}
+
+		cv::Scalar mean, std;
+		cv::meanStdDev(neurons[i].weights, mean, std);
+		if (std[0] * std[0] < DBL_EPSILON)
+		{
+			flat_neurons_response += (float)((2 * neurons[i].alpha) / (1.0 + exp(-(neurons[i].norm_weights + neurons[i].bias))));
+		}
+		else
+		{
+			spectra_neurons.push_back((int)i);
+		}
+	}
+
 	// In case we are using OpenBLAS, make sure it is not multi-threading as we are multi-threading outside of it
 	openblas_set_num_threads(1);
 
@@ -353,36 +348,99 @@ void CCNF_patch_expert::Read(std::ifstream &stream, std::vector<int> window_size
 }
 
 //===========================================================================
-void CCNF_patch_expert::Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response)
+void CCNF_patch_expert::NeuronResponsesFFT(const cv::Mat_<float> &area_of_interest, const cv::Mat_<float> &spectra, cv::Mat_<float> &neuron_sum) const
 {
-	
-	int response_height = area_of_interest.rows - height + 1;
-	int response_width = area_of_interest.cols - width + 1;
+	int response_height = neuron_sum.rows;
+	int response_width = neuron_sum.cols;
 
-	if(response.rows != response_height || response.cols != response_width)
+	int dft_height = spectra.rows / (int)spectra_neurons.size();
+	int dft_width = spectra.cols;
+
+	// The spectrum of the area of interest, shared by all of the neurons
+	cv::Mat_<float> area_of_interest_dft(dft_height, dft_width, 0.0f);
+	area_of_interest.copyTo(area_of_interest_dft(cv::Rect(0, 0, area_of_interest.cols, area_of_interest.rows)));
+	cv::dft(area_of_interest_dft, area_of_interest_dft, 0, area_of_interest.rows);
+
+	// The norm of every window, as the neuron weights are already normalised this is all that is left of TM_CCOEFF_NORMED
+	// (the integral images are kept in double as the window variance suffers from cancellation)
+	cv::Mat_<double> integral_image, integral_image_sq;
+	cv::integral(area_of_interest, integral_image, integral_image_sq, CV_64F, CV_64F);
+
+	double inv_area = 1.0 / (width * height);
+	cv::Mat_<float> window_norms(response_height, response_width);
+	for (int i = 0; i < response_height; i++)
 	{
-		response.create(response_height, response_width);
+		const double* s0 = integral_image.ptr<double>(i);
+		const double* s1 = integral_image.ptr<double>(i + height);
+		const double* q0 = integral_image_sq.ptr<double>(i);
+		const double* q1 = integral_image_sq.ptr<double>(i + height);
+		float* norms = window_norms.ptr<float>(i);
+
+		for (int j = 0; j < response_width; j++)
+		{
+			double sum = s1[j + width] - s1[j] - s0[j + width] + s0[j];
+			double sum_sq = q1[j + width] - q1[j] - q0[j + width] + q0[j];
+			norms[j] = (float)std::sqrt(std::max(sum_sq - sum * sum * inv_area, 0.0));
+		}
 	}
-		
-	response.setTo(0);
-	
-	// the placeholder for the DFT of the image, the integral image, and squared integral image so they don't get recalculated for every response
-	cv::Mat_<double> area_of_interest_dft;
-	cv::Mat integral_image, integral_image_sq;
-	
-	cv::Mat_<float> neuron_response;
 
-	// responses from the neural layers
-	for(size_t i = 0; i < neurons.size(); i++)
-	{		
-		// Do not bother with neuron response if the alpha is tiny and will not contribute much to overall result
-		if(neurons[i].alpha > 1e-4)
+	neuron_sum.setTo(flat_neurons_response);
+
+	// The neuron spectra are stored one after the other, so all of the neurons are a run of multiply-accumulates over a single buffer
+	cv::Mat_<float> correlation(dft_height, dft_width);
+	for (size_t n = 0; n < spectra_neurons.size(); n++)
+	{
+		const CCNF_neuron& neuron = neurons[spectra_neurons[n]];
+
+		cv::mulSpectrums(area_of_interest_dft, spectra.rowRange(n * dft_height, (n + 1) * dft_height), correlation, 0, true);
+		cv::dft(correlation, correlation, cv::DFT_INVERSE + cv::DFT_SCALE, response_height);
+
+		float alpha_2 = (float)(2 * neuron.alpha);
+		float norm_weights = (float)neuron.norm_weights;
+		float bias = (float)neuron.bias;
+
+		for (int i = 0; i < response_height; i++)
 		{
+			const float* corr = correlation.ptr<float>(i);
+			const float* norms = window_norms.ptr<float>(i);
+			float* out = neuron_sum.ptr<float>(i);
 
-			neurons[i].Response(area_of_interest, area_of_interest_dft, integral_image, integral_image_sq, neuron_response);
-			response = response + neuron_response;
+			for (int j = 0; j < response_width; j++)
+			{
+				// Same handling of the numerical noise as in matchTemplate_m
+				float num = corr[j];
+				float t = norms[j];
+				float r;
+				if (std::abs(num) < t)
+					r = num / t;
+				else if (std::abs(num) < t * 1.125f)
+					r = num > 0 ? 1.0f : -1.0f;
+				else
+					r = 0.0f;
+
+				// the logistic function (sigmoid) applied to the response
+				out[j] += alpha_2 / (1.0f + std::exp(-(r * norm_weights + bias)));
+			}
 		}
 	}
+}
+
+//===========================================================================
+bool CCNF_patch_expert::HasSpectra(int window_size) const
+{
+	for (size_t i = 0; i < window_sizes.size(); ++i)
+	{
+		if (window_sizes[i] == window_size)
+			return !neuron_spectra[i].empty();
+	}
+	return false;
+}
+
+void CCNF_patch_expert::Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response)
+{
+	
+	int response_height = area_of_interest.rows - height + 1;
+	int response_width = area_of_interest.cols - width + 1;
 
 	int s_to_use = -1;
 
@@ -397,11 +455,50 @@ void CCNF_patch_expert::Response(const cv::Mat_<float> &area_of_interest, cv::Ma
 		}
 	}
 
-	cv::Mat_<float> resp_vec_f = response.reshape(1, response_height * response_width);
+	// The sum of the neuron responses, the edge potentials (Sigma) are applied to it afterwards
+	cv::Mat_<float> neuron_sum(response_height, response_width, 0.0f);
 
-	cv::Mat out = Sigmas[s_to_use] * resp_vec_f;
+	if (response_width == response_height && !neuron_spectra[s_to_use].empty())
+	{
+		NeuronResponsesFFT(area_of_interest, neuron_spectra[s_to_use], neuron_sum);
+	}
+	else
+	{
+		// the placeholder for the DFT of the image, the integral image, and squared integral image so they don't get recalculated for every response
+		cv::Mat_<double> area_of_interest_dft;
+		cv::Mat integral_image, integral_image_sq;
 	
-	response = out.reshape(1, response_height);
+		cv::Mat_<float> neuron_response;
+
+		// responses from the neural layers
+		for(size_t i = 0; i < neurons.size(); i++)
+		{		
+			// Do not bother with neuron response if the alpha is tiny and will not contribute much to overall result
+			if(neurons[i].alpha > 1e-4)
+			{
+
+				neurons[i].Response(area_of_interest, area_of_interest_dft, integral_image, integral_image_sq, neuron_response);
+				neuron_sum = neuron_sum + neuron_response;
+			}
+		}
+	}
+
+	if(response.rows != response_height || response.cols != response_width)
+	{
+		response.create(response_height, response_width);
+	}
+
+	// Perform the Sigma multiplication in OpenBLAS (fortran call), the row major Sigma is transposed from the column major point of view
+	int num_elements = response_height * response_width;
+	int one = 1;
+	float alpha1 = 1.0;
+	float beta1 = 0.0;
+	char T[2]; T[0] = 'T';
+	char N[2]; N[0] = 'N';
+	sgemm_(T, N, &num_elements, &one, &num_elements, &alpha1, (float*)Sigmas[s_to_use].data, &num_elements, (float*)neuron_sum.data, &num_elements, &beta1, (float*)response.data, &num_elements);
+
+	// Above is a faster version of this
+	//response = (Sigmas[s_to_use] * neuron_sum.reshape(1, num_elements)).reshape(1, response_height);
 
 	// Making sure the response does not have negative numbers
 	double min;
@@ -34,6 +34,12 @@
 #include "stdafx.h"
 
 #include "CNN_utils.h"
+#include "TaskScheduler.h"
+
+#include <cfloat>
+#include <fstream>
+#include <sstream>
+#include <thread>
 
 namespace LandmarkDetector
 {
@@ -442,6 +448,80 @@ namespace LandmarkDetector
 		}
 	}
 
+	// Perform im2col, while at the same time doing contrast normalization and adding a bias term 
+	void im2colContrastNormBias(const cv::Mat_<float>& input, const unsigned int width, const unsigned int height, cv::Mat_<float>& output)
+	{
+		const unsigned int m = input.rows;
+		const unsigned int n = input.cols;
+
+		// determine how many blocks there will be with a sliding window of width x height in the input
+		const unsigned int yB = m - height + 1;
+		const unsigned int xB = n - width + 1;
+
+		// Allocate the output size
+		if (output.rows != xB*yB && output.cols != width * height + 1) 
+		{
+			output = cv::Mat::ones(xB*yB, width * height + 1, CV_32F);
+		}
+
+		// Iterate over the blocks
+		unsigned int rowIdx = 0;
+		for (unsigned int j = 0; j< xB; j++)
+		{
+			for (unsigned int i = 0; i< yB; i++)
+			{
+
+				float* Mo = output.ptr<float>(rowIdx);
+
+				float sum = 0;
+
+				for (unsigned int yy = 0; yy < height; ++yy)
+				{
+					const float* Mi = input.ptr<float>(i + yy);
+					for (unsigned int xx = 0; xx < width; ++xx)
+					{
+						unsigned int colIdx = xx*height + yy;
+						float in = Mi[j + xx];
+						sum += in;
+
+						Mo[colIdx + 1] = in;
+					}
+				}
+
+				// Working out the mean
+				float mean = sum / (float)(width * height);
+
+				float sum_sq = 0;
+				const unsigned int num_items = width*height + 1;
+				// Working out the sum squared and subtracting the mean
+				for (unsigned int x = 1; x < num_items; ++x)
+				{
+					float in = Mo[x] - mean;
+					Mo[x] = in;
+					sum_sq += in * in;
+				}
+
+				float norm = sqrt(sum_sq);
+
+				// Avoiding division by 0
+				if (norm == 0)
+				{
+					norm = 1;
+				}
+
+				// Flip multiplication to division for speed
+				norm = 1.0 / norm;
+
+				for (unsigned int x = 1; x < num_items; ++x)
+				{
+					Mo[x] *= norm;
+				}
+
+				rowIdx++;
+			}
+		}
+	}
+
 	void im2col_multimap(const std::vector<cv::Mat_<float> >& inputs, const unsigned int width, const unsigned int height, 
 		cv::Mat_<float>& output)
 	{
@@ -539,5 +619,187 @@ namespace LandmarkDetector
 	
 	}
 
+	// A batched version of the above, all of the inputs are expected to be of the same size
+	void convolution_direct_blas_batch(std::vector<std::vector<cv::Mat_<float> > >& outputs, const std::vector<std::vector<cv::Mat_<float> > >& input_maps, const cv::Mat_<float>& weight_matrix, int height_k, int width_k, cv::Mat_<float>& pre_alloc_im2col)
+	{
+		int batch_size = (int)input_maps.size();
+
+		outputs.clear();
+		outputs.resize(batch_size);
+
+		if (batch_size == 0)
+			return;
+
+		int height_in = input_maps[0][0].rows;
+		int width_n = input_maps[0][0].cols;
+
+		// determine how many blocks there will be with a sliding window of width x height in the input
+		int yB = height_in - height_k + 1;
+		int xB = width_n - width_k + 1;
+		int num_rows = yB * xB;
+		int num_cols = width_k * height_k * (int)input_maps[0].size() + 1;
+
+		// Allocate (the last column is the bias term, hence the ones) only if not enough rows are present, as in the non-batched version this is not thread safe
+		if (pre_alloc_im2col.cols != num_cols || pre_alloc_im2col.rows < num_rows * batch_size)
+		{
+			pre_alloc_im2col = cv::Mat::ones(num_rows * batch_size, num_cols, CV_32F);
+		}
+
+		// Stack the im2col of every input one after the other
+		for (int b = 0; b < batch_size; ++b)
+		{
+			cv::Mat_<float> im2col_b = pre_alloc_im2col.rowRange(b * num_rows, (b + 1) * num_rows);
+			im2col_multimap(input_maps[b], width_k, height_k, im2col_b);
+		}
+
+		int total_rows = num_rows * batch_size;
+
+		float* m1 = (float*)pre_alloc_im2col.data;
+		float* m2 = (float*)weight_matrix.data;
+		int m2_cols = weight_matrix.cols;
+
+		cv::Mat_<float> out(total_rows, weight_matrix.cols, 1.0);
+		float* m3 = (float*)out.data;
+
+		float alpha = 1.0f;
+		float beta = 0.0f;
+		// Call fortran directly (faster)
+		char N[2]; N[0] = 'N';
+		sgemm_(N, N, &m2_cols, &total_rows, &pre_alloc_im2col.cols, &alpha, m2, &m2_cols, m1, &pre_alloc_im2col.cols, &beta, m3, &m2_cols);
+
+		// Above is equivalent to out = pre_alloc_im2col(0:total_rows, :) * weight_matrix;
+
+		out = out.t();
+
+		// Split the result back to the individual inputs
+		for (int b = 0; b < batch_size; ++b)
+		{
+			for (int k = 0; k < out.rows; ++k)
+			{
+				outputs[b].push_back(out(cv::Rect(b * num_rows, k, num_rows, 1)).reshape(1, yB));
+			}
+		}
+	}
+
+
+
+	//===========================================================================
+	ConvolutionTuner& ConvolutionTuner::Instance()
+	{
+		static ConvolutionTuner tuner;
+		return tuner;
+	}
+
+	// A description of the CPU and the number of worker threads the convolutions run on, so that the cached timings are not used on a different host
+	static std::string HostDescription()
+	{
+		std::string cpu_model;
+
+		std::ifstream cpu_info("/proc/cpuinfo");
+		std::string line;
+		while (cpu_model.empty() && std::getline(cpu_info, line))
+		{
+			if (line.compare(0, 10, "model name") == 0 && line.find(':') != std::string::npos)
+			{
+				cpu_model = line.substr(line.find(':') + 1);
+			}
+		}
+
+		if (cpu_model.empty() && getenv("PROCESSOR_IDENTIFIER") != NULL)
+		{
+			cpu_model = getenv("PROCESSOR_IDENTIFIER");
+		}
+
+		// Tabs separate the fields of the cache file
+		for (size_t i = 0; i < cpu_model.size(); ++i)
+		{
+			if (cpu_model[i] == '\t')
+				cpu_model[i] = ' ';
+		}
+
+		std::stringstream description;
+		description << cpu_model << " " << std::thread::hardware_concurrency() << " cores " << TaskScheduler::Instance().NumberOfWorkers() << " threads";
+		return description.str();
+	}
+
+	void ConvolutionTuner::Enable(const std::string& cache_location)
+	{
+		std::lock_guard<std::mutex> lock(tuner_mutex);
+
+		this->cache_location = cache_location;
+		this->host = HostDescription();
+		this->enabled = true;
+
+		// Every line of the cache is host, convolution and kernel separated by tabs
+		std::ifstream cache(cache_location);
+		std::string line;
+		while (std::getline(cache, line))
+		{
+			size_t host_end = line.find('\t');
+			size_t key_end = line.rfind('\t');
+			if (host_end == std::string::npos || key_end == host_end || line.compare(0, host_end, host) != 0)
+				continue;
+
+			int kernel = atoi(line.substr(key_end + 1).c_str());
+			kernels[line.substr(host_end + 1, key_end - host_end - 1)] = kernel == FFT ? FFT : GEMM;
+		}
+	}
+
+	ConvolutionTuner::Kernel ConvolutionTuner::GetKernel(const std::string& key)
+	{
+		std::lock_guard<std::mutex> lock(tuner_mutex);
+
+		std::map<std::string, Kernel>::const_iterator it = kernels.find(key);
+		if (it == kernels.end())
+			return UNKNOWN;
+
+		return it->second;
+	}
+
+	void ConvolutionTuner::SetTimings(const std::string& key, double gemm_time, double fft_time)
+	{
+		std::lock_guard<std::mutex> lock(tuner_mutex);
+
+		// Another thread might have timed it in the meantime
+		if (kernels.find(key) != kernels.end())
+			return;
+
+		Kernel kernel = fft_time < gemm_time ? FFT : GEMM;
+		kernels[key] = kernel;
+
+		if (!cache_location.empty())
+		{
+			std::ofstream cache(cache_location, std::ios_base::app);
+			cache << host << "\t" << key << "\t" << (int)kernel << std::endl;
+		}
+	}
+
+	void ConvolutionTuner::Tune(const std::string& key, const std::function<void()>& gemm, const std::function<void()>& fft)
+	{
+		// Only one convolution is timed at a time, so that the timings do not compete with each other for the cores
+		std::lock_guard<std::mutex> lock(timing_mutex);
+
+		if (GetKernel(key) != UNKNOWN)
+			return;
+
+		// Both are run once before timing, so that the im2col buffers and the kernel DFTs are in place
+		gemm();
+		fft();
+
+		// Taking the fastest run of each, as anything else running on the host can only make a run slower
+		double gemm_time = DBL_MAX, fft_time = DBL_MAX;
+		for (int run = 0; run < TIMING_RUNS; ++run)
+		{
+			int64 start = cv::getTickCount();
+			gemm();
+			gemm_time = std::min(gemm_time, (double)(cv::getTickCount() - start));
+
+			start = cv::getTickCount();
+			fft();
+			fft_time = std::min(fft_time, (double)(cv::getTickCount() - start));
+		}
+
+		SetTimings(key, gemm_time, fft_time);
+	}
 
 }
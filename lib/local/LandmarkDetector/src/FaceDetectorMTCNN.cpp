@@ -44,6 +44,7 @@
 
 // CNN includes
 #include "CNN_utils.h"
+#include "TaskScheduler.h"
 
 // Instead of including cblas.h (the definitions from OpenBLAS and other BLAS libraries differ, declare the required OpenBLAS functionality here)
 #ifdef __cplusplus
@@ -62,11 +63,23 @@ FaceDetectorMTCNN::FaceDetectorMTCNN(const std::string& location)
 {
 	this->Read(location);
 }
-// Copy constructor
+// Copy constructor (the pyramid levels start out empty in the copy)
 FaceDetectorMTCNN::FaceDetectorMTCNN(const FaceDetectorMTCNN& other) : PNet(other.PNet), RNet(other.RNet), ONet(other.ONet)
 {
 }
 
+// Assignment, only the networks are taken over and the pyramid levels of this instance are kept
+FaceDetectorMTCNN& FaceDetectorMTCNN::operator=(const FaceDetectorMTCNN& other)
+{
+	if (this != &other)
+	{
+		PNet = other.PNet;
+		RNet = other.RNet;
+		ONet = other.ONet;
+	}
+	return *this;
+}
+
 CNN::CNN(const CNN& other) : cnn_layer_types(other.cnn_layer_types), cnn_max_pooling_layers(other.cnn_max_pooling_layers), cnn_convolutional_layers_bias(other.cnn_convolutional_layers_bias), conv_layer_pre_alloc_im2col(other.conv_layer_pre_alloc_im2col)
 {
 
@@ -154,7 +167,29 @@ std::vector<cv::Mat_<float>> CNN::Inference(const cv::Mat& input_img, bool direc
 		{
 
 			// Either perform direct convolution through matrix multiplication or use an FFT optimized version, which one is optimal depends on the kernel and input sizes
-			if (direct)
+			bool direct_layer = direct;
+
+			// When tuning, the faster of the two is picked per kernel and input size (not when thread safe, as the FFT caches the kernel DFTs)
+			ConvolutionTuner& tuner = ConvolutionTuner::Instance();
+			if (direct && !thread_safe && tuner.Enabled())
+			{
+				std::stringstream key;
+				key << "conv " << cnn_convolutional_layers[cnn_layer][0][0].rows << "x" << cnn_convolutional_layers[cnn_layer][0][0].cols << " " << 
+					input_maps.size() << "->" << cnn_convolutional_layers[cnn_layer].size() << " on " << input_maps[0].rows << "x" << input_maps[0].cols;
+
+				if (tuner.GetKernel(key.str()) == ConvolutionTuner::UNKNOWN)
+				{
+					// The network runs sequentially here, so the timing does not compete with the other layers
+					tuner.Tune(key.str(), [&]() {
+						convolution_direct_blas(outputs, input_maps, cnn_convolutional_layers_weights[cnn_layer], cnn_convolutional_layers[cnn_layer][0][0].rows, cnn_convolutional_layers[cnn_layer][0][0].cols, conv_layer_pre_alloc_im2col[cnn_layer]);
+					}, [&]() {
+						convolution_fft2(outputs, input_maps, cnn_convolutional_layers[cnn_layer], cnn_convolutional_layers_bias[cnn_layer], cnn_convolutional_layers_dft[cnn_layer]);
+					});
+				}
+				direct_layer = tuner.GetKernel(key.str()) == ConvolutionTuner::GEMM;
+			}
+
+			if (direct_layer)
 			{
 				if(thread_safe)
 				{
@@ -623,6 +658,125 @@ void apply_correction(std::vector<cv::Rect_<float> >& total_bboxes, const std::v
 
 }
 
+void FaceDetectorMTCNN::BuildPyramid(const cv::Mat& img, double first_scale, double factor, int num_scales)
+{
+	pyramid_levels.resize(num_scales);
+	pyramid_normalised.resize(num_scales);
+	pyramid_scales.resize(num_scales);
+
+	for (int i = 0; i < num_scales; ++i)
+	{
+		double scale = first_scale * cv::pow(factor, i);
+
+		int h_pyr = ceil(img.rows * scale);
+		int w_pyr = ceil(img.cols * scale);
+
+		// Every level is downsampled from the previous one rather than from the full image, resize will reuse the existing level memory when sizes match
+		const cv::Mat& source = i == 0 ? img : pyramid_levels[i - 1];
+		cv::resize(source, pyramid_levels[i], cv::Size(w_pyr, h_pyr));
+
+		pyramid_scales[i] = scale;
+	}
+}
+
+// PNet is fully convolutional (3x3 conv, 2x2 max pool, 3x3 conv, 3x3 conv, 1x1 conv) with a 12x12 receptive field and an output stride of 2,
+// so big pyramid levels are evaluated in tiles of this many outputs across
+const int PNET_TILE_OUTPUTS = 128;
+
+// Number of PNet outputs along an input dimension (following the rounding in max_pooling)
+int pnet_output_size(int input_size)
+{
+	return (int)round((float)(input_size - 4) / 2.0f) + 1 - 4;
+}
+
+std::vector<cv::Mat_<float> > FaceDetectorMTCNN::PNetInferenceTiled(const cv::Mat& img)
+{
+	// Each output depends on a 12x12 input window starting at twice its location, so neighbouring tiles overlap by 10 pixels
+	int tile_size = 2 * PNET_TILE_OUTPUTS + 10;
+
+	// Small images are done in one go
+	if (img.rows <= tile_size && img.cols <= tile_size)
+	{
+		return PNet.Inference(img, true, true);
+	}
+
+	int out_rows = pnet_output_size(img.rows);
+	int out_cols = pnet_output_size(img.cols);
+
+	std::vector<cv::Point> tile_starts;
+	for (int y = 0; y < out_rows; y += PNET_TILE_OUTPUTS)
+	{
+		for (int x = 0; x < out_cols; x += PNET_TILE_OUTPUTS)
+		{
+			tile_starts.push_back(cv::Point(x, y));
+		}
+	}
+
+	std::vector<std::vector<cv::Mat_<float> > > tile_outputs(tile_starts.size());
+
+	TaskScheduler::Instance().ParallelFor(cv::Range(0, (int)tile_starts.size()), [&](const cv::Range& range) {
+		for (int t = range.start; t < range.end; ++t)
+		{
+			int x_in = 2 * tile_starts[t].x;
+			int y_in = 2 * tile_starts[t].y;
+			cv::Rect tile(x_in, y_in, cv::min(tile_size, img.cols - x_in), cv::min(tile_size, img.rows - y_in));
+			tile_outputs[t] = PNet.Inference(img(tile), true, true);
+		}
+	});
+
+	// Stitch the tile outputs back together
+	std::vector<cv::Mat_<float> > outputs;
+	for (size_t k = 0; k < tile_outputs[0].size(); ++k)
+	{
+		cv::Mat_<float> output(out_rows, out_cols, 0.0f);
+		for (size_t t = 0; t < tile_starts.size(); ++t)
+		{
+			const cv::Mat_<float>& tile_output = tile_outputs[t][k];
+			tile_output.copyTo(output(cv::Rect(tile_starts[t].x, tile_starts[t].y, tile_output.cols, tile_output.rows)));
+		}
+		outputs.push_back(output);
+	}
+
+	return outputs;
+}
+
+void FaceDetectorMTCNN::ExtractProposal(cv::Mat& out_img, const cv::Mat& img, const cv::Rect_<float>& box, int out_size) const
+{
+	// The region to crop in the original image (the boxes are inclusive of their end pixels)
+	cv::Rect_<float> region(box.x - 1, box.y - 1, box.width + 1, box.height + 1);
+
+	// Pick the smallest pyramid level (no bigger than the original) on which the region is still at least as big as the network input
+	const cv::Mat* source = &img;
+	for (size_t i = 0; i < pyramid_levels.size(); ++i)
+	{
+		if (pyramid_levels[i].cols <= img.cols && region.width * pyramid_levels[i].cols / img.cols >= out_size)
+		{
+			source = &pyramid_levels[i];
+		}
+	}
+
+	float scale_x = (float)source->cols / (float)img.cols;
+	float scale_y = (float)source->rows / (float)img.rows;
+
+	int start_x = cvRound(region.x * scale_x);
+	int start_y = cvRound(region.y * scale_y);
+	int width = cv::max(cvRound((region.x + region.width) * scale_x) - start_x, 1);
+	int height = cv::max(cvRound((region.y + region.height) * scale_y) - start_y, 1);
+
+	// Pad with zeros anything outside of the image
+	cv::Mat tmp(height, width, source->type(), cv::Scalar(0, 0, 0));
+	cv::Rect crop = cv::Rect(start_x, start_y, width, height) & cv::Rect(0, 0, source->cols, source->rows);
+	if (crop.area() > 0)
+	{
+		(*source)(crop).copyTo(tmp(crop - cv::Point(start_x, start_y)));
+	}
+
+	cv::Mat prop_img;
+	cv::resize(tmp, prop_img, cv::Size(out_size, out_size));
+
+	// Normalise as part of the conversion to float
+	prop_img.convertTo(out_img, CV_32F, 0.0078125, -127.5 * 0.0078125);
+}
 
 // The actual MTCNN face detection step
 bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, const cv::Mat& img_in, 
@@ -654,8 +808,13 @@ bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, c
 		input_img = img_in;
 	}
 
-	cv::Mat img_float;
-	input_img.convertTo(img_float, CV_32FC3);
+	// The pyramid is built from 8-bit data, so make sure that is what we have
+	if (input_img.depth() != CV_8U)
+	{
+		input_img.convertTo(input_img, CV_8U);
+	}
+
+	BuildPyramid(input_img, (double)face_support / (double)min_face_size, pyramid_factor, num_scales);
 
 	std::vector<cv::Rect_<float> > proposal_boxes_all;
 	std::vector<float> scores_all;
@@ -666,44 +825,38 @@ bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, c
 	std::vector<std::vector<float> > scores_cross_scale(num_scales);
 	std::vector<std::vector<cv::Rect_<float> > > proposal_corrections_cross_scale(num_scales);
 
-	for (int i = 0; i < num_scales; ++i)
-	{
-		double scale = ((double)face_support / (double)min_face_size)*cv::pow(pyramid_factor, i);
-
-		int h_pyr = ceil(height_orig * scale);
-		int w_pyr = ceil(width_orig * scale);
-
-		cv::Mat normalised_img;
-		cv::resize(img_float, normalised_img, cv::Size(w_pyr, h_pyr));
-		
-		// Normalize the image
-		normalised_img = (normalised_img - 127.5) * 0.0078125;
+	// The scales are done in parallel, so PNet needs to be run in a thread safe way
+	TaskScheduler::Instance().ParallelFor(cv::Range(0, num_scales), [&](const cv::Range& range) {
+		for (int i = range.start; i < range.end; ++i)
+		{
+			double scale = pyramid_scales[i];
 
-		// Actual PNet CNN step
-		std::vector<cv::Mat_<float> > pnet_out = PNet.Inference(normalised_img, true, false);
+			// Normalize the image, done on the small level as part of the conversion to float
+			cv::Mat& normalised_img = pyramid_normalised[i];
+			pyramid_levels[i].convertTo(normalised_img, CV_32F, 0.0078125, -127.5 * 0.0078125);
 
-		// Clear the precomputations, as the image sizes will be different
-		PNet.ClearPrecomp();
+			// Actual PNet CNN step
+			std::vector<cv::Mat_<float> > pnet_out = PNetInferenceTiled(normalised_img);
 
-		// Extract the probabilities from PNet response
-		cv::Mat_<float> prob_heatmap;
-		cv::exp(pnet_out[0]- pnet_out[1], prob_heatmap);
-		prob_heatmap = 1.0 / (1.0 + prob_heatmap);
+			// Extract the probabilities from PNet response
+			cv::Mat_<float> prob_heatmap;
+			cv::exp(pnet_out[0]- pnet_out[1], prob_heatmap);
+			prob_heatmap = 1.0 / (1.0 + prob_heatmap);
 
-		// Extract the probabilities from PNet response
-		std::vector<cv::Mat_<float>> corrections_heatmap(pnet_out.begin() + 2, pnet_out.end());
+			// Extract the probabilities from PNet response
+			std::vector<cv::Mat_<float>> corrections_heatmap(pnet_out.begin() + 2, pnet_out.end());
 
-		// Grab the detections
-		std::vector<cv::Rect_<float> > proposal_boxes;
-		std::vector<float> scores;
-		std::vector<cv::Rect_<float> > proposal_corrections;
-		generate_bounding_boxes(proposal_boxes, scores, proposal_corrections, prob_heatmap, corrections_heatmap, scale, t1, face_support);
+			// Grab the detections
+			std::vector<cv::Rect_<float> > proposal_boxes;
+			std::vector<float> scores;
+			std::vector<cv::Rect_<float> > proposal_corrections;
+			generate_bounding_boxes(proposal_boxes, scores, proposal_corrections, prob_heatmap, corrections_heatmap, scale, t1, face_support);
 
-		proposal_boxes_cross_scale[i] = proposal_boxes;
-		scores_cross_scale[i] = scores;
-		proposal_corrections_cross_scale[i] = proposal_corrections;
-	}
-	//});
+			proposal_boxes_cross_scale[i] = proposal_boxes;
+			scores_cross_scale[i] = scores;
+			proposal_corrections_cross_scale[i] = proposal_corrections;
+		}
+	});
 
 	// Perform non-maximum supression on proposals accross scales and combine them
 	for (int i = 0; i < num_scales; ++i)
@@ -733,31 +886,9 @@ bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, c
 
 	for (size_t k = 0; k < proposal_boxes_all.size(); ++k) 
 	{
-		float width_target = proposal_boxes_all[k].width + 1;
-		float height_target = proposal_boxes_all[k].height + 1;
-
-		// Work out the start and end indices in the original image
-		int start_x_in = cv::max((int)(proposal_boxes_all[k].x - 1), 0);
-		int start_y_in = cv::max((int)(proposal_boxes_all[k].y - 1), 0);
-		int end_x_in = cv::min((int)(proposal_boxes_all[k].x + width_target - 1), width_orig);
-		int end_y_in = cv::min((int)(proposal_boxes_all[k].y + height_target - 1), height_orig);
-
-		// Work out the start and end indices in the target image
-		int	start_x_out = cv::max((int)(-proposal_boxes_all[k].x + 1), 0);
-		int start_y_out = cv::max((int)(-proposal_boxes_all[k].y + 1), 0);
-		int end_x_out = cv::min(width_target - (proposal_boxes_all[k].x + proposal_boxes_all[k].width - width_orig), width_target);
-		int end_y_out = cv::min(height_target - (proposal_boxes_all[k].y + proposal_boxes_all[k].height - height_orig), height_target);
-
-		cv::Mat tmp(height_target, width_target, CV_32FC3, cv::Scalar(0.0f,0.0f,0.0f));
-
-		img_float(cv::Rect(start_x_in, start_y_in, end_x_in - start_x_in, end_y_in - start_y_in)).copyTo(
-			tmp(cv::Rect(start_x_out, start_y_out, end_x_out - start_x_out, end_y_out - start_y_out)));
-		
 		cv::Mat prop_img;
-		cv::resize(tmp, prop_img, cv::Size(24, 24));
-			
-		prop_img = (prop_img - 127.5) * 0.0078125;
-		
+		ExtractProposal(prop_img, input_img, proposal_boxes_all[k], 24);
+
 		// Perform RNet on the proposal image
 		std::vector<cv::Mat_<float> > rnet_out = RNet.Inference(prop_img, true, false);
 
@@ -806,30 +937,8 @@ bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, c
 
 	for (size_t k = 0; k < proposal_boxes_all.size(); ++k)
 	{
-		float width_target = proposal_boxes_all[k].width + 1;
-		float height_target = proposal_boxes_all[k].height + 1;
-
-		// Work out the start and end indices in the original image
-		int start_x_in = cv::max((int)(proposal_boxes_all[k].x - 1), 0);
-		int start_y_in = cv::max((int)(proposal_boxes_all[k].y - 1), 0);
-		int end_x_in = cv::min((int)(proposal_boxes_all[k].x + width_target - 1), width_orig);
-		int end_y_in = cv::min((int)(proposal_boxes_all[k].y + height_target - 1), height_orig);
-
-		// Work out the start and end indices in the target image
-		int	start_x_out = cv::max((int)(-proposal_boxes_all[k].x + 1), 0);
-		int start_y_out = cv::max((int)(-proposal_boxes_all[k].y + 1), 0);
-		int end_x_out = cv::min(width_target - (proposal_boxes_all[k].x + proposal_boxes_all[k].width - width_orig), width_target);
-		int end_y_out = cv::min(height_target - (proposal_boxes_all[k].y + proposal_boxes_all[k].height - height_orig), height_target);
-
-		cv::Mat tmp(height_target, width_target, CV_32FC3, cv::Scalar(0.0f, 0.0f, 0.0f));
-
-		img_float(cv::Rect(start_x_in, start_y_in, end_x_in - start_x_in, end_y_in - start_y_in)).copyTo(
-			tmp(cv::Rect(start_x_out, start_y_out, end_x_out - start_x_out, end_y_out - start_y_out)));
-
 		cv::Mat prop_img;
-		cv::resize(tmp, prop_img, cv::Size(48, 48));
-
-		prop_img = (prop_img - 127.5) * 0.0078125;
+		ExtractProposal(prop_img, input_img, proposal_boxes_all[k], 48);
 
 		// Perform RNet on the proposal image
 		std::vector<cv::Mat_<float> > onet_out = ONet.Inference(prop_img, true, false);
@@ -58,10 +58,22 @@ using namespace LandmarkDetector;
 
 // Copy constructor
 DetectionValidator::DetectionValidator(const DetectionValidator& other) : orientations(other.orientations), paws(other.paws),
-cnn_subsampling_layers(other.cnn_subsampling_layers), cnn_layer_types(other.cnn_layer_types), cnn_convolutional_layers_im2col_precomp(other.cnn_convolutional_layers_im2col_precomp),
+cnn_subsampling_layers(other.cnn_subsampling_layers), cnn_layer_types(other.cnn_layer_types),
 cnn_convolutional_layers_weights(other.cnn_convolutional_layers_weights)
 {
 
+	// The im2col buffers are written to when validating, so every copy needs its own (copies are validated on different threads)
+	this->cnn_convolutional_layers_im2col_precomp.resize(other.cnn_convolutional_layers_im2col_precomp.size());
+	for (size_t v = 0; v < other.cnn_convolutional_layers_im2col_precomp.size(); ++v)
+	{
+		this->cnn_convolutional_layers_im2col_precomp[v].resize(other.cnn_convolutional_layers_im2col_precomp[v].size());
+
+		for (size_t l = 0; l < other.cnn_convolutional_layers_im2col_precomp[v].size(); ++l)
+		{
+			this->cnn_convolutional_layers_im2col_precomp[v][l] = other.cnn_convolutional_layers_im2col_precomp[v][l].clone();
+		}
+	}
+
 	this->cnn_convolutional_layers.resize(other.cnn_convolutional_layers.size());
 	for (size_t v = 0; v < other.cnn_convolutional_layers.size(); ++v)
 	{
@@ -314,11 +326,60 @@ void DetectionValidator::Read(std::string location)
 float DetectionValidator::Check(const cv::Vec3d& orientation, const cv::Mat_<uchar>& intensity_img, cv::Mat_<float>& detected_landmarks)
 {
 
-	int id = GetViewId(orientation);
-	
 	// The warped (cropped) image, corresponding to a face lying withing the detected lanmarks
 	cv::Mat_<float> warped;
-	
+	int id;
+
+	// If the ROI is non existent return failure (this could happen if all landmarks are outside of the image)
+	if (!Warp(orientation, intensity_img, detected_landmarks, warped, id))
+	{
+		return 0.0f;
+	}
+
+	// The actual validation step
+	return CheckWarped(std::vector<cv::Mat_<float> >(1, warped), std::vector<int>(1, id))[0];
+}
+
+//===========================================================================
+// Check if the fitting succeeded for a number of faces in the same image
+std::vector<float> DetectionValidator::Check(const std::vector<cv::Vec3d>& orientations, const cv::Mat_<uchar>& intensity_img, const std::vector<cv::Mat_<float> >& detected_landmarks)
+{
+	std::vector<float> certainties(detected_landmarks.size(), 0.0f);
+
+	std::vector<cv::Mat_<float> > warped_imgs;
+	std::vector<int> view_ids;
+	std::vector<size_t> warped_inds;
+
+	for (size_t i = 0; i < detected_landmarks.size(); ++i)
+	{
+		cv::Mat_<float> warped;
+		int id;
+
+		// Faces that are not in the image are failures
+		if (Warp(orientations[i], intensity_img, detected_landmarks[i], warped, id))
+		{
+			warped_imgs.push_back(warped);
+			view_ids.push_back(id);
+			warped_inds.push_back(i);
+		}
+	}
+
+	std::vector<float> warped_certainties = CheckWarped(warped_imgs, view_ids);
+
+	for (size_t i = 0; i < warped_inds.size(); ++i)
+	{
+		certainties[warped_inds[i]] = warped_certainties[i];
+	}
+
+	return certainties;
+}
+
+//===========================================================================
+// Warping the face to the reference shape of the validator view closest to the orientation
+bool DetectionValidator::Warp(const cv::Vec3d& orientation, const cv::Mat_<uchar>& intensity_img, const cv::Mat_<float>& detected_landmarks, cv::Mat_<float>& warped_img, int& view_id)
+{
+	view_id = GetViewId(orientation);
+
 	// First only use the ROI of the image of interest
 	cv::Mat_<float> detected_landmarks_local = detected_landmarks.clone();
 
@@ -344,64 +405,100 @@ float DetectionValidator::Check(const cv::Vec3d& orientation, const cv::Mat_<uch
 	// If the ROI is non existent return failure (this could happen if all landmarks are outside of the image)
 	if (max_x - min_x <= 1 || max_y - min_y <= 1)
 	{
-		return 0.0f;
+		return false;
 	}
 
 	cv::Mat_<float> intensity_img_float_local;
 	intensity_img(cv::Rect(min_x, min_y, max_x - min_x, max_y - min_y)).convertTo(intensity_img_float_local, CV_32F);
 
 	// the piece-wise affine image warping
-	paws[id].Warp(intensity_img_float_local, warped, detected_landmarks_local);
+	paws[view_id].Warp(intensity_img_float_local, warped_img, detected_landmarks_local);
 
-	// The actual validation step
-	double dec = CheckCNN(warped, id);
+	return true;
+}
 
-	// Convert it to a more interpretable signal (0 low confidence, 1 high confidence)
-	dec = 0.5 * (1.0 - dec);
+//===========================================================================
+// Running the CNN on the warped faces, faces of the same view are evaluated together
+std::vector<float> DetectionValidator::CheckWarped(const std::vector<cv::Mat_<float> >& warped_imgs, const std::vector<int>& view_ids, bool thread_safe)
+{
+	std::vector<float> certainties(warped_imgs.size(), 0.0f);
 
-	return (float)dec;
+	for (size_t view = 0; view < orientations.size(); ++view)
+	{
+		std::vector<cv::Mat_<float> > warped_view;
+		std::vector<size_t> view_inds;
+
+		for (size_t i = 0; i < warped_imgs.size(); ++i)
+		{
+			if (view_ids[i] == (int)view)
+			{
+				warped_view.push_back(warped_imgs[i]);
+				view_inds.push_back(i);
+			}
+		}
+
+		if (warped_view.empty())
+			continue;
+
+		std::vector<double> decs = CheckCNN(warped_view, (int)view, thread_safe);
+
+		for (size_t i = 0; i < view_inds.size(); ++i)
+		{
+			// Convert it to a more interpretable signal (0 low confidence, 1 high confidence)
+			certainties[view_inds[i]] = (float)(0.5 * (1.0 - decs[i]));
+		}
+	}
+
+	return certainties;
 }
 
-double DetectionValidator::CheckCNN(const cv::Mat_<float>& warped_img, int view_id)
+std::vector<double> DetectionValidator::CheckCNN(const std::vector<cv::Mat_<float> >& warped_imgs, int view_id, bool thread_safe)
 {
+	size_t batch_size = warped_imgs.size();
 
-	cv::Mat_<float> feature_vec;
-	NormaliseWarpedToVector(warped_img, feature_vec, view_id);
-
-	// Create a normalised image from the crop vector
-	cv::Mat_<float> img(warped_img.size(), 0.0);
-	img = img.t();
+	// The per face input maps of the current layer
+	std::vector<std::vector<cv::Mat_<float> > > input_maps(batch_size);
 
 	cv::Mat mask = paws[view_id].pixel_mask.t();
-	cv::MatIterator_<uchar>  mask_it = mask.begin<uchar>();
 
-	cv::MatIterator_<float> feature_it = feature_vec.begin();
-	cv::MatIterator_<float> img_it = img.begin();
+	for (size_t b = 0; b < batch_size; ++b)
+	{
+		cv::Mat_<float> feature_vec;
+		NormaliseWarpedToVector(warped_imgs[b], feature_vec, view_id);
 
-	int wInt = img.cols;
-	int hInt = img.rows;
+		// Create a normalised image from the crop vector
+		cv::Mat_<float> img(warped_imgs[b].size(), 0.0);
+		img = img.t();
 
-	for (int i = 0; i < wInt; ++i)
-	{
-		for (int j = 0; j < hInt; ++j, ++mask_it, ++img_it)
+		cv::MatIterator_<uchar>  mask_it = mask.begin<uchar>();
+
+		cv::MatIterator_<float> feature_it = feature_vec.begin();
+		cv::MatIterator_<float> img_it = img.begin();
+
+		int wInt = img.cols;
+		int hInt = img.rows;
+
+		for (int i = 0; i < wInt; ++i)
 		{
-			// if is within mask
-			if (*mask_it)
+			for (int j = 0; j < hInt; ++j, ++mask_it, ++img_it)
 			{
-				// assign the feature to image if it is within the mask
-				*img_it = (float)*feature_it++;
+				// if is within mask
+				if (*mask_it)
+				{
+					// assign the feature to image if it is within the mask
+					*img_it = (float)*feature_it++;
+				}
 			}
 		}
+		img = img.t();
+
+		input_maps[b].push_back(img);
 	}
-	img = img.t();
 
 	int cnn_layer = 0;
 	int fully_connected_layer = 0;
 
-	std::vector<cv::Mat_<float> > input_maps;
-	input_maps.push_back(img);
-
-	std::vector<cv::Mat_<float> > outputs;
+	std::vector<std::vector<cv::Mat_<float> > > outputs(batch_size);
 
 	for (size_t layer = 0; layer < cnn_layer_types[view_id].size(); ++layer)
 	{
@@ -411,63 +508,77 @@ double DetectionValidator::CheckCNN(const cv::Mat_<float>& warped_img, int view_
 		// Convolutional layer
 		if (layer_type == 0)
 		{
+			// The whole batch is convolved with a single matrix multiplication, the thread safe version can't share the pre-allocated im2col
+			cv::Mat_<float> im2col_local;
+			cv::Mat_<float>& im2col = thread_safe ? im2col_local : cnn_convolutional_layers_im2col_precomp[view_id][cnn_layer];
 
-			convolution_direct_blas(outputs, input_maps, cnn_convolutional_layers_weights[view_id][cnn_layer], cnn_convolutional_layers[view_id][cnn_layer][0][0].rows, cnn_convolutional_layers[view_id][cnn_layer][0][0].cols, cnn_convolutional_layers_im2col_precomp[view_id][cnn_layer]);
+			convolution_direct_blas_batch(outputs, input_maps, cnn_convolutional_layers_weights[view_id][cnn_layer], cnn_convolutional_layers[view_id][cnn_layer][0][0].rows, cnn_convolutional_layers[view_id][cnn_layer][0][0].cols, im2col);
 
 			cnn_layer++;
 		}
-		if (layer_type == 1)
+		for (size_t b = 0; b < batch_size; ++b)
 		{
-			max_pooling(outputs, input_maps, 2, 2, 2, 2);
-		}
-		if (layer_type == 2)
-		{
-
-			fully_connected(outputs, input_maps, cnn_fully_connected_layers_weights[view_id][fully_connected_layer].t(), cnn_fully_connected_layers_biases[view_id][fully_connected_layer]);
-			fully_connected_layer++;
-		}
-		if (layer_type == 3) // ReLU
-		{
-			outputs.clear();
-			for (size_t k = 0; k < input_maps.size(); ++k)
+			if (layer_type == 1)
 			{
-				// Apply the ReLU
-				cv::threshold(input_maps[k], input_maps[k], 0, 0, cv::THRESH_TOZERO);
-				outputs.push_back(input_maps[k]);
+				max_pooling(outputs[b], input_maps[b], 2, 2, 2, 2);
+			}
+			if (layer_type == 2)
+			{
+				fully_connected(outputs[b], input_maps[b], cnn_fully_connected_layers_weights[view_id][fully_connected_layer].t(), cnn_fully_connected_layers_biases[view_id][fully_connected_layer]);
+			}
+			if (layer_type == 3) // ReLU
+			{
+				outputs[b].clear();
+				for (size_t k = 0; k < input_maps[b].size(); ++k)
+				{
+					// Apply the ReLU
+					cv::threshold(input_maps[b][k], input_maps[b][k], 0, 0, cv::THRESH_TOZERO);
+					outputs[b].push_back(input_maps[b][k]);
 
+				}
 			}
-		}
-		if (layer_type == 4)
-		{
-			outputs.clear();
-			for (size_t k = 0; k < input_maps.size(); ++k)
+			if (layer_type == 4)
 			{
-				// Apply the sigmoid
-				cv::exp(-input_maps[k], input_maps[k]);
-				input_maps[k] = 1.0 / (1.0 + input_maps[k]);
+				outputs[b].clear();
+				for (size_t k = 0; k < input_maps[b].size(); ++k)
+				{
+					// Apply the sigmoid
+					cv::exp(-input_maps[b][k], input_maps[b][k]);
+					input_maps[b][k] = 1.0 / (1.0 + input_maps[b][k]);
 
-				outputs.push_back(input_maps[k]);
+					outputs[b].push_back(input_maps[b][k]);
 
+				}
 			}
 		}
+		if (layer_type == 2)
+		{
+			fully_connected_layer++;
+		}
+
 		// Set the outputs of this layer to inputs of the next
 		input_maps = outputs;
 
 	}
 
-	// Convert the class label to a continuous value
-	double max_val = 0;
-	cv::Point max_loc;
-	cv::minMaxLoc(outputs[0].t(), 0, &max_val, 0, &max_loc);
-	int max_idx = max_loc.y;
-	double max = 1;
-	double min = -1;
-	double bins = (double)outputs[0].cols;
-	// Unquantizing the softmax layer to continuous value
-	double step_size = (max - min) / bins; // This should be saved somewhere
-	double unquantized = min + step_size / 2.0 + max_idx * step_size;
-
-	return unquantized;
+	std::vector<double> decisions(batch_size);
+
+	for (size_t b = 0; b < batch_size; ++b)
+	{
+		// Convert the class label to a continuous value
+		double max_val = 0;
+		cv::Point max_loc;
+		cv::minMaxLoc(outputs[b][0].t(), 0, &max_val, 0, &max_loc);
+		int max_idx = max_loc.y;
+		double max = 1;
+		double min = -1;
+		double bins = (double)outputs[b][0].cols;
+		// Unquantizing the softmax layer to continuous value
+		double step_size = (max - min) / bins; // This should be saved somewhere
+		decisions[b] = min + step_size / 2.0 + max_idx * step_size;
+	}
+
+	return decisions;
 }
 
 void DetectionValidator::NormaliseWarpedToVector(const cv::Mat_<float>& warped_img, cv::Mat_<float>& feature_vec, int view_id)
@@ -46,6 +46,7 @@
 // System includes
 #include <vector>
 #include <numeric>
+#include <chrono>
 
 using namespace LandmarkDetector;
 
@@ -212,8 +213,119 @@ void CorrectGlobalParametersVideo(const cv::Mat_<uchar> &grayscale_image, CLNF&
 	
 }
 
-bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& clnf_model, FaceModelParameters& params, cv::Mat& grayscale_image)
+// Landmark validation when tracking in video that is not run on every frame (or is run in the background). The validator is run every n frames,
+// when the model likelihood drops, or when the previous frame was not successful, in between the last certainty is carried forward
+bool ScheduledValidation(const cv::Mat_<uchar> &grayscale_image, CLNF& clnf_model, const FaceModelParameters& params, bool fit_success, float carried_certainty, bool previous_success)
 {
+	// Pick up the result of a finished background validation
+	if (clnf_model.pending_validation.valid() && clnf_model.pending_validation.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		carried_certainty = clnf_model.pending_validation.get();
+	}
+
+	if (!fit_success)
+	{
+		clnf_model.detection_success = false;
+		clnf_model.detection_certainty = 0;
+		return false;
+	}
+
+	clnf_model.frames_since_validation++;
+
+	bool validation_due = !previous_success || clnf_model.frames_since_validation >= params.validate_every_n_frames
+		|| clnf_model.validation_likelihood - clnf_model.model_likelihood > params.validation_likelihood_drop;
+
+	if (validation_due)
+	{
+		cv::Vec3d orientation(clnf_model.params_global[1], clnf_model.params_global[2], clnf_model.params_global[3]);
+
+		if (!params.validate_async)
+		{
+			carried_certainty = clnf_model.landmark_validator.Check(orientation, grayscale_image, clnf_model.detected_landmarks);
+
+			clnf_model.frames_since_validation = 0;
+			clnf_model.validation_likelihood = clnf_model.model_likelihood;
+		}
+		else if (!clnf_model.pending_validation.valid())
+		{
+			// Only one validation in flight, if the previous one is still running this is tried again on the next frame
+			// The warp needs the current image, so it is done here and only the CNN is evaluated in the background
+			cv::Mat_<float> warped;
+			int view_id;
+			if (clnf_model.landmark_validator.Warp(orientation, grayscale_image, clnf_model.detected_landmarks, warped, view_id))
+			{
+				DetectionValidator* validator = &clnf_model.landmark_validator;
+				clnf_model.pending_validation = std::async(std::launch::async, [validator, warped, view_id]() {
+					return validator->CheckWarped(std::vector<cv::Mat_<float> >(1, warped), std::vector<int>(1, view_id), true)[0];
+				});
+			}
+			else
+			{
+				// The face is not within the image
+				carried_certainty = 0;
+			}
+
+			clnf_model.frames_since_validation = 0;
+			clnf_model.validation_likelihood = clnf_model.model_likelihood;
+		}
+	}
+
+	clnf_model.detection_certainty = carried_certainty;
+	clnf_model.detection_success = carried_certainty > params.validation_boundary;
+
+	return clnf_model.detection_success;
+}
+
+// Detecting a single face in the image (or a region of it) using the face detector chosen in the parameters
+bool DetectSingleFaceForTracking(cv::Rect_<float>& bounding_box, const cv::Mat &rgb_image, const cv::Mat_<uchar> &grayscale_image, CLNF& clnf_model, const FaceModelParameters& params, cv::Point preference_det)
+{
+	bool face_detection_success = false;
+	if(params.curr_face_detector == FaceModelParameters::HOG_SVM_DETECTOR)
+	{
+		float confidence;
+		face_detection_success = LandmarkDetector::DetectSingleFaceHOG(bounding_box, grayscale_image, clnf_model.face_detector_HOG, confidence, preference_det);
+	}
+	else if(params.curr_face_detector == FaceModelParameters::HAAR_DETECTOR)
+	{
+		face_detection_success = LandmarkDetector::DetectSingleFace(bounding_box, grayscale_image, clnf_model.face_detector_HAAR, preference_det);
+	}
+	else if (params.curr_face_detector == FaceModelParameters::MTCNN_DETECTOR)
+	{
+		float confidence;
+		face_detection_success = LandmarkDetector::DetectSingleFaceMTCNN(bounding_box, rgb_image, clnf_model.face_detector_MTCNN, confidence, preference_det);
+	}
+	return face_detection_success;
+}
+
+// The region around the last tracked face in which to look for it first when reinitialising, empty if it would not be much smaller than the image
+cv::Rect ReinitialisationRegion(const CLNF& clnf_model, const FaceModelParameters& params, const cv::Size& image_size)
+{
+	if (params.reinit_roi_scale <= 0 || !clnf_model.tracking_initialised)
+		return cv::Rect();
+
+	cv::Rect_<float> last_box = clnf_model.GetBoundingBox();
+	if (last_box.width <= 0 || last_box.height <= 0)
+		return cv::Rect();
+
+	float size = std::max(last_box.width, last_box.height) * params.reinit_roi_scale;
+	float center_x = last_box.x + last_box.width / 2.0f;
+	float center_y = last_box.y + last_box.height / 2.0f;
+
+	cv::Rect roi((int)(center_x - size / 2.0f), (int)(center_y - size / 2.0f), (int)size, (int)size);
+	roi &= cv::Rect(0, 0, image_size.width, image_size.height);
+
+	// Not worth it if most of the image would be searched anyway
+	if (roi.area() == 0 || roi.area() > image_size.area() / 2)
+		return cv::Rect();
+
+	return roi;
+}
+
+// The tracking itself, with an option to leave the validation of the tracked fit to the caller (only when it would be run on every frame)
+bool TrackLandmarksInVideo(const cv::Mat &rgb_image, CLNF& clnf_model, FaceModelParameters& params, cv::Mat& grayscale_image, bool defer_validation, bool& validation_deferred)
+{
+	validation_deferred = false;
+
 	// First need to decide if the landmarks should be "detected" or "tracked"
 	// Detected means running face detection and a larger search area, tracked means initialising from previous step
 	// and using a smaller search area
@@ -246,7 +358,33 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& cl
 			CorrectGlobalParametersVideo(grayscale_image, clnf_model, params);
 		}
 
-		bool track_success = clnf_model.DetectLandmarks(grayscale_image, params);
+		bool track_success;
+
+		// If the validation is not run on every frame (or is run in the background) it is scheduled after the fitting
+		if (params.validate_detections && (params.validate_every_n_frames > 1 || params.validate_async))
+		{
+			float carried_certainty = clnf_model.detection_certainty;
+			bool previous_success = clnf_model.detection_success;
+
+			bool fit_success = clnf_model.DetectLandmarks(grayscale_image, params, true);
+
+			track_success = ScheduledValidation(grayscale_image, clnf_model, params, fit_success, carried_certainty, previous_success);
+		}
+		else if (params.validate_detections && defer_validation)
+		{
+			track_success = clnf_model.DetectLandmarks(grayscale_image, params, true);
+
+			// A successful fit is only accepted (and the tracking state updated) once the caller has validated it, a failed one is handled as usual
+			if (track_success)
+			{
+				validation_deferred = true;
+				return true;
+			}
+		}
+		else
+		{
+			track_success = clnf_model.DetectLandmarks(grayscale_image, params);
+		}
 		
 		if(!track_success)
 		{
@@ -301,20 +439,29 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& cl
 			clnf_model.preference_det = cv::Point(-1, -1);
 		}
 
-		bool face_detection_success;
-		if(params.curr_face_detector == FaceModelParameters::HOG_SVM_DETECTOR)
-		{
-			float confidence;
-			face_detection_success = LandmarkDetector::DetectSingleFaceHOG(bounding_box, grayscale_image, clnf_model.face_detector_HOG, confidence, preference_det);
-		}
-		else if(params.curr_face_detector == FaceModelParameters::HAAR_DETECTOR)
+		bool face_detection_success = false;
+
+		// The face is most likely still close to where it was lost, so look there first (this is much cheaper than searching a large image)
+		cv::Rect reinit_roi = ReinitialisationRegion(clnf_model, params, grayscale_image.size());
+		if (reinit_roi.area() > 0)
 		{
-			face_detection_success = LandmarkDetector::DetectSingleFace(bounding_box, grayscale_image, clnf_model.face_detector_HAAR, preference_det);
+			cv::Point preference_roi(-1, -1);
+			if (preference_det.x != -1 && preference_det.y != -1)
+			{
+				preference_roi = preference_det - reinit_roi.tl();
+			}
+
+			face_detection_success = DetectSingleFaceForTracking(bounding_box, rgb_image(reinit_roi), grayscale_image(reinit_roi), clnf_model, params, preference_roi);
+			if (face_detection_success)
+			{
+				bounding_box.x += reinit_roi.x;
+				bounding_box.y += reinit_roi.y;
+			}
 		}
-		else if (params.curr_face_detector == FaceModelParameters::MTCNN_DETECTOR)
+
+		if (!face_detection_success)
 		{
-			float confidence;
-			face_detection_success = LandmarkDetector::DetectSingleFaceMTCNN(bounding_box, rgb_image, clnf_model.face_detector_MTCNN, confidence, preference_det);
+			face_detection_success = DetectSingleFaceForTracking(bounding_box, rgb_image, grayscale_image, clnf_model, params, preference_det);
 		}
 
 		// Attempt to detect landmarks using the detected face (if unseccessful the detection will be ignored)
@@ -322,6 +469,9 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& cl
 		{
 			// Indicate that tracking has started as a face was detected
 			clnf_model.tracking_initialised = true;
+
+			// A validation still running in the background would refer to the old track
+			clnf_model.DiscardPendingValidation();
 						
 			// Keep track of old model values so that they can be restored if redetection fails
 			cv::Vec6f params_global_init = clnf_model.params_global;
@@ -366,6 +516,10 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& cl
 			else
 			{
 				clnf_model.failures_in_a_row = -1;			
+
+				// The reinitialisation was validated
+				clnf_model.frames_since_validation = 0;
+				clnf_model.validation_likelihood = clnf_model.model_likelihood;
 				
 				if(params.use_face_template)
 				{
@@ -393,6 +547,45 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& cl
 	
 }
 
+bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& clnf_model, FaceModelParameters& params, cv::Mat& grayscale_image)
+{
+	bool validation_deferred;
+	return TrackLandmarksInVideo(rgb_image, clnf_model, params, grayscale_image, false, validation_deferred);
+}
+
+bool LandmarkDetector::DetectLandmarksInVideoDeferValidation(const cv::Mat &rgb_image, CLNF& clnf_model, FaceModelParameters& params, cv::Mat& grayscale_image)
+{
+	bool validation_deferred;
+	TrackLandmarksInVideo(rgb_image, clnf_model, params, grayscale_image, true, validation_deferred);
+	return validation_deferred;
+}
+
+void LandmarkDetector::CompleteDeferredValidation(const cv::Mat_<uchar> &grayscale_image, CLNF& clnf_model, const FaceModelParameters& params)
+{
+	// The same bookkeeping as after a validated fit in DetectLandmarksInVideo
+	if (!clnf_model.detection_success)
+	{
+		// Make a record that tracking failed
+		clnf_model.failures_in_a_row++;
+
+		// un-initialise the tracking
+		if (clnf_model.failures_in_a_row > 100)
+		{
+			clnf_model.tracking_initialised = false;
+		}
+	}
+	else
+	{
+		// indicate that tracking is a success
+		clnf_model.failures_in_a_row = -1;
+
+		if (params.use_face_template)
+		{
+			UpdateTemplate(grayscale_image, clnf_model);
+		}
+	}
+}
+
 bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params, cv::Mat &grayscale_image)
 {
 	if(bounding_box.width > 0)
@@ -409,6 +602,35 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, const cv
 
 }
 
+void LandmarkDetector::ValidateLandmarks(std::vector<CLNF>& clnf_models, const std::vector<bool>& models_to_validate, const cv::Mat_<uchar> &grayscale_image, const FaceModelParameters& params)
+{
+	std::vector<size_t> model_ids;
+	std::vector<cv::Vec3d> orientations;
+	std::vector<cv::Mat_<float> > landmarks;
+
+	for (size_t i = 0; i < clnf_models.size(); ++i)
+	{
+		if (models_to_validate[i])
+		{
+			model_ids.push_back(i);
+			orientations.push_back(cv::Vec3d(clnf_models[i].params_global[1], clnf_models[i].params_global[2], clnf_models[i].params_global[3]));
+			landmarks.push_back(clnf_models[i].detected_landmarks);
+		}
+	}
+
+	if (model_ids.empty())
+		return;
+
+	std::vector<float> certainties = clnf_models[0].landmark_validator.Check(orientations, grayscale_image, landmarks);
+
+	for (size_t i = 0; i < model_ids.size(); ++i)
+	{
+		CLNF& clnf_model = clnf_models[model_ids[i]];
+		clnf_model.detection_certainty = certainties[i];
+		clnf_model.detection_success = certainties[i] > params.validation_boundary;
+	}
+}
+
 //================================================================================================================
 // Landmark detection in image, need to provide an image and optionally CLNF model together with parameters (default values work well)
 // Optionally can provide a bounding box in which detection is performed (this is useful if multiple faces are to be detected in images)
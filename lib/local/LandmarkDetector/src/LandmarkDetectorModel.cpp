@@ -39,6 +39,7 @@
 // Local includes
 #include <LandmarkDetectorUtils.h>
 #include <RotationHelpers.h>
+#include <TaskScheduler.h>
 
 using namespace LandmarkDetector;
 
@@ -77,6 +78,8 @@ CLNF::CLNF(const CLNF& other): pdm(other.pdm), params_local(other.params_local.c
 	this->detection_certainty = other.detection_certainty;
 	this->model_likelihood = other.model_likelihood;
 	this->failures_in_a_row = other.failures_in_a_row;
+	this->frames_since_validation = other.frames_since_validation;
+	this->validation_likelihood = other.validation_likelihood;
 
 	// Load the CascadeClassifier (as it does not have a proper copy constructor)
 	if(!haar_face_detector_location.empty())
@@ -105,6 +108,9 @@ CLNF & CLNF::operator= (const CLNF& other)
 {
 	if (this != &other) // protect against invalid self-assignment
 	{
+		// The background validation uses the validator that is about to be replaced
+		DiscardPendingValidation();
+
 		pdm = PDM(other.pdm);
 		params_local = other.params_local.clone();
 		params_global = other.params_global;
@@ -121,6 +127,8 @@ CLNF & CLNF::operator= (const CLNF& other)
 		this->detection_certainty = other.detection_certainty;
 		this->model_likelihood = other.model_likelihood;
 		this->failures_in_a_row = other.failures_in_a_row;
+		this->frames_since_validation = other.frames_since_validation;
+		this->validation_likelihood = other.validation_likelihood;
 
 		this->eye_model = other.eye_model;
 		
@@ -169,6 +177,8 @@ CLNF::CLNF(const CLNF&& other)
 	this->detection_certainty = other.detection_certainty;
 	this->model_likelihood = other.model_likelihood;
 	this->failures_in_a_row = other.failures_in_a_row;
+	this->frames_since_validation = other.frames_since_validation;
+	this->validation_likelihood = other.validation_likelihood;
 
 	pdm = other.pdm;
 	params_local = other.params_local;
@@ -204,11 +214,16 @@ CLNF::CLNF(const CLNF&& other)
 // Assignment operator for rvalues
 CLNF & CLNF::operator= (const CLNF&& other)
 {
+	// The background validation uses the validator that is about to be replaced
+	DiscardPendingValidation();
+
 	this->detection_success = other.detection_success;
 	this->tracking_initialised = other.tracking_initialised;
 	this->detection_certainty = other.detection_certainty;
 	this->model_likelihood = other.model_likelihood;
 	this->failures_in_a_row = other.failures_in_a_row;
+	this->frames_since_validation = other.frames_since_validation;
+	this->validation_likelihood = other.validation_likelihood;
 
 	pdm = other.pdm;
 	params_local = other.params_local;
@@ -580,6 +595,9 @@ void CLNF::Read(std::string main_location)
 
 	failures_in_a_row = -1;
 
+	frames_since_validation = 0;
+	validation_likelihood = model_likelihood;
+
 	preference_det.x = -1;
 	preference_det.y = -1;
 
@@ -590,6 +608,8 @@ void CLNF::Read(std::string main_location)
 // Resetting the model (for a new video, or complet reinitialisation
 void CLNF::Reset()
 {
+	DiscardPendingValidation();
+
 	detected_landmarks.setTo(0);
 
 	detection_success = false;
@@ -605,6 +625,19 @@ void CLNF::Reset()
 
 	failures_in_a_row = -1;
 	face_template = cv::Mat_<uchar>();
+
+	frames_since_validation = 0;
+	validation_likelihood = model_likelihood;
+}
+
+// Waiting for the background validation (if any), as it uses the landmark validator of this model
+void CLNF::DiscardPendingValidation()
+{
+	if (pending_validation.valid())
+	{
+		pending_validation.wait();
+		pending_validation = std::future<float>();
+	}
 }
 
 // Resetting the model, choosing the face nearest (x,y)
@@ -621,7 +654,7 @@ void CLNF::Reset(double x, double y)
 }
 
 // The main internal landmark detection call (should not be used externally?)
-bool CLNF::DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& params)
+bool CLNF::DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& params, bool skip_validation)
 {
 
 	// TODO this could be moved out
@@ -638,8 +671,11 @@ bool CLNF::DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& pa
 	{
 		bool parts_used = false;		
 
-		// Do the hierarchical models in parallel
-		parallel_for_(cv::Range(0, hierarchical_models.size()), [&](const cv::Range& range) {
+		// If the face was tracked in the previous frame the part models start their fit from where they were
+		bool warm_start_parts = tracking_initialised && detection_success;
+
+		// Do the hierarchical models in parallel (the landmarks of each are in turn done in parallel on the same scheduler)
+		TaskScheduler::Instance().ParallelFor(cv::Range(0, hierarchical_models.size()), [&](const cv::Range& range) {
 			for (int part_model = range.start; part_model < range.end; part_model++)
 			{
 				
@@ -657,7 +693,14 @@ bool CLNF::DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& pa
 				}
 
 				// Fit the part based model PDM
-				hierarchical_models[part_model].pdm.CalcParams(hierarchical_models[part_model].params_global, hierarchical_models[part_model].params_local, part_model_locs);
+				if (warm_start_parts)
+				{
+					hierarchical_models[part_model].pdm.RefineParams(hierarchical_models[part_model].params_global, hierarchical_models[part_model].params_local, part_model_locs);
+				}
+				else
+				{
+					hierarchical_models[part_model].pdm.CalcParams(hierarchical_models[part_model].params_global, hierarchical_models[part_model].params_local, part_model_locs);
+				}
 
 				// Only do this if we don't need to upsample
 				if (params_global[0] > 0.9 * hierarchical_models[part_model].patch_experts.patch_scaling[0])
@@ -694,14 +737,15 @@ bool CLNF::DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& pa
 				}
 			}
 
-			pdm.CalcParams(params_global, params_local, detected_landmarks);		
+			// The parameters the model converged to are a good starting point, as only the part landmarks moved
+			pdm.RefineParams(params_global, params_local, detected_landmarks);
 			pdm.CalcShape2D(detected_landmarks, params_local, params_global);
 		}
 
 	}
 
 	// Check detection correctness
-	if(params.validate_detections && fit_success)
+	if(params.validate_detections && !skip_validation && fit_success)
 	{
 
 		cv::Vec3d orientation(params_global[1], params_global[2], params_global[3]);
@@ -934,54 +978,52 @@ void CLNF::NonVectorisedMeanShift_precalc_kde(cv::Mat_<float>& out_mean_shifts,
 
 }
 
-void CLNF::GetWeightMatrix(cv::Mat_<float>& WeightMatrix, int scale, int view_id, const FaceModelParameters& parameters)
+void CLNF::GetWeights(cv::Mat_<float>& weights, int scale, int view_id, const FaceModelParameters& parameters)
 {
 	int n = pdm.NumberOfPoints();  
 
-	// Is the weight matrix needed at all
+	// Only the diagonal of the weight matrix is ever non-zero, so it is kept as a 2n x 1 vector
+	// Is the weighting needed at all
 	if(parameters.weight_factor > 0)
 	{
-		WeightMatrix = cv::Mat_<float>::zeros(n*2, n*2);
+		weights = cv::Mat_<float>::zeros(n*2, 1);
 
 		for (int p=0; p < n; p++)
 		{
 			if (!patch_experts.cen_expert_intensity.empty())
 			{
-
-				// for the x dimension
-				WeightMatrix.at<float>(p, p) = WeightMatrix.at<float>(p, p) + patch_experts.cen_expert_intensity[scale][view_id][p].confidence;
-
-				// for they y dimension
-				WeightMatrix.at<float>(p + n, p + n) = WeightMatrix.at<float>(p, p);
-
+				weights.at<float>(p) = patch_experts.cen_expert_intensity[scale][view_id][p].confidence;
 			}
 			else if(!patch_experts.ccnf_expert_intensity.empty())
 			{
-
-				// for the x dimension
-				WeightMatrix.at<float>(p,p) = WeightMatrix.at<float>(p,p)  + patch_experts.ccnf_expert_intensity[scale][view_id][p].patch_confidence;
-				
-				// for they y dimension
-				WeightMatrix.at<float>(p+n,p+n) = WeightMatrix.at<float>(p,p);
-
+				weights.at<float>(p) = patch_experts.ccnf_expert_intensity[scale][view_id][p].patch_confidence;
 			}
 			else
 			{
 				// Across the modalities add the confidences
 				for(size_t pc=0; pc < patch_experts.svr_expert_intensity[scale][view_id][p].svr_patch_experts.size(); pc++)
 				{
-					// for the x dimension
-					WeightMatrix.at<float>(p,p) = WeightMatrix.at<float>(p,p)  + patch_experts.svr_expert_intensity[scale][view_id][p].svr_patch_experts.at(pc).confidence;
-				}	
-				// for the y dimension
-				WeightMatrix.at<float>(p+n,p+n) = WeightMatrix.at<float>(p,p);
+					weights.at<float>(p) = weights.at<float>(p) + patch_experts.svr_expert_intensity[scale][view_id][p].svr_patch_experts.at(pc).confidence;
+				}
 			}
+			// for the y dimension
+			weights.at<float>(p + n) = weights.at<float>(p);
 		}
-		WeightMatrix = parameters.weight_factor * WeightMatrix;
+		weights = parameters.weight_factor * weights;
 	}
 	else
 	{
-		WeightMatrix = cv::Mat_<float>::eye(n*2, n*2);
+		weights = cv::Mat_<float>::ones(n*2, 1);
+	}
+
+	// Landmarks without a patch expert in this view do not contribute to the fit
+	for (int p = 0; p < n; p++)
+	{
+		if (patch_experts.visibilities[scale][view_id].at<int>(p, 0) == 0)
+		{
+			weights.at<float>(p) = 0.0f;
+			weights.at<float>(p + n) = 0.0f;
+		}
 	}
 
 }
@@ -1008,24 +1050,29 @@ float CLNF::NU_RLMS(cv::Vec6f& final_global, cv::Mat_<float>& final_local, const
 	cv::Mat_<float> current_shape;
 	cv::Mat_<float> previous_shape;
 
-	// Pre-calculate the regularisation term
-	cv::Mat_<float> regTerm;
+	// Number of parameters being optimised
+	int num_params = rigid ? 6 : 6 + m;
+
+	// Pre-calculate the regularisation term (it is diagonal, so only the diagonal is stored)
+	cv::Mat_<float> regularisations = cv::Mat_<float>::zeros(num_params, 1);
 
-	if(rigid)
+	if(!rigid)
 	{
-		regTerm = cv::Mat_<float>::zeros(6,6);
+		// Setting the regularisation to the inverse of eigenvalues
+		cv::Mat(parameters.reg_factor / E).reshape(1, m).copyTo(regularisations(cv::Rect(0, 6, 1, m)));
 	}
-	else
-	{
-		cv::Mat_<float> regularisations = cv::Mat_<float>::zeros(1, 6 + m);
 
-		// Setting the regularisation to the inverse of eigenvalues
-		cv::Mat(parameters.reg_factor / E).copyTo(regularisations(cv::Rect(6, 0, m, 1)));
-		regTerm = cv::Mat::diag(regularisations.t());
-	}	
+	// The landmark weights (diagonal of the weight matrix), these are folded into the Jacobian through their square root
+	cv::Mat_<float> weights;
+	GetWeights(weights, scale, view_id, parameters);
+
+	cv::Mat_<float> weights_sqrt;
+	cv::sqrt(cv::max(weights, 0.0f), weights_sqrt);
 
-	cv::Mat_<float> WeightMatrix;
-	GetWeightMatrix(WeightMatrix, scale, view_id, parameters);
+	// Preallocated buffers reused across iterations
+	cv::Mat_<float> J_w;
+	cv::Mat_<float> J_w_t_m(num_params, 1);
+	cv::Mat_<float> Hessian(num_params, num_params);
 
 	cv::Mat_<float> dxs, dys;
 	
@@ -1049,18 +1096,8 @@ float CLNF::NU_RLMS(cv::Vec6f& final_global, cv::Mat_<float>& final_local, const
 
 		current_shape.copyTo(previous_shape);
 		
-		// Jacobian, and transposed weighted jacobian
-		cv::Mat_<float> J, J_w_t;
-
-		// calculate the appropriate Jacobians in 2D, even though the actual behaviour is in 3D, using small angle approximation and oriented shape
-		if(rigid)
-		{
-			pdm.ComputeRigidJacobian(current_local, current_global, J, WeightMatrix, J_w_t);
-		}
-		else
-		{
-			pdm.ComputeJacobian(current_local, current_global, J, WeightMatrix, J_w_t);
-		}
+		// calculate the appropriate weighted Jacobian in 2D, even though the actual behaviour is in 3D, using small angle approximation and oriented shape
+		pdm.ComputeWeightedJacobian(current_local, current_global, weights_sqrt, rigid, J_w);
 		
 		// useful for mean shift calculation
 		float a = -0.5/(parameters.sigma * parameters.sigma);
@@ -1082,50 +1119,59 @@ float CLNF::NU_RLMS(cv::Vec6f& final_global, cv::Mat_<float>& final_local, const
 		mean_shifts_2D = mean_shifts_2D * cv::Mat(sim_ref_to_img).t();
 		mean_shifts = cv::Mat(mean_shifts_2D.t()).reshape(1, n*2);
 
-		// remove non-visible observations
-		for(int i = 0; i < n; ++i)
+		// projection of the meanshifts onto the jacobians (using the weighted Jacobian, see Baltrusaitis 2013)
+		// computed as J' * W * mean_shifts, row by row, as a sequence of contiguous multiply-adds (non-visible landmarks have zero weight)
+		J_w_t_m.setTo(0.0f);
+		float* J_w_t_m_ptr = J_w_t_m.ptr<float>();
+		for (int i = 0; i < 2 * n; ++i)
 		{
-			// if patch unavailable for current index
-			if(patch_experts.visibilities[scale][view_id].at<int>(i,0) == 0)
-			{				
-				cv::Mat Jx = J.row(i);
-				Jx = cvScalar(0);
-				cv::Mat Jy = J.row(i+n);
-				Jy = cvScalar(0);
-
-				Jx = J_w_t.col(i);
-				Jx = cvScalar(0);
-				Jy = J_w_t.col(i + n);
-				Jy = cvScalar(0);
-
-				mean_shifts.at<float>(i,0) = 0.0f;
-				mean_shifts.at<float>(i+n,0) = 0.0f;
+			float ms_w = weights_sqrt.at<float>(i) * mean_shifts.at<float>(i);
+			if (ms_w == 0.0f)
+				continue;
+
+			const float* J_row = J_w.ptr<float>(i);
+			for (int k = 0; k < num_params; ++k)
+			{
+				J_w_t_m_ptr[k] += ms_w * J_row[k];
 			}
 		}
 
-		// projection of the meanshifts onto the jacobians (using the weighted Jacobian, see Baltrusaitis 2013)
-		cv::Mat_<float> J_w_t_m = J_w_t * mean_shifts;
-
 		// Add the regularisation term
 		if(!rigid)
 		{
-			J_w_t_m(cv::Rect(0,6,1, m)) = J_w_t_m(cv::Rect(0,6,1, m)) - regTerm(cv::Rect(6,6, m, m)) * current_local;
+			for (int k = 6; k < num_params; ++k)
+			{
+				J_w_t_m_ptr[k] -= regularisations.at<float>(k) * current_local.at<float>(k - 6);
+			}
 		}
 
-		cv::Mat_<float> Hessian = regTerm.clone();
+		// Start from the regularisation term
+		Hessian.setTo(0.0f);
+		for (int k = 0; k < num_params; ++k)
+		{
+			Hessian.at<float>(k, k) = regularisations.at<float>(k);
+		}
 
-		// Perform matrix multiplication in OpenBLAS (fortran call)
+		// Perform a symmetric rank-k update in OpenBLAS (fortran call), as J_w is row-major it is the transpose in fortran terms,
+		// so 'N' gives J_w' * J_w, and the 'U' triangle in column-major is the lower triangle in row-major that the Cholesky reads
 		float alpha1 = 1.0;
 		float beta1 = 1.0;
+		int num_rows = J_w.rows;
+		char U[2]; U[0] = 'U';
 		char N[2]; N[0] = 'N';
-		sgemm_(N, N, &J.cols, &J_w_t.rows, &J_w_t.cols, &alpha1, (float*)J.data, &J.cols, (float*)J_w_t.data, &J_w_t.cols, &beta1, (float*)Hessian.data, &J.cols);
+		ssyrk_(U, N, &num_params, &num_rows, &alpha1, (float*)J_w.data, &num_params, &beta1, (float*)Hessian.data, &num_params);
 
 		// Above is a fast (but ugly) version of 
-		// cv::Mat_<float> Hessian = J_w_t * J + regTerm;
+		// cv::Mat_<float> Hessian = J_w.t() * J_w + cv::Mat::diag(regularisations);
 
-		// Solve for the parameter update (from Baltrusaitis 2013 based on eq (36) Saragih 2011)
-		cv::Mat_<float> param_update;
-		cv::solve(Hessian, J_w_t_m, param_update, cv::DECOMP_CHOLESKY);
+		// Solve for the parameter update (from Baltrusaitis 2013 based on eq (36) Saragih 2011), as the Hessian is symmetric positive
+		// definite this is done in place with a Cholesky decomposition (the solution overwrites the right hand side)
+		cv::Mat_<float> param_update = J_w_t_m.clone();
+		if (!cv::Cholesky(Hessian.ptr<float>(), Hessian.step, num_params, param_update.ptr<float>(), param_update.step, 1))
+		{
+			// Same as cv::solve with DECOMP_CHOLESKY on a failed decomposition
+			param_update.setTo(0.0f);
+		}
 		
 		// update the reference
 		pdm.UpdateModelParameters(param_update, current_local, current_global);		
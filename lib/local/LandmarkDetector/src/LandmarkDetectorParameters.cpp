@@ -35,6 +35,7 @@
 #include "stdafx.h"
 
 #include "LandmarkDetectorParameters.h"
+#include "CNN_utils.h"
 
 // System includes
 #include <sstream>
@@ -135,6 +136,62 @@ FaceModelParameters::FaceModelParameters(std::vector<std::string> &arguments)
 			valid[i + 1] = false;
 			i++;
 		}
+		else if (arguments[i].compare("-validate_every") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> validate_every_n_frames;
+
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-validate_async") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			int v_async;
+			data >> v_async;
+
+			validate_async = (bool)(v_async != 0);
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-autotune") == 0)
+		{
+			convolution_tuning_location = arguments[i + 1];
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-reinit_roi") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> reinit_roi_scale;
+
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-detect_every") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> detect_every_n_frames;
+
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-detect_async") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			int d_async;
+			data >> d_async;
+
+			detect_async = (bool)(d_async != 0);
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
 		else if (arguments[i].compare("-n_iter") == 0)
 		{
 			std::stringstream data(arguments[i + 1]);
@@ -173,6 +230,11 @@ FaceModelParameters::FaceModelParameters(std::vector<std::string> &arguments)
 		}
 	}
 
+	if (!convolution_tuning_location.empty())
+	{
+		ConvolutionTuner::Instance().Enable(convolution_tuning_location);
+	}
+
 
 	// Make sure model_location is valid
 	// First check working directory, then the executable's directory, then the config path set by the build process.
@@ -324,10 +386,16 @@ void FaceModelParameters::init()
 
 	validation_boundary = 0.725f;
 
+	// By default validate every tracked frame on the tracking thread
+	validate_every_n_frames = 1;
+	validation_likelihood_drop = 0.5f;
+	validate_async = false;
+
 	limit_pose = true;
 	multi_view = false;
 
 	reinit_video_every = 2;
+	reinit_roi_scale = 3.0f;
 
 	// Face detection
 	haar_face_detector_location = "classifiers/haarcascade_frontalface_alt.xml";
@@ -336,5 +404,9 @@ void FaceModelParameters::init()
 	// By default use MTCNN
 	curr_face_detector = MTCNN_DETECTOR;
 
+	// When tracking multiple faces look for new ones every 8 frames on the tracking thread
+	detect_every_n_frames = 8;
+	detect_async = false;
+
 }
 
@@ -449,6 +449,94 @@ void PDM::ComputeJacobian(const cv::Mat_<float>& params_local, const cv::Vec6f&
 	}
 }
 
+//===========================================================================
+// Calculate the PDM's Jacobian (over rigid or all parameters) with the square root of the landmark weights folded into every row.
+// The layout is the same as ComputeJacobian (x rows followed by y rows, parameters along columns) so that each row is written
+// contiguously and the non-rigid part is a simple vectorisable loop over the rows of the principal components
+void PDM::ComputeWeightedJacobian(const cv::Mat_<float>& params_local, const cv::Vec6f& params_global, const cv::Mat_<float>& weights_sqrt, bool rigid, cv::Mat_<float> &Jacob_w) const
+{
+	// number of vertices
+	int n = this->NumberOfPoints();
+
+	// number of non-rigid parameters
+	int m = rigid ? 0 : this->NumberOfModes();
+
+	int num_cols = 6 + m;
+
+	Jacob_w.create(n * 2, num_cols);
+
+	float s = params_global[0];
+
+	cv::Mat_<float> shape_3D;
+	this->CalcShape3D(shape_3D, params_local);
+
+	cv::Vec3f euler(params_global[1], params_global[2], params_global[3]);
+	cv::Matx33f currRot = Utilities::Euler2RotationMatrix(euler);
+
+	const float r11 = currRot(0, 0);
+	const float r12 = currRot(0, 1);
+	const float r13 = currRot(0, 2);
+	const float r21 = currRot(1, 0);
+	const float r22 = currRot(1, 1);
+	const float r23 = currRot(1, 2);
+
+	const float* shape_ptr = shape_3D.ptr<float>();
+	const float* w_ptr = weights_sqrt.ptr<float>();
+
+	for (int i = 0; i < n; i++)
+	{
+		const float X = shape_ptr[i];
+		const float Y = shape_ptr[i + n];
+		const float Z = shape_ptr[i + n * 2];
+
+		const float w_x = w_ptr[i];
+		const float w_y = w_ptr[i + n];
+
+		float* Jx = Jacob_w.ptr<float>(i);
+		float* Jy = Jacob_w.ptr<float>(i + n);
+
+		// Same small angle approximation of the rotation as in ComputeJacobian
+
+		// scaling term
+		Jx[0] = w_x * (X * r11 + Y * r12 + Z * r13);
+		Jy[0] = w_y * (X * r21 + Y * r22 + Z * r23);
+
+		// rotation terms
+		Jx[1] = w_x * (s * (Y * r13 - Z * r12));
+		Jy[1] = w_y * (s * (Y * r23 - Z * r22));
+		Jx[2] = w_x * (-s * (X * r13 - Z * r11));
+		Jy[2] = w_y * (-s * (X * r23 - Z * r21));
+		Jx[3] = w_x * (s * (X * r12 - Y * r11));
+		Jy[3] = w_y * (s * (X * r22 - Y * r21));
+
+		// translation terms
+		Jx[4] = w_x;
+		Jy[4] = 0.0f;
+		Jx[5] = 0.0f;
+		Jy[5] = w_y;
+
+		if (m > 0)
+		{
+			const float* Vx = this->princ_comp.ptr<float>(i);
+			const float* Vy = this->princ_comp.ptr<float>(i + n);
+			const float* Vz = this->princ_comp.ptr<float>(i + n * 2);
+
+			// Fold the scale and the weights into the rotation so the inner loop is a plain multiply-add over the modes
+			const float a11 = s * w_x * r11, a12 = s * w_x * r12, a13 = s * w_x * r13;
+			const float a21 = s * w_y * r21, a22 = s * w_y * r22, a23 = s * w_y * r23;
+
+			float* Jx_nr = Jx + 6;
+			float* Jy_nr = Jy + 6;
+
+			for (int j = 0; j < m; ++j)
+			{
+				Jx_nr[j] = a11 * Vx[j] + a12 * Vy[j] + a13 * Vz[j];
+				Jy_nr[j] = a21 * Vx[j] + a22 * Vy[j] + a23 * Vz[j];
+			}
+		}
+	}
+}
+
 //===========================================================================
 // Updating the parameters (more details in my thesis)
 void PDM::UpdateModelParameters(const cv::Mat_<float>& delta_p, cv::Mat_<float>& params_local, cv::Vec6f& params_global)
@@ -511,178 +599,146 @@ void PDM::CalcParams(cv::Vec6f& out_params_global, cv::Mat_<float>& out_params_l
 	int m = this->NumberOfModes();
 	int n = this->NumberOfPoints();
 
-	cv::Mat_<int> visi_ind_2D(n * 2, 1, 1);
-	cv::Mat_<int> visi_ind_3D(3 * n , 1, 1);
-
-	int visi_count = n;
-
-	for(int i = 0; i < n; ++i)
-	{
-		// If the landmark is invisible indicate this
-		if(landmark_locations.at<float>(i) == 0)
-		{
-			visi_ind_2D.at<int>(i) = 0;
-			visi_ind_2D.at<int>(i+n) = 0;
-			visi_ind_3D.at<int>(i) = 0;
-			visi_ind_3D.at<int>(i+n) = 0;
-			visi_ind_3D.at<int>(i+2*n) = 0;
+	// The model shape with no rotation or scaling, used to work out the initial scale
+	cv::Mat_<float> model_shape;
+	CalcShape2D(model_shape, cv::Mat_<float>(m, 1, 0.0f), cv::Vec6f(1.0, 0.0, 0.0, 0.0, 0.0, 0.0));
 
-			visi_count--;
-		}
-	}
+	// Compute the initial global parameters from the extent of the visible landmarks (and of the corresponding model points)
+	float min_x = FLT_MAX, max_x = -FLT_MAX, min_y = FLT_MAX, max_y = -FLT_MAX;
+	float model_min_x = FLT_MAX, model_max_x = -FLT_MAX, model_min_y = FLT_MAX, model_max_y = -FLT_MAX;
 
-	// As not all landmarks might be visible, subsample the Mean and principal component matrices
-	cv::Mat_<float> M(visi_count * 3, mean_shape.cols, 0.0);
-	cv::Mat_<float> V(visi_count * 3, princ_comp.cols, 0.0);
-	visi_count = 0;
-	for (int i = 0; i < n * 3; ++i)
+	for (int i = 0; i < n; ++i)
 	{
-		if (visi_ind_3D.at<int>(i) == 1)
+		// If the landmark is invisible skip it
+		if (landmark_locations.at<float>(i) == 0)
 		{
-			this->mean_shape.row(i).copyTo(M.row(visi_count));
-			this->princ_comp.row(i).copyTo(V.row(visi_count));
-			visi_count++;
+			continue;
 		}
-	}
-
-	cv::Mat_<float> m_old = this->mean_shape.clone();
-	cv::Mat_<float> v_old = this->princ_comp.clone();
 
-	this->mean_shape = M;
-	this->princ_comp = V;
+		min_x = std::min(min_x, landmark_locations.at<float>(i));
+		max_x = std::max(max_x, landmark_locations.at<float>(i));
+		min_y = std::min(min_y, landmark_locations.at<float>(i + n));
+		max_y = std::max(max_y, landmark_locations.at<float>(i + n));
 
-	// The new number of points
-	n  = M.rows / 3;
-
-	// Extract the relevant landmark locations
-	cv::Mat_<float> landmark_locs_vis(n*2, 1, 0.0f);
-	int k = 0;
-	for(int i = 0; i < visi_ind_2D.rows; ++i)
-	{
-		if(visi_ind_2D.at<int>(i) == 1)
-		{
-			landmark_locs_vis.at<float>(k) = landmark_locations.at<float>(i);
-			k++;
-		}		
+		model_min_x = std::min(model_min_x, model_shape.at<float>(i));
+		model_max_x = std::max(model_max_x, model_shape.at<float>(i));
+		model_min_y = std::min(model_min_y, model_shape.at<float>(i + n));
+		model_max_y = std::max(model_max_y, model_shape.at<float>(i + n));
 	}
 
-	// Compute the initial global parameters
-	float min_x, max_x, min_y, max_y;
-	ExtractBoundingBox(landmark_locs_vis, min_x, max_x, min_y, max_y);
-
 	float width = abs(min_x - max_x);
 	float height = abs(min_y - max_y);
 
-	cv::Rect_<float> model_bbox;
-	CalcBoundingBox(model_bbox, cv::Vec6f(1.0, 0.0, 0.0, 0.0, 0.0, 0.0), cv::Mat_<float>(this->NumberOfModes(), 1, 0.0));
+	float scaling = ((width / (model_max_x - model_min_x)) + (height / (model_max_y - model_min_y))) / 2.0f;
 
-	cv::Rect_<float> bbox(min_x, min_y, width, height);
+	out_params_global = cv::Vec6f(scaling, rotation[0], rotation[1], rotation[2], (min_x + max_x) / 2.0f, (min_y + max_y) / 2.0f);
+	out_params_local = cv::Mat_<float>(m, 1, 0.0f);
 
-	float scaling = ((width / model_bbox.width) + (height / model_bbox.height)) / 2.0f;
-        
-	cv::Vec3f rotation_init = rotation;
-	cv::Matx33f R = Utilities::Euler2RotationMatrix(rotation_init);
-	cv::Vec2f translation((min_x + max_x) / 2.0f, (min_y + max_y) / 2.0f);
-    
-	cv::Mat_<float> loc_params(this->NumberOfModes(),1, 0.0);
-	cv::Vec6f glob_params(scaling, rotation_init[0], rotation_init[1], rotation_init[2], translation[0], translation[1]);
+	FitParams(out_params_global, out_params_local, landmark_locations);
 
-	// get the 3D shape of the object	
-	cv::Mat_<float> shape_3D = M + V * loc_params;
+}
 
-	cv::Mat_<float> curr_shape(2*n, 1);
-	
-	// for every vertex
-	for(int i = 0; i < n; i++)
+//===========================================================================
+// Refine the parameters to the landmark locations starting from the provided ones (e.g. the previous frame or a converged tracker fit),
+// if they are not a valid starting point (no scale or wrong number of modes) the fit starts from the extent of the landmarks instead
+void PDM::RefineParams(cv::Vec6f& params_global, cv::Mat_<float>& params_local, const cv::Mat_<float>& landmark_locations)
+{
+	if (params_global[0] <= 0 || params_local.rows != this->NumberOfModes() || params_local.cols != 1)
 	{
-		// Transform this using the weak-perspective mapping to 2D from 3D
-		curr_shape.at<float>(i  ,0) = scaling * ( R(0,0) * shape_3D.at<float>(i, 0) + R(0,1) * shape_3D.at<float>(i+n  ,0) + R(0,2) * shape_3D.at<float>(i+n*2,0) ) + translation[0];
-		curr_shape.at<float>(i+n,0) = scaling * ( R(1,0) * shape_3D.at<float>(i, 0) + R(1,1) * shape_3D.at<float>(i+n  ,0) + R(1,2) * shape_3D.at<float>(i+n*2,0) ) + translation[1];
+		CalcParams(params_global, params_local, landmark_locations);
+	}
+	else
+	{
+		FitParams(params_global, params_local, landmark_locations);
 	}
-		    
-    float currError = cv::norm(curr_shape - landmark_locs_vis);
+}
 
-	cv::Mat_<float> regularisations = cv::Mat_<float>::zeros(1, 6 + m);
+//===========================================================================
+// Gauss-Newton fit of the parameters to the landmark locations, starting from the provided values. The weight matrix is diagonal, so it is
+// kept as a vector, with the invisible landmarks (at 0) given a zero weight rather than being removed from the model
+void PDM::FitParams(cv::Vec6f& params_global, cv::Mat_<float>& params_local, const cv::Mat_<float>& landmark_locations)
+{
+	int m = this->NumberOfModes();
+	int n = this->NumberOfPoints();
+
+	int num_params = 6 + m;
 
+	cv::Mat_<float> weights_sqrt(n * 2, 1, 1.0f);
+	for (int i = 0; i < n; ++i)
+	{
+		if (landmark_locations.at<float>(i) == 0)
+		{
+			weights_sqrt.at<float>(i) = 0.0f;
+			weights_sqrt.at<float>(i + n) = 0.0f;
+		}
+	}
+
+	// Setting the regularisation to the inverse of eigenvalues (it is diagonal, so only the diagonal is stored)
 	float reg_factor = 1;
+	cv::Mat_<float> regularisations = cv::Mat_<float>::zeros(num_params, 1);
+	cv::Mat(reg_factor / this->eigen_values).reshape(1, m).copyTo(regularisations(cv::Rect(0, 6, 1, m)));
+
+	// Preallocated buffers reused across iterations
+	cv::Mat_<float> J_w;
+	cv::Mat_<float> J_w_t_m(num_params, 1);
+	cv::Mat_<float> Hessian(num_params, num_params);
+	cv::Mat_<float> error_resid(n * 2, 1);
 
-	// Setting the regularisation to the inverse of eigenvalues
-	cv::Mat(reg_factor / this->eigen_values).copyTo(regularisations(cv::Rect(6, 0, m, 1)));
-	regularisations = cv::Mat::diag(regularisations.t());
+	cv::Mat_<float> curr_shape;
+	CalcShape2D(curr_shape, params_local, params_global);
 
-	cv::Mat_<float> WeightMatrix = cv::Mat_<float>::eye(n*2, n*2);
+	float currError = cv::norm((landmark_locations - curr_shape).mul(weights_sqrt));
 
 	int not_improved_in = 0;
 
 	for (size_t i = 0; i < 1000; ++i)
 	{
-		// get the 3D shape of the object
-		shape_3D = M + V * loc_params;
-
-		shape_3D = shape_3D.reshape(1, 3);
+		this->ComputeWeightedJacobian(params_local, params_global, weights_sqrt, false, J_w);
 
-		cv::Matx23f R_2D(R(0,0), R(0,1), R(0,2), R(1,0), R(1,1), R(1,2));
+		// projection of the weighted residuals onto the weighted Jacobian, J' * W * residual
+		cv::multiply(landmark_locations - curr_shape, weights_sqrt, error_resid);
+		cv::gemm(J_w, error_resid, 1.0, cv::noArray(), 0.0, J_w_t_m, cv::GEMM_1_T);
 
-		cv::Mat_<float> curr_shape_2D = scaling * shape_3D.t() * cv::Mat(R_2D).t();
-        curr_shape_2D.col(0) = curr_shape_2D.col(0) + translation(0);
-		curr_shape_2D.col(1) = curr_shape_2D.col(1) + translation(1);
-
-		curr_shape_2D = cv::Mat(curr_shape_2D.t()).reshape(1, n * 2);
-		
-		cv::Mat_<float> error_resid;
-		cv::Mat(landmark_locs_vis - curr_shape_2D).convertTo(error_resid, CV_32F);
-        
-		cv::Mat_<float> J, J_w_t;
-		this->ComputeJacobian(loc_params, glob_params, J, WeightMatrix, J_w_t);
-        
-		// projection of the meanshifts onto the jacobians (using the weighted Jacobian, see Baltrusaitis 2013)
-		cv::Mat_<float> J_w_t_m = J_w_t * error_resid;
-
-		// Add the regularisation term
-		J_w_t_m(cv::Rect(0,6,1, m)) = J_w_t_m(cv::Rect(0,6,1, m)) - regularisations(cv::Rect(6,6, m, m)) * loc_params;
-
-		cv::Mat_<float> Hessian = regularisations.clone();
+		// Add the regularisation term, and start the Hessian from it
+		float* J_w_t_m_ptr = J_w_t_m.ptr<float>();
+		Hessian.setTo(0.0f);
+		for (int k = 0; k < num_params; ++k)
+		{
+			if (k >= 6)
+			{
+				J_w_t_m_ptr[k] -= regularisations.at<float>(k) * params_local.at<float>(k - 6);
+			}
+			Hessian.at<float>(k, k) = regularisations.at<float>(k);
+		}
 
-		// Perform matrix multiplication in OpenBLAS (fortran call)
+		// Perform a symmetric rank-k update in OpenBLAS (fortran call), same as in CLNF::NU_RLMS
 		float alpha1 = 1.0;
 		float beta1 = 1.0;
+		int num_rows = J_w.rows;
+		char U[2]; U[0] = 'U';
 		char N[2]; N[0] = 'N';
-		sgemm_(N, N, &J.cols, &J_w_t.rows, &J_w_t.cols, &alpha1, (float*)J.data, &J.cols, (float*)J_w_t.data, &J_w_t.cols, &beta1, (float*)Hessian.data, &J.cols);
+		ssyrk_(U, N, &num_params, &num_rows, &alpha1, (float*)J_w.data, &num_params, &beta1, (float*)Hessian.data, &num_params);
 
 		// Above is a fast (but ugly) version of 
-		// cv::Mat_<float> Hessian2 = J_w_t * J + regularisations;
-		
-		// Solve for the parameter update (from Baltrusaitis 2013 based on eq (36) Saragih 2011)
-		cv::Mat_<float> param_update;
-		cv::solve(Hessian, J_w_t_m, param_update, cv::DECOMP_CHOLESKY);
+		// cv::Mat_<float> Hessian = J_w.t() * J_w + cv::Mat::diag(regularisations);
+
+		// Solve for the parameter update (from Baltrusaitis 2013 based on eq (36) Saragih 2011) using an in place Cholesky decomposition
+		cv::Mat_<float> param_update = J_w_t_m.clone();
+		if (!cv::Cholesky(Hessian.ptr<float>(), Hessian.step, num_params, param_update.ptr<float>(), param_update.step, 1))
+		{
+			break;
+		}
 
 		// To not overshoot, have the gradient decent rate a bit smaller
 		param_update = 0.75 * param_update;
 
-		UpdateModelParameters(param_update, loc_params, glob_params);		
-        
-        scaling = glob_params[0];
-		rotation_init[0] = glob_params[1];
-		rotation_init[1] = glob_params[2];
-		rotation_init[2] = glob_params[3];
-
-		translation[0] = glob_params[4];
-		translation[1] = glob_params[5];
-        
-		R = Utilities::Euler2RotationMatrix(rotation_init);
-
-		R_2D(0,0) = R(0,0);R_2D(0,1) = R(0,1); R_2D(0,2) = R(0,2);
-		R_2D(1,0) = R(1,0);R_2D(1,1) = R(1,1); R_2D(1,2) = R(1,2); 
-
-		curr_shape_2D = scaling * shape_3D.t() * cv::Mat(R_2D).t();
-        curr_shape_2D.col(0) = curr_shape_2D.col(0) + translation(0);
-		curr_shape_2D.col(1) = curr_shape_2D.col(1) + translation(1);
-
-		curr_shape_2D = cv::Mat(curr_shape_2D.t()).reshape(1, n * 2);
-        
-        float error = cv::norm(curr_shape_2D - landmark_locs_vis);
-        
-        if(0.999 * currError < error)
+		UpdateModelParameters(param_update, params_local, params_global);		
+
+		CalcShape2D(curr_shape, params_local, params_global);
+
+		float error = cv::norm((landmark_locations - curr_shape).mul(weights_sqrt));
+
+		if(0.999 * currError < error)
 		{
 			not_improved_in++;
 			if (not_improved_in == 3)
@@ -692,16 +748,8 @@ void PDM::CalcParams(cv::Vec6f& out_params_global, cv::Mat_<float>& out_params_l
 		}
 
 		currError = error;
-        
 	}
 
-	out_params_global = glob_params;
-	out_params_local = loc_params;
-    	
-	this->mean_shape = m_old;
-	this->princ_comp = v_old;
-
-
 }
 
 bool PDM::Read(std::string location)
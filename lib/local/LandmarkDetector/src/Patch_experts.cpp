@@ -47,6 +47,8 @@
 #endif
 
 #include "LandmarkDetectorUtils.h"
+#include "CNN_utils.h"
+#include "TaskScheduler.h"
 
 using namespace LandmarkDetector;
 
@@ -210,8 +212,65 @@ void Patch_experts::Response(std::vector<cv::Mat_<float> >& patch_expert_respons
 	// We do not want to create threads for invisible landmarks, so construct an index of visible ones
 	std::vector<int> vis_lmk = Collect_visible_landmarks(visibilities, scale, view_id, n);
 
+	// When tuning, the convolution kernel is looked up once per distinct patch expert size rather than for every landmark,
+	// a size that has not been timed yet uses the default kernel for now and the area of interest of its first landmark is kept, so that
+	// the kernels can be timed on it once the parallel loop is done and the timing does not compete with the other landmarks
+	struct KernelChoice
+	{
+		int width;
+		int height;
+		int count;
+		std::string key;
+		ConvolutionTuner::Kernel kernel;
+		int tuning_landmark;
+		cv::Mat_<float> tuning_area;
+	};
+	std::vector<KernelChoice> kernel_choices;
+	std::vector<int> landmark_kernels(vis_lmk.size(), -1);
+	ConvolutionTuner& tuner = ConvolutionTuner::Instance();
+	if (tuner.Enabled() && !use_cen)
+	{
+		for (size_t i = 0; i < vis_lmk.size(); ++i)
+		{
+			int ind = vis_lmk[i];
+			int width, height, count;
+			if (use_ccnf)
+			{
+				width = ccnf_expert_intensity[scale][view_id][ind].width;
+				height = ccnf_expert_intensity[scale][view_id][ind].height;
+				count = (int)ccnf_expert_intensity[scale][view_id][ind].neurons.size();
+			}
+			else
+			{
+				width = svr_expert_intensity[scale][view_id][ind].width;
+				height = svr_expert_intensity[scale][view_id][ind].height;
+				count = (int)svr_expert_intensity[scale][view_id][ind].svr_patch_experts.size();
+			}
+
+			size_t choice = 0;
+			while (choice < kernel_choices.size() && (kernel_choices[choice].width != width || kernel_choices[choice].height != height || kernel_choices[choice].count != count))
+			{
+				++choice;
+			}
+
+			if (choice == kernel_choices.size())
+			{
+				KernelChoice new_choice;
+				new_choice.width = width;
+				new_choice.height = height;
+				new_choice.count = count;
+				new_choice.key = std::string(use_ccnf ? "ccnf " : "svr ") + std::to_string(width) + "x" + std::to_string(height) + " " + std::to_string(count) +
+					" on " + std::to_string(window_size + height - 1) + "x" + std::to_string(window_size + width - 1);
+				new_choice.kernel = tuner.GetKernel(new_choice.key);
+				new_choice.tuning_landmark = (int)i;
+				kernel_choices.push_back(new_choice);
+			}
+			landmark_kernels[i] = (int)choice;
+		}
+	}
+
 	// calculate the patch responses for every landmark (this is the heavy lifting of landmark detection)
-	parallel_for_(cv::Range(0, vis_lmk.size()), [&](const cv::Range& range) {
+	TaskScheduler::Instance().ParallelFor(cv::Range(0, vis_lmk.size()), [&](const cv::Range& range) {
 		for (int i = range.start; i < range.end; i++)
 		{
 
@@ -317,12 +376,28 @@ void Patch_experts::Response(std::vector<cv::Mat_<float> >& patch_expert_respons
 
 				cv::Mat_<float> prealloc_mat = preallocated_im2col[ind][im2col_size];
 
-				ccnf_expert_intensity[scale][view_id][ind].ResponseOpenBlas(area_of_interest, patch_expert_responses[ind], prealloc_mat);
+				// The shared spectra FFT path is used by default, with OpenBLAS as the fallback for experts that do not have the spectra,
+				// when tuning the faster one is used for the patch and area sizes
+				ConvolutionTuner::Kernel kernel = ccnf_expert_intensity[scale][view_id][ind].HasSpectra(window_size) ? ConvolutionTuner::FFT : ConvolutionTuner::GEMM;
+				if (landmark_kernels[i] >= 0)
+				{
+					KernelChoice& choice = kernel_choices[landmark_kernels[i]];
+					if (choice.kernel != ConvolutionTuner::UNKNOWN)
+						kernel = choice.kernel;
+					else if (choice.tuning_landmark == i)
+						choice.tuning_area = area_of_interest.clone();
+				}
 
-				preallocated_im2col[ind][im2col_size] = prealloc_mat;
+				if (kernel == ConvolutionTuner::FFT)
+				{
+					ccnf_expert_intensity[scale][view_id][ind].Response(area_of_interest, patch_expert_responses[ind]);
+				}
+				else
+				{
+					ccnf_expert_intensity[scale][view_id][ind].ResponseOpenBlas(area_of_interest, patch_expert_responses[ind], prealloc_mat);
+				}
 
-				// Below is an alternative way to compute the same, but that uses FFT instead of OpenBLAS
-				// ccnf_expert_intensity[scale][view_id][ind].Response(area_of_interest, patch_expert_responses[ind]);
+				preallocated_im2col[ind][im2col_size] = prealloc_mat;
 
 			}
 			else
@@ -330,10 +405,61 @@ void Patch_experts::Response(std::vector<cv::Mat_<float> >& patch_expert_respons
 				// get the correct size response window			
 				patch_expert_responses[ind] = cv::Mat_<float>(window_size, window_size);
 
-				svr_expert_intensity[scale][view_id][ind].Response(area_of_interest, patch_expert_responses[ind]);
+				int im2col_size = area_of_interest_width * area_of_interest_height;
+
+				cv::Mat_<float> prealloc_mat = preallocated_im2col[ind][im2col_size];
+
+				Multi_SVR_patch_expert& svr_expert = svr_expert_intensity[scale][view_id][ind];
+
+				// As with CCNF the response can be computed using FFT or OpenBLAS, when tuning the faster one is used for the patch and area sizes
+				ConvolutionTuner::Kernel kernel = ConvolutionTuner::GEMM;
+				if (landmark_kernels[i] >= 0)
+				{
+					KernelChoice& choice = kernel_choices[landmark_kernels[i]];
+					if (choice.kernel != ConvolutionTuner::UNKNOWN)
+						kernel = choice.kernel;
+					else if (choice.tuning_landmark == i)
+						choice.tuning_area = area_of_interest.clone();
+				}
+
+				if (kernel == ConvolutionTuner::FFT)
+				{
+					svr_expert.Response(area_of_interest, patch_expert_responses[ind]);
+				}
+				else
+				{
+					svr_expert.ResponseOpenBlas(area_of_interest, patch_expert_responses[ind], prealloc_mat);
+				}
+
+				preallocated_im2col[ind][im2col_size] = prealloc_mat;
 			}
 		}
 	});
+
+	// Time the kernels for the sizes that have not been seen before, the responses are already computed so the results are thrown away
+	for (size_t c = 0; c < kernel_choices.size(); ++c)
+	{
+		const KernelChoice& choice = kernel_choices[c];
+		if (choice.kernel != ConvolutionTuner::UNKNOWN || choice.tuning_area.empty())
+			continue;
+
+		int ind = vis_lmk[choice.tuning_landmark];
+		cv::Mat_<float> response(window_size, window_size);
+		cv::Mat_<float> prealloc_mat;
+
+		if (use_ccnf)
+		{
+			CCNF_patch_expert& ccnf_expert = ccnf_expert_intensity[scale][view_id][ind];
+			tuner.Tune(choice.key, [&]() { ccnf_expert.ResponseOpenBlas(choice.tuning_area, response, prealloc_mat); },
+				[&]() { ccnf_expert.Response(choice.tuning_area, response); });
+		}
+		else
+		{
+			Multi_SVR_patch_expert& svr_expert = svr_expert_intensity[scale][view_id][ind];
+			tuner.Tune(choice.key, [&]() { svr_expert.ResponseOpenBlas(choice.tuning_area, response, prealloc_mat); },
+				[&]() { svr_expert.Response(choice.tuning_area, response); });
+		}
+	}
 }
 
 
@@ -386,6 +512,11 @@ bool Patch_experts::Read(std::vector<std::string> intensity_svr_expert_locations
 		{
 			return false;
 		}
+
+		if (scale == 0)
+		{
+			preallocated_im2col.resize(svr_expert_intensity[0][0].size());
+		}
 	}
 
 	// Initialise and read CCNF patch experts (currently only intensity based), 
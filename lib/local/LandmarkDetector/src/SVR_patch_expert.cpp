@@ -41,6 +41,7 @@
 #include <opencv2/imgproc.hpp>
 
 #include "LandmarkDetectorUtils.h"
+#include "CNN_utils.h"
 
 using namespace LandmarkDetector;
 
@@ -99,7 +100,7 @@ void Grad(const cv::Mat& im, cv::Mat& grad)
 }
 
 // A copy constructor
-SVR_patch_expert::SVR_patch_expert(const SVR_patch_expert& other) : weights(other.weights.clone())
+SVR_patch_expert::SVR_patch_expert(const SVR_patch_expert& other) : weights(other.weights.clone()), weight_row(other.weight_row.clone())
 {
 	this->type = other.type;
 	this->scaling = other.scaling;
@@ -128,6 +129,27 @@ void SVR_patch_expert::Read(std::ifstream &stream)
 	// OpenCV and Matlab matrix cardinality is different, hence the transpose
 	weights = weights.t();
 
+	// The im2col windows are contrast normalised, so normalising the weights as well gives the TM_CCOEFF_NORMED response
+	cv::Scalar mean, std;
+	cv::meanStdDev(weights, mean, std);
+	double norm = std[0] * std::sqrt((double)(weights.rows * weights.cols));
+
+	weight_row = cv::Mat_<float>(1, 1 + weights.rows * weights.cols, 0.0f);
+	if (norm * norm < DBL_EPSILON)
+	{
+		// A flat template has a normalised response of 1 everywhere
+		weight_row(0, 0) = (float)(scaling + bias);
+	}
+	else
+	{
+		// im2col lays out the window column by column
+		cv::Mat_<float> w_tmp = weights.t();
+		cv::Mat_<float> weights_flat = w_tmp.reshape(1, 1);
+		weights_flat = (weights_flat - mean[0]) * (scaling / norm);
+		weights_flat.copyTo(weight_row(cv::Rect(1, 0, weights.rows * weights.cols, 1)));
+		weight_row(0, 0) = (float)bias;
+	}
+
 }
 
 //===========================================================================
@@ -195,6 +217,42 @@ void SVR_patch_expert::Response(const cv::Mat_<float>& area_of_interest, cv::Mat
 
 }
 
+void SVR_patch_expert::ResponseOpenBlas(const cv::Mat_<float>& input, cv::Mat_<float>& response, cv::Mat_<float>& im2col_prealloc)
+{
+	int response_height = input.rows - weights.rows + 1;
+	int response_width = input.cols - weights.cols + 1;
+
+	// The normalisation of the raw patch done in Response does not change the normalised cross-correlation, so it is skipped here
+	im2colContrastNormBias(input, weights.cols, weights.rows, im2col_prealloc);
+
+	// Perform matrix multiplication in OpenBLAS (fortran call), the im2col rows are the windows so it is transposed from the column major point of view
+	cv::Mat_<float> svr_response(response_width, response_height);
+	int num_windows = response_height * response_width;
+	int num_cols = im2col_prealloc.cols;
+	int one = 1;
+	float alpha1 = 1.0;
+	float beta1 = 0.0;
+	char T[2]; T[0] = 'T';
+	char N[2]; N[0] = 'N';
+	sgemm_(T, N, &num_windows, &one, &num_cols, &alpha1, (float*)im2col_prealloc.data, &num_cols, (float*)weight_row.data, &num_cols, &beta1, (float*)svr_response.data, &num_windows);
+
+	// Above is a faster version of this
+	//cv::Mat_<float> svr_response = weight_row * im2col_prealloc.t();
+
+	cv::MatIterator_<float> q1 = svr_response.begin(); // respone for each pixel
+	cv::MatIterator_<float> q2 = svr_response.end();
+
+	while (q1 != q2)
+	{
+		// the SVR response passed into logistic regressor (the slope and bias are already in the weights)
+		*q1 = 1.0f / (1.0f + std::exp(-*q1));
+		q1++;
+	}
+
+	// im2col goes through the windows column by column
+	cv::transpose(svr_response, response);
+}
+
 void SVR_patch_expert::ResponseDepth(const cv::Mat_<float>& area_of_interest, cv::Mat_<float> &response)
 {
 
@@ -321,6 +379,54 @@ void Multi_SVR_patch_expert::Response(const cv::Mat_<float> &area_of_interest, c
 
 }
 
+void Multi_SVR_patch_expert::ResponseOpenBlas(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response, cv::Mat_<float> &im2col_prealloc)
+{
+
+	int response_height = area_of_interest.rows - height + 1;
+	int response_width = area_of_interest.cols - width + 1;
+
+	if (response.rows != response_height || response.cols != response_width)
+	{
+		response.create(response_height, response_width);
+	}
+
+	// The gradient is only computed once, even if there are several gradient modalities
+	cv::Mat_<float> gradient;
+
+	cv::Mat_<float> modality_resp(response_height, response_width);
+
+	for (size_t i = 0; i < svr_patch_experts.size(); i++)
+	{
+		const cv::Mat_<float>* input = &area_of_interest;
+
+		if (svr_patch_experts[i].type == 1)
+		{
+			if (gradient.empty())
+			{
+				Grad(area_of_interest, gradient);
+			}
+			input = &gradient;
+		}
+		else if (svr_patch_experts[i].type != 0)
+		{
+			printf("ERROR(%s,%d): Unsupported patch type %d!\n", __FILE__, __LINE__, svr_patch_experts[i].type);
+			abort();
+		}
+
+		if (i == 0)
+		{
+			svr_patch_experts[i].ResponseOpenBlas(*input, response, im2col_prealloc);
+		}
+		else
+		{
+			// responses from multiple patch experts these can be gradients, LBPs etc.
+			svr_patch_experts[i].ResponseOpenBlas(*input, modality_resp, im2col_prealloc);
+			response = response.mul(modality_resp);
+		}
+	}
+
+}
+
 void Multi_SVR_patch_expert::ResponseDepth(const cv::Mat_<float>& area_of_interest, cv::Mat_<float>& response)
 {
 	int response_height = area_of_interest.rows - height + 1;
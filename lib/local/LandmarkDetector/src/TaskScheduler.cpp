@@ -0,0 +1,275 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Tadas Baltrusaitis, all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "stdafx.h"
+
+#include "TaskScheduler.h"
+
+using namespace LandmarkDetector;
+
+// The worker running on this thread, -1 if it is not one of the scheduler threads
+static thread_local int current_worker = -1;
+
+TaskScheduler& TaskScheduler::Instance()
+{
+	static TaskScheduler scheduler;
+	return scheduler;
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	sleep_cond.notify_all();
+
+	for (size_t i = 0; i < workers.size(); ++i)
+	{
+		workers[i].join();
+	}
+}
+
+void TaskScheduler::SetNumberOfWorkers(int num_workers)
+{
+	std::lock_guard<std::mutex> lock(start_mutex);
+	if (!started)
+	{
+		this->num_workers = num_workers;
+	}
+}
+
+int TaskScheduler::NumberOfWorkers()
+{
+	Start();
+	return num_workers;
+}
+
+void TaskScheduler::Start()
+{
+	if (started)
+		return;
+
+	std::lock_guard<std::mutex> lock(start_mutex);
+	if (started)
+		return;
+
+	// The thread waiting for a loop works as well, so one worker less than there are cores
+	if (num_workers <= 0)
+	{
+		num_workers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+	}
+
+	// The extra queue is for the threads outside of the scheduler
+	for (int i = 0; i <= num_workers; ++i)
+	{
+		queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+	}
+
+	for (int i = 0; i < num_workers; ++i)
+	{
+		workers.push_back(std::thread(&TaskScheduler::WorkerThread, this, i));
+	}
+
+	started = true;
+}
+
+void TaskScheduler::ParallelFor(const cv::Range& range, const std::function<void(const cv::Range&)>& body)
+{
+	if (range.end <= range.start)
+		return;
+
+	Start();
+
+	// A few tasks per thread, so that uneven work can be balanced by stealing
+	int length = range.end - range.start;
+	int num_tasks = std::min(length, 2 * (num_workers + 1));
+
+	if (num_tasks == 1)
+	{
+		body(range);
+		return;
+	}
+
+	int queue_index = current_worker < 0 ? num_workers : current_worker;
+
+	Loop loop;
+	loop.body = &body;
+	loop.remaining = num_tasks;
+	loop.failed = false;
+	{
+		std::lock_guard<std::mutex> lock(queues[queue_index]->queue_mutex);
+		for (int t = 0; t < num_tasks; ++t)
+		{
+			Task task;
+			task.loop = &loop;
+			task.range = cv::Range(range.start + (int)((long long)length * t / num_tasks), range.start + (int)((long long)length * (t + 1) / num_tasks));
+			queues[queue_index]->tasks.push_back(task);
+		}
+	}
+
+	queued_tasks += num_tasks;
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+	}
+	sleep_cond.notify_all();
+
+	// Help with the tasks of this loop that have not been taken yet
+	while (loop.remaining > 0 && RunTask(queue_index, &loop))
+	{
+		;
+	}
+
+	// The rest are running on other threads and are usually close to done, so spin for a bit before sleeping
+	for (int spin = 0; spin < 64 && loop.remaining > 0; ++spin)
+	{
+		std::this_thread::yield();
+	}
+
+	// Even if done already, the lock makes sure that the thread finishing the last task is not using the loop anymore
+	{
+		std::unique_lock<std::mutex> lock(loop.done_mutex);
+		loop.done_cond.wait(lock, [&loop]() { return loop.remaining == 0; });
+	}
+
+	if (loop.exception)
+	{
+		std::rethrow_exception(loop.exception);
+	}
+}
+
+bool TaskScheduler::TakeTask(TaskQueue& queue, bool most_recent, const Loop* only_loop, Task& task)
+{
+	std::lock_guard<std::mutex> lock(queue.queue_mutex);
+
+	if (queue.tasks.empty())
+		return false;
+
+	if (only_loop == nullptr)
+	{
+		if (most_recent)
+		{
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+		}
+		else
+		{
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+		}
+		return true;
+	}
+
+	// The queues are short (a few tasks per thread per loop), so just search for a task of the loop
+	for (size_t i = 0; i < queue.tasks.size(); ++i)
+	{
+		size_t index = most_recent ? queue.tasks.size() - 1 - i : i;
+		if (queue.tasks[index].loop == only_loop)
+		{
+			task = queue.tasks[index];
+			queue.tasks.erase(queue.tasks.begin() + index);
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskScheduler::Execute(const Task& task)
+{
+	Loop& loop = *task.loop;
+
+	if (!loop.failed)
+	{
+		try
+		{
+			(*loop.body)(task.range);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(loop.done_mutex);
+			if (!loop.exception)
+			{
+				loop.exception = std::current_exception();
+			}
+			loop.failed = true;
+		}
+	}
+
+	// This has to be the last use of the loop, as the waiter can return straight after
+	std::lock_guard<std::mutex> lock(loop.done_mutex);
+	if (--loop.remaining == 0)
+	{
+		loop.done_cond.notify_all();
+	}
+}
+
+bool TaskScheduler::RunTask(int queue_index, const Loop* only_loop)
+{
+	Task task;
+
+	// The most recent task of the own queue first, as its data is most likely to still be in the cache
+	bool found = TakeTask(*queues[queue_index], true, only_loop, task);
+
+	// Otherwise steal the oldest task of another queue
+	for (size_t i = 1; !found && i < queues.size(); ++i)
+	{
+		found = TakeTask(*queues[(queue_index + i) % queues.size()], false, only_loop, task);
+	}
+
+	if (!found)
+		return false;
+
+	queued_tasks--;
+
+	Execute(task);
+
+	return true;
+}
+
+void TaskScheduler::WorkerThread(int worker_index)
+{
+	current_worker = worker_index;
+
+	while (true)
+	{
+		if (RunTask(worker_index))
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		sleep_cond.wait(lock, [this]() { return queued_tasks > 0 || stopping; });
+
+		if (stopping)
+			return;
+	}
+}
@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Tadas Baltrusaitis all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef AU_SCHEMA_H
+#define AU_SCHEMA_H
+
+// System includes
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace Utilities
+{
+
+	//===========================================================================
+	/**
+	The set of Action Units a model predicts, fixed once the model is loaded. An AU is identified by its position in the schema,
+	so per frame predictions are just dense arrays indexed by it and the names are only needed when the results are written out
+	*/
+	class AUSchema {
+
+	public:
+
+		AUSchema() {}
+
+		explicit AUSchema(const std::vector<std::string>& au_names) : names(au_names)
+		{
+			sorted_ids.resize(names.size());
+			for (size_t i = 0; i < names.size(); ++i)
+			{
+				sorted_ids[i] = (int)i;
+			}
+			std::stable_sort(sorted_ids.begin(), sorted_ids.end(), [this](int a, int b) { return names[a] < names[b]; });
+		}
+
+		size_t size() const { return names.size(); }
+		bool empty() const { return names.empty(); }
+
+		const std::string& Name(int id) const { return names[id]; }
+		const std::vector<std::string>& Names() const { return names; }
+
+		// The id of an AU, or -1 if it is not in the schema
+		int Find(const std::string& name) const
+		{
+			for (size_t i = 0; i < names.size(); ++i)
+			{
+				if (names[i] == name)
+				{
+					return (int)i;
+				}
+			}
+			return -1;
+		}
+
+		// The ids ordered by AU name, the order in which the AUs are written out
+		const std::vector<int>& SortedIds() const { return sorted_ids; }
+
+		bool operator==(const AUSchema& other) const { return names == other.names; }
+		bool operator!=(const AUSchema& other) const { return !(*this == other); }
+
+	private:
+
+		std::vector<std::string> names;
+		std::vector<int> sorted_ids;
+
+	};
+
+	//===========================================================================
+	/**
+	A non-owning view of the AU predictions of a frame, values[id] is the prediction of schema.Name(id). The view is only valid as long as
+	the predictions it points to are (for the FaceAnalyser until the next frame is added), anyone keeping them around has to copy the values
+	*/
+	class AUView {
+
+	public:
+
+		AUView() : schema(nullptr), values(nullptr) {}
+
+		// If there are no predictions (e.g. no face was analysed yet), the view is empty
+		AUView(const AUSchema& schema, const std::vector<double>& values) : schema(&schema), values(values.size() == schema.size() ? values.data() : nullptr) {}
+
+		size_t size() const { return values ? schema->size() : 0; }
+		bool empty() const { return size() == 0; }
+
+		double operator[](int id) const { return values[id]; }
+		const double* data() const { return values; }
+		const std::string& Name(int id) const { return schema->Name(id); }
+
+		// Only valid if the view was constructed from a schema
+		const AUSchema& Schema() const { return *schema; }
+		bool HasSchema() const { return schema != nullptr; }
+
+	private:
+
+		const AUSchema* schema;
+		const double* values;
+
+	};
+
+}
+#endif // AU_SCHEMA_H
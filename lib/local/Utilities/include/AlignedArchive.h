@@ -0,0 +1,173 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Tadas Baltrusaitis, all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef ALIGNED_ARCHIVE_H
+#define ALIGNED_ARCHIVE_H
+
+// System includes
+#include <vector>
+#include <string>
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+#include <iostream>
+#include <fstream>
+
+namespace Utilities
+{
+
+	// Description of a single aligned face stored in the archive
+	struct AlignedArchiveEntry
+	{
+		int frame_number;
+		int face_id;
+		bool success;
+
+		// Size and type of the aligned face image
+		int rows;
+		int cols;
+		int type;
+
+		// Where the (encoded or raw) image data is in the archive file
+		long long offset;
+		long long size;
+	};
+
+	//===========================================================================
+	/**
+	A class for recording similarity aligned faces to a single archive file instead of a file per face.
+	The faces are stored as encoded images (any format cv::imencode supports) or as raw pixels ("raw" format), in chunks of records.
+	On closing, an index of all of the faces is appended so that they can be read in any order.
+	The chunks (and so the index) are in the order they were written, when several threads encode the faces that is not frame order,
+	so a reader has to go by the frame number and face id of the entries rather than by their position.
+	File layout (little endian): header "OFAA", version, format | chunks "CHNK", count, records | index "INDX", count, entries | index offset, "OFAE"
+	*/
+	class AlignedArchiveWriter {
+
+	public:
+
+		// The constructor for the writer, by default does not do anything
+		AlignedArchiveWriter();
+
+		~AlignedArchiveWriter();
+
+		// Format is either "raw" or an image extension, e.g. "bmp", "png" or "jpg"
+		bool Open(const std::string& filename, const std::string& format);
+
+		bool IsOpen() const { return archive_file.is_open(); }
+
+		// Encoding an aligned face in the given archive format, it does not touch the file, so can be called from several threads at once
+		static bool Encode(const cv::Mat& aligned_face, const std::string& format, std::vector<uchar>& data);
+
+		// Appending a chunk of already encoded faces (only frame number, face id, success and image size and type of the entries are used),
+		// the chunks do not need to follow on from each other in frame order
+		void WriteChunk(const std::vector<AlignedArchiveEntry>& entries, const std::vector<std::vector<uchar> >& data);
+
+		// Encoding and appending a single face
+		void Write(int frame_number, int face_id, bool success, const cv::Mat& aligned_face);
+
+		std::string GetFormat() const { return format; }
+
+		// Writing the index and closing the file
+		void Close();
+
+	private:
+
+		// Blocking copy and move, as it doesn't make sense to write to the same file
+		AlignedArchiveWriter & operator= (const AlignedArchiveWriter& other);
+		AlignedArchiveWriter & operator= (const AlignedArchiveWriter&& other);
+		AlignedArchiveWriter(const AlignedArchiveWriter&& other);
+		AlignedArchiveWriter(const AlignedArchiveWriter& other);
+
+		std::ofstream archive_file;
+		std::string format;
+
+		// The faces written so far, becomes the index of the archive
+		std::vector<AlignedArchiveEntry> index;
+
+	};
+
+	//===========================================================================
+	/**
+	A class for reading the archives written by AlignedArchiveWriter, with random access to the faces.
+	If the archive was not closed properly (no index at the end) the index is rebuilt from the chunks.
+	*/
+	class AlignedArchiveReader {
+
+	public:
+
+		AlignedArchiveReader();
+
+		bool Open(const std::string& filename);
+
+		void Close();
+
+		size_t NumberOfFaces() const { return index.size(); }
+
+		// The entries are in the order they were written, which is not necessarily frame order
+		const AlignedArchiveEntry& GetEntry(size_t i) const { return index[i]; }
+
+		std::string GetFormat() const { return format; }
+
+		// Reading the stored bytes of a face (the encoded image, unless the format is raw)
+		bool ReadData(size_t i, std::vector<uchar>& data);
+
+		// Reading a face as an image, decoding it if needed
+		bool Read(size_t i, cv::Mat& aligned_face);
+
+	private:
+
+		// Blocking copy and move, as it doesn't make sense to read from the same file
+		AlignedArchiveReader & operator= (const AlignedArchiveReader& other);
+		AlignedArchiveReader & operator= (const AlignedArchiveReader&& other);
+		AlignedArchiveReader(const AlignedArchiveReader&& other);
+		AlignedArchiveReader(const AlignedArchiveReader& other);
+
+		// Reading the index from the end of the file, fails if the archive was not closed
+		bool ReadIndex(long long file_size);
+
+		// Reconstructing the index by going through the chunks
+		void ScanChunks(long long file_size);
+
+		std::ifstream archive_file;
+		std::string format;
+
+		// Where the first chunk starts
+		long long data_start;
+
+		std::vector<AlignedArchiveEntry> index;
+
+	};
+}
+#endif // ALIGNED_ARCHIVE_H
@@ -23,79 +23,224 @@
 #ifndef CONCURRENT_QUEUE_
 #define CONCURRENT_QUEUE_
 
-#include <queue>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 
-template <typename T>
+// A bounded lock-free ring buffer queue (after D. Vyukov's bounded MPMC queue), every slot has a sequence number telling whether it
+// is ready to be written to or read from, so producers and consumers only contend on the slot positions and not on a lock.
+// With single_producer_consumer the positions are advanced without compare and swap, this requires at most one thread pushing
+// and one popping at a time (several threads can take turns if they synchronise with each other)
+// A push to a full queue or a pop from an empty one spins for a while before parking on a condition variable, the lock is only
+// touched by the other side if somebody is actually parked
+template <typename T, bool single_producer_consumer = false>
 class ConcurrentQueue
 {
 public:
 
 	T pop()
 	{
-		std::unique_lock<std::mutex> mlock(mutex_);
-		while (queue_.empty())
-		{
-			cond_empty_.wait(mlock);
-		}
-		auto val = queue_.front();
-		queue_.pop();
-		mlock.unlock();
-		cond_full_.notify_one();
-		return val;
+		T item;
+		pop(item);
+		return item;
 	}
 
 	void pop(T& item)
 	{
-		std::unique_lock<std::mutex> mlock(mutex_);
-		while (queue_.empty())
+		if (!try_pop(item))
 		{
-			cond_empty_.wait(mlock);
+			wait(cond_empty_, waiting_consumers_, [&]() { return try_pop(item); });
 		}
-		item = queue_.front();
-		queue_.pop();
-		mlock.unlock();
-		cond_full_.notify_one();
+		wake(cond_full_, waiting_producers_);
 	}
 
 	void push(const T& item)
 	{
-		std::unique_lock<std::mutex> mlock(mutex_);
+		if (!try_push(item))
+		{
+			wait(cond_full_, waiting_producers_, [&]() { return try_push(item); });
+		}
+		wake(cond_empty_, waiting_consumers_);
+	}
 
-		while (capacity_ > 0 && queue_.size() >= capacity_)
+	bool try_push(const T& item)
+	{
+		Slot* slot;
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		while (true)
 		{
-			cond_full_.wait(mlock);
+			slot = &slots_[pos % capacity_];
+			size_t seq = slot->sequence.load(std::memory_order_acquire);
+			std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+			if (diff == 0)
+			{
+				if (single_producer_consumer)
+				{
+					enqueue_pos_.store(pos + 1, std::memory_order_relaxed);
+					break;
+				}
+				else if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (diff < 0)
+			{
+				// The slot still holds an item from the previous round, so the queue is full
+				return false;
+			}
+			else
+			{
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			}
 		}
-		queue_.push(item);
-		mlock.unlock();
-		cond_empty_.notify_one();
+		slot->item = item;
+		slot->sequence.store(pos + 1, std::memory_order_release);
+		return true;
 	}
-	
+
+	bool try_pop(T& item)
+	{
+		Slot* slot;
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		while (true)
+		{
+			slot = &slots_[pos % capacity_];
+			size_t seq = slot->sequence.load(std::memory_order_acquire);
+			std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos + 1);
+			if (diff == 0)
+			{
+				if (single_producer_consumer)
+				{
+					dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+					break;
+				}
+				else if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (diff < 0)
+			{
+				// Nothing written to the slot yet, so the queue is empty
+				return false;
+			}
+			else
+			{
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		item = std::move(slot->item);
+		// Do not keep a reference to the data (e.g. cv::Mat buffers) in the slot
+		slot->item = T();
+		slot->sequence.store(pos + capacity_, std::memory_order_release);
+		return true;
+	}
+
+	// The queue holds at most capacity items (0 picks a default, and the ring needs at least two slots), this reallocates the queue
+	// so it must be empty and not in use
 	void set_capacity(int capacity)
 	{
-		std::unique_lock<std::mutex> mlock(mutex_);
-		capacity_ = capacity;
+		allocate(capacity > 0 ? std::max((size_t)capacity, (size_t)2) : DEFAULT_CAPACITY);
+	}
+
+	// How many times to yield before parking when the queue is full or empty, 0 parks straight away
+	void set_spin_count(int spin_count)
+	{
+		spin_count_ = spin_count;
 	}
 
 	bool empty()
 	{
-		std::unique_lock<std::mutex> mlock(mutex_);
-		return queue_.empty();
+		return size() == 0;
+	}
+
+	// The number of items in the queue, only approximate if it is being pushed to or popped from at the same time
+	size_t size()
+	{
+		size_t dequeue_pos = dequeue_pos_.load(std::memory_order_acquire);
+		size_t enqueue_pos = enqueue_pos_.load(std::memory_order_acquire);
+		return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
 	}
 
-	ConcurrentQueue() = default;
+	ConcurrentQueue() { allocate(DEFAULT_CAPACITY); }
 	ConcurrentQueue(const ConcurrentQueue&) = delete;            // disable copying
 	ConcurrentQueue& operator=(const ConcurrentQueue&) = delete; // disable assignment
 
 private:
-	std::queue<T> queue_;
+
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		T item;
+	};
+
+	void allocate(size_t capacity)
+	{
+		capacity_ = capacity;
+		slots_.reset(new Slot[capacity_]);
+		for (size_t i = 0; i < capacity_; ++i)
+		{
+			slots_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		enqueue_pos_.store(0, std::memory_order_relaxed);
+		dequeue_pos_.store(0, std::memory_order_relaxed);
+	}
+
+	template <typename Attempt>
+	void wait(std::condition_variable& cond, std::atomic<int>& waiting, Attempt attempt)
+	{
+		// The other side is usually just about to make progress, so try a few more times before going to sleep
+		for (int i = 0; i < spin_count_; ++i)
+		{
+			std::this_thread::yield();
+			if (attempt())
+				return;
+		}
+
+		std::unique_lock<std::mutex> mlock(mutex_);
+		waiting++;
+		// Make sure the other side either sees that we are waiting or we see its update
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		while (!attempt())
+		{
+			cond.wait(mlock);
+		}
+		waiting--;
+	}
+
+	void wake(std::condition_variable& cond, std::atomic<int>& waiting)
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiting.load() > 0)
+		{
+			// Taking the lock makes sure the waiting thread is either not parked yet (and will see the update) or is in wait
+			{
+				std::unique_lock<std::mutex> mlock(mutex_);
+			}
+			cond.notify_all();
+		}
+	}
+
+	static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+	std::unique_ptr<Slot[]> slots_;
+	size_t capacity_;
+
+	// Positions are on their own cache lines, as they are written by different threads
+	alignas(64) std::atomic<size_t> enqueue_pos_;
+	alignas(64) std::atomic<size_t> dequeue_pos_;
+
+	// Parking when full or empty
+	alignas(64) std::atomic<int> waiting_producers_{ 0 };
+	std::atomic<int> waiting_consumers_{ 0 };
 	std::mutex mutex_;
 	std::condition_variable cond_empty_;
 	std::condition_variable cond_full_;
-	// If capacity greater than one, the queue will block on push if there are too many elements in it
-	int capacity_ = 0;
+	int spin_count_ = 64;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,135 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Tadas Baltrusaitis all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+// System includes
+#include <vector>
+#include <mutex>
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+namespace Utilities
+{
+
+	//===========================================================================
+	/**
+	A pool of image buffers that get recycled once no one else refers to them, relies on the reference counting of cv::Mat, so a buffer
+	handed out can be passed along (to the tracker, analyser, recording queues) as any other cv::Mat and returns to the pool when the last copy of it is released
+	*/
+	class FramePool {
+
+	public:
+
+		FramePool(size_t max_buffers = 16) : max_buffers(max_buffers) {}
+
+		// Get a buffer of a specific size and type, its contents are undefined
+		cv::Mat Acquire(int rows, int cols, int type)
+		{
+			std::unique_lock<std::mutex> lock(pool_mutex);
+
+			for (size_t i = 0; i < buffers.size(); ++i)
+			{
+				// Only the pool refers to this buffer, so it can be reused
+				if (buffers[i].u && buffers[i].u->refcount == 1 && buffers[i].rows == rows && buffers[i].cols == cols && buffers[i].type() == type)
+				{
+					return buffers[i];
+				}
+			}
+
+			cv::Mat buffer(rows, cols, type);
+
+			if (buffers.size() < max_buffers)
+			{
+				buffers.push_back(buffer);
+			}
+			else
+			{
+				// Replace a free buffer of a different size (e.g. if the resolution changed), otherwise the buffer is just not pooled
+				for (size_t i = 0; i < buffers.size(); ++i)
+				{
+					if (buffers[i].u && buffers[i].u->refcount == 1)
+					{
+						buffers[i] = buffer;
+						break;
+					}
+				}
+			}
+			return buffer;
+		}
+
+		// Copy an image into a pooled buffer (instead of clone)
+		cv::Mat Copy(const cv::Mat& image)
+		{
+			if (image.empty())
+				return cv::Mat();
+
+			cv::Mat buffer = Acquire(image.rows, image.cols, image.type());
+			image.copyTo(buffer);
+			return buffer;
+		}
+
+		void SetMaxBuffers(size_t max_buffers)
+		{
+			std::unique_lock<std::mutex> lock(pool_mutex);
+			this->max_buffers = max_buffers;
+			if (buffers.size() > max_buffers)
+			{
+				buffers.resize(max_buffers);
+			}
+		}
+
+		// Copies do not share the buffers, they start with an empty pool
+		FramePool(const FramePool& other) : max_buffers(other.max_buffers) {}
+		FramePool& operator=(const FramePool& other)
+		{
+			if (this != &other)
+			{
+				std::unique_lock<std::mutex> lock(pool_mutex);
+				buffers.clear();
+				max_buffers = other.max_buffers;
+			}
+			return *this;
+		}
+
+	private:
+
+		std::vector<cv::Mat> buffers;
+		size_t max_buffers;
+		std::mutex pool_mutex;
+
+	};
+}
+#endif // FRAME_POOL_H
@@ -80,6 +80,14 @@ namespace Utilities
 		// Parameters describing the sequence and it's progress (what's the proportion of images opened)
 		double GetProgress();
 
+		// Number of images that were opened
+		size_t NumberOfImages() const { return image_files.size(); }
+
+		// Reading a specific image together with its grayscale version, name, bounding boxes and camera intrinsics, this does not
+		// change the state of the reader so several threads can read images at the same time (for batch processing)
+		bool ReadImage(size_t image_index, cv::Mat& rgb_image, cv::Mat_<uchar>& gray_image, std::string& image_name,
+			std::vector<cv::Rect_<float> >& image_bounding_boxes, float& image_fx, float& image_fy, float& image_cx, float& image_cy) const;
+
 		int image_width;
 		int image_height;
 
@@ -42,6 +42,8 @@
 // OpenCV includes
 #include <opencv2/core/core.hpp>
 
+#include "AUSchema.h"
+
 namespace Utilities
 {
 
@@ -58,7 +60,7 @@ namespace Utilities
 
 		// Opening the file and preparing the header for it
 		bool Open(std::string output_file_name, bool is_sequence, bool output_2D_landmarks, bool output_3D_landmarks, bool output_model_params, bool output_pose, bool output_AUs, bool output_gaze,
-			int num_face_landmarks, int num_model_modes, int num_eye_landmarks, const std::vector<std::string>& au_names_class, const std::vector<std::string>& au_names_reg);
+			int num_face_landmarks, int num_model_modes, int num_eye_landmarks, const AUSchema& au_schema_class, const AUSchema& au_schema_reg, bool output_interpolated = false);
 
 		bool isOpen() const { return output_file.is_open(); }
 
@@ -68,7 +70,7 @@ namespace Utilities
 		void WriteLine(int face_id, int frame_num, double time_stamp, bool landmark_detection_success, double landmark_confidence,
 			const cv::Mat_<float>& landmarks_2D, const cv::Mat_<float>& landmarks_3D, const cv::Mat_<float>& pdm_model_params, const cv::Vec6f& rigid_shape_params, cv::Vec6f& pose_estimate,
 			const cv::Point3f& gazeDirection0, const cv::Point3f& gazeDirection1, const cv::Vec2f& gaze_angle, const std::vector<cv::Point2f>& eye_landmarks2d, const std::vector<cv::Point3f>& eye_landmarks3d,
-			const std::vector<std::pair<std::string, double> >& au_intensities, const std::vector<std::pair<std::string, double> >& au_occurences);
+			const AUView& au_intensities, const AUView& au_occurences, bool interpolated = false);
 
 	private:
 
@@ -91,9 +93,27 @@ namespace Utilities
 		bool output_pose;
 		bool output_AUs;
 		bool output_gaze;
+		bool output_interpolated;
+
+		// The AUs are written out in the order of their names
+		AUSchema au_schema_class;
+		AUSchema au_schema_reg;
+
+		// Where the AU of every column is in the predictions, worked out when a schema is first seen rather than for every row
+		struct AUColumns
+		{
+			// The schema of the predictions the ids are for
+			const AUSchema* source;
+
+			// The id in that schema for every column (in header order), -1 if it does not have the AU
+			std::vector<int> ids;
+
+			AUColumns() : source(nullptr) {}
+		};
+		AUColumns au_columns_class;
+		AUColumns au_columns_reg;
 
-		std::vector<std::string> au_names_class;
-		std::vector<std::string> au_names_reg;
+		void WriteActionUnits(const AUSchema& au_schema, AUColumns& au_columns, const AUView& au_predictions);
 
 	};
 }
@@ -36,6 +36,7 @@
 
 #include "RecorderCSV.h"
 #include "RecorderHOG.h"
+#include "AlignedArchive.h"
 #include "RecorderOpenFaceParameters.h"
 
 // System includes
@@ -46,6 +47,7 @@
 #include <opencv2/highgui/highgui.hpp>
 
 #include <thread>
+#include <mutex>
 
 #include <ConcurrentQueue.h>
 
@@ -88,8 +90,7 @@ namespace Utilities
 		void SetObservationPose(const cv::Vec6f& pose);
 
 		// AU related observations
-		void SetObservationActionUnits(const std::vector<std::pair<std::string, double> >& au_intensities, 
-			const std::vector<std::pair<std::string, double> >& au_occurences);
+		void SetObservationActionUnits(const AUView& au_intensities, const AUView& au_occurences);
 
 		// Gaze related observations
 		void SetObservationGaze(const cv::Point3f& gazeDirection0, const cv::Point3f& gazeDirection1,
@@ -103,6 +104,9 @@ namespace Utilities
 
 		void SetObservationVisualization(const cv::Mat &vis_track);
 
+		// If the observation was interpolated from neighbouring frames rather than tracked (no aligned face is written for it)
+		void SetObservationInterpolated(bool interpolated);
+
 		// Write out all observations for current face (except for tracked image/video)
 		void WriteObservation();
 
@@ -121,10 +125,14 @@ namespace Utilities
 
 		void PrepareRecording(const std::string& in_filename);
 
-		// A thread that will write image and video output (the slowest parts of output_
+		// Threads that will encode and write image and video output (the slowest parts of output), there are several of them unless
+		// writing a video, as the frames have to be written in order
 		void VideoWritingTask(bool is_sequence);
 		void AlignedImageWritingTask();
 
+		// The number of encoding threads to start for each output
+		int NumberOfEncodeThreads() const;
+
 		// Keeping track of what to output and how to output it
 		const RecorderOpenFaceParameters params;
 
@@ -134,6 +142,7 @@ namespace Utilities
 		std::string out_name; // Short name, based on which other names are constructed
 		std::string csv_filename;
 		std::string aligned_output_directory;
+		AlignedArchiveWriter aligned_archive;
 		std::ofstream metadata_file;
 
 		// The actual output file stream that will be written
@@ -153,13 +162,20 @@ namespace Utilities
 		cv::Mat_<float> pdm_params_local;
 		double landmark_detection_confidence;
 		bool landmark_detection_success;
+		bool interpolated;
 
 		// Head pose related observations
 		cv::Vec6f head_pose;
 
-		// Action Unit related observations
-		std::vector<std::pair<std::string, double> > au_intensities;
-		std::vector<std::pair<std::string, double> > au_occurences;
+		// Action Unit related observations, the values are indexed by the AU id in the schema
+		AUSchema au_schema_reg;
+		AUSchema au_schema_class;
+
+		// The schemas the copies above were taken from, so that the names only have to be compared when a different schema is passed in
+		const AUSchema* au_schema_reg_source;
+		const AUSchema* au_schema_class_source;
+		std::vector<double> au_intensities;
+		std::vector<double> au_occurences;
 
 		// Gaze related observations
 		cv::Point3f gaze_direction0;
@@ -182,10 +198,32 @@ namespace Utilities
 		const int ALIGNED_QUEUE_CAPACITY = 100;
 		bool aligned_writing_thread_started;
 		cv::Mat aligned_face;
-		ConcurrentQueue<std::pair<std::string, cv::Mat> > aligned_face_queue;
 
-		std::thread video_writing_thread;
-		std::thread aligned_writing_thread;
+		// An aligned face waiting to be written, either to its own file or to the archive
+		struct AlignedFaceOutput
+		{
+			std::string filename;
+			cv::Mat aligned_face;
+			int frame_number;
+			int face_id;
+			bool success;
+		};
+		ConcurrentQueue<AlignedFaceOutput> aligned_face_queue;
+
+		// The most faces written to the archive as one chunk
+		const size_t ALIGNED_ARCHIVE_CHUNK = 64;
+
+		std::vector<std::thread> video_writing_threads;
+		std::vector<std::thread> aligned_writing_threads;
+
+		// The encoding threads take turns appending to the archive
+		std::mutex aligned_archive_mutex;
+
+		// How long (in seconds) recording was blocked waiting for space in the output queues, and the most items waiting in them
+		double tracked_stall_time;
+		double aligned_stall_time;
+		size_t tracked_max_queue_depth;
+		size_t aligned_max_queue_depth;
 
 	};
 }
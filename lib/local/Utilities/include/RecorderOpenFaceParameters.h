@@ -63,13 +63,20 @@ namespace Utilities
 		bool outputHOG() const { return output_hog; }
 		bool outputTracked() const { return output_tracked; }
 		bool outputAlignedFaces() const { return output_aligned_faces; }
+		bool outputAlignedArchive() const { return output_aligned_archive; }
 		std::string outputCodec() const { return output_codec; }
 		std::string imageFormatAligned() const { return image_format_aligned; }
 		std::string imageFormatVisualization() const { return image_format_visualization; }
 		double outputFps() const { return fps_vid_out; }
 
+		// Number of threads encoding the aligned faces and tracked images, 0 picks it based on the number of cores
+		int encodeThreads() const { return num_encode_threads; }
+
 		bool outputBadAligned() const { return record_aligned_bad; }
 
+		// If some of the frames are interpolated and not tracked (keyframe mode), these are flagged in the output
+		bool outputInterpolated() const { return output_interpolated; }
+
 		float getFx() const { return fx; }
 		float getFy() const { return fy; }
 		float getCx() const { return cx; }
@@ -77,6 +84,7 @@ namespace Utilities
 
 		void setOutputAUs(bool output_AUs) { this->output_AUs = output_AUs; }
 		void setOutputGaze(bool output_gaze) { this->output_gaze = output_gaze; }
+		void setOutputInterpolated(bool output_interpolated) { this->output_interpolated = output_interpolated; }
 
 	private:
 		
@@ -95,10 +103,16 @@ namespace Utilities
 		bool output_hog;
 		bool output_tracked;
 		bool output_aligned_faces;
+
+		// Should the aligned faces be packed into a single archive file rather than a file per face
+		bool output_aligned_archive;
 		
 		// Should the algined faces be recorded even if the detection failed (blank images)
 		bool record_aligned_bad;
 
+		// Should a column indicating interpolated frames be added
+		bool output_interpolated;
+
 		// Some video recording parameters
 		std::string output_codec;
 		double fps_vid_out;
@@ -106,6 +120,7 @@ namespace Utilities
 		// Image recording parameters
 		std::string image_format_aligned;
 		std::string image_format_visualization;
+		int num_encode_threads;
 
 		// Camera parameters for recording in the meta file;
 		float fx, fy, cx, cy;
@@ -40,12 +40,16 @@
 #include <vector>
 
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 // OpenCV includes
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
 #include <ConcurrentQueue.h>
+#include <FramePool.h>
 
 namespace Utilities
 {
@@ -59,12 +63,14 @@ namespace Utilities
 	public:
 
 		// Default constructor
-		SequenceCapture() {};
+		SequenceCapture() : no_input_specified(false), live_mode(false), capturing(false), live_time_stamp(0), live_frame_new(false), dropped_frames(0),
+			next_decode_frame(0), next_queued_frame(0), num_decode_threads(0), capture_memory(CAPTURE_CAPACITY), frame_num(0), vid_length(0), start_time(0),
+			is_webcam(false), is_image_seq(false) {};
 
 		// Destructor
 		~SequenceCapture();
 
-		// Opening based on command line arguments
+		// Opening based on command line arguments, the capture options (-live, -decode_threads, -capture_memory) not among them are back to their defaults
 		bool Open(std::vector<std::string>& arguments);
 
 		// Direct opening
@@ -91,6 +97,9 @@ namespace Utilities
 
 		size_t GetFrameNumber() { return frame_num; }
 
+		// In live webcam mode, the number of frames that were dropped because processing could not keep up (since the sequence was opened)
+		size_t GetDroppedFrames() const { return dropped_frames; }
+
 		bool IsOpened();
 
 		void Close();
@@ -110,6 +119,10 @@ namespace Utilities
 		// Allows to differentiate if failed because no input specified or if failed to open a specified input
 		bool no_input_specified;
 
+		// Live webcam mode (-live), frames are captured continuously and only the newest one is kept, so that the latency stays at one frame
+		// even if processing is slower than the camera, time_stamp is then the time the frame was captured
+		bool live_mode;
+
 				// Storing the captured data queue
 		static const int CAPTURE_CAPACITY = 200; // 200 MB
 
@@ -117,8 +130,8 @@ namespace Utilities
 
 		// For faster input, multi-thread the capture so it is not waiting for processing to be done
 
-		// Used to keep track if the recording is still going (for the writing threads)
-		bool capturing;
+		// Used to keep track if the recording is still going (set and read by the capture and decoding threads as well as Close)
+		std::atomic<bool> capturing;
 
 		// For keeping track of tasks
 		std::thread capture_thread;
@@ -126,6 +139,35 @@ namespace Utilities
 		// A thread that will write video output, so that the rest of the application does not block on it
 		void CaptureThread();
 
+		// Capturing from a webcam in live mode, replaces the latest frame if it was not processed yet
+		void LiveCaptureThread();
+
+		std::mutex live_frame_mutex;
+		std::condition_variable live_frame_cond;
+		cv::Mat live_frame;
+		double live_time_stamp;
+		bool live_frame_new;
+		std::atomic<size_t> dropped_frames;
+
+		// Image sequences are decoded by several threads ahead of processing, the frames are still handed to the queue in order
+		std::vector<std::thread> decode_threads;
+		void DecodeThread();
+
+		// The next image to be decoded and the next one to be placed on the queue
+		std::atomic<size_t> next_decode_frame;
+		size_t next_queued_frame;
+		std::mutex decode_order_mutex;
+		std::condition_variable decode_order_cond;
+
+		// Number of decoding threads for image sequences (-decode_threads, 0 picks it based on the number of cores)
+		int num_decode_threads;
+
+		// The memory in MB that captured frames can take up (-capture_memory), this includes the frames being decoded
+		int capture_memory;
+
+		// How many frames fit in the capture memory
+		int CaptureQueueCapacity(int frames_in_flight) const;
+
 		// Blocking copy and move, as it doesn't make sense to have several readers pointed at the same source, and this would cause issues, especially with webcams
 		SequenceCapture & operator= (const SequenceCapture& other);
 		SequenceCapture & operator= (const SequenceCapture&& other);
@@ -139,8 +181,12 @@ namespace Utilities
 		cv::Mat latest_frame;
 		cv::Mat_<uchar> latest_gray_frame;
 		
-		// Storing capture timestamp, RGB image, gray image
-		ConcurrentQueue<std::tuple<double, cv::Mat, cv::Mat_<uchar> > > capture_queue;
+		// Storing capture timestamp, RGB image, gray image, the queue is single producer so the decoding threads only push to it
+		// while holding decode_order_mutex (the capture thread is the only producer otherwise)
+		ConcurrentQueue<std::tuple<double, cv::Mat, cv::Mat_<uchar> >, true> capture_queue;
+
+		// The captured frames are recycled once processing (and recording) is done with them
+		FramePool frame_pool;
 
 		// Keeping track of frame number and the files in the image sequence
 		size_t  frame_num;
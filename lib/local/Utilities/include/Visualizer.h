@@ -36,11 +36,15 @@
 
 // System includes
 #include <vector>
+#include <functional>
 
 // OpenCV includes
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include "FramePool.h"
+#include "AUSchema.h"
+
 namespace Utilities
 {
 
@@ -67,7 +71,7 @@ namespace Utilities
 		// Pose related observations
 		void SetObservationPose(const cv::Vec6f& pose, double confidence);
 		
-		void SetObservationActionUnits(const std::vector<std::pair<std::string, double> >& au_intensities, const std::vector<std::pair<std::string, double> >& au_occurences);
+		void SetObservationActionUnits(const AUView& au_intensities, const AUView& au_occurences);
 
 		// Gaze related observations
 		void SetObservationGaze(const cv::Point3f& gazeDirection0, const cv::Point3f& gazeDirection1, const std::vector<cv::Point2f>& eye_landmarks, const std::vector<cv::Point3f>& eye_landmarks3d, double confidence);
@@ -97,8 +101,21 @@ namespace Utilities
 
 	private:
 
+		// Copy the frame and draw the recorded observations on it, done at most once per frame
+		void Render();
+
+		// The frame to draw on, only referenced until it is rendered
+		cv::Mat frame;
+
+		// Observations are recorded as draw commands and only drawn if the visualization is shown or recorded
+		std::vector<std::function<void(cv::Mat&)> > draw_commands;
+		bool rendered = false;
+
 		// Temporary variables for visualization
 		cv::Mat captured_image; // out canvas
+
+		// The canvases are recycled once they have been shown and recorded
+		FramePool canvas_pool;
 		cv::Mat tracked_image;
 		cv::Mat hog_image;
 		cv::Mat aligned_face_image;
@@ -0,0 +1,376 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Tadas Baltrusaitis, all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "stdafx_ut.h"
+
+#include "AlignedArchive.h"
+
+#include <opencv2/imgcodecs.hpp>
+
+using namespace Utilities;
+
+#define WARN_STREAM( stream ) \
+std::cout << "Warning: " << stream << std::endl
+
+namespace
+{
+	const int ARCHIVE_VERSION = 1;
+
+	// Every record of a chunk, frame number, face id, success, rows, cols, type (4 bytes each) and data size (8 bytes)
+	const int RECORD_HEADER_SIZE = 6 * 4 + 8;
+
+	// Every entry of the index, as the record header with the data offset before the size
+	const int INDEX_ENTRY_SIZE = 6 * 4 + 8 + 8;
+
+	// Index offset (8 bytes) and the end tag
+	const int TRAILER_SIZE = 8 + 4;
+
+	void WriteInt(std::ostream& stream, int value)
+	{
+		stream.write((char*)(&value), 4);
+	}
+
+	void WriteLong(std::ostream& stream, long long value)
+	{
+		stream.write((char*)(&value), 8);
+	}
+
+	bool ReadInt(std::istream& stream, int& value)
+	{
+		return (bool)stream.read((char*)(&value), 4);
+	}
+
+	bool ReadLong(std::istream& stream, long long& value)
+	{
+		return (bool)stream.read((char*)(&value), 8);
+	}
+
+	bool ReadTag(std::istream& stream, const char* tag)
+	{
+		char read_tag[4];
+		if (!stream.read(read_tag, 4))
+			return false;
+		return std::equal(read_tag, read_tag + 4, tag);
+	}
+}
+
+// Default constructor initializes the variables
+AlignedArchiveWriter::AlignedArchiveWriter() :archive_file() {}
+
+AlignedArchiveWriter::~AlignedArchiveWriter()
+{
+	this->Close();
+}
+
+// Opening the file and writing the header for it
+bool AlignedArchiveWriter::Open(const std::string& filename, const std::string& format)
+{
+	this->format = format;
+	this->index.clear();
+
+	archive_file.open(filename, std::ios_base::out | std::ios_base::binary);
+
+	if (!archive_file.is_open())
+	{
+		return false;
+	}
+
+	archive_file.write("OFAA", 4);
+	WriteInt(archive_file, ARCHIVE_VERSION);
+	WriteInt(archive_file, (int)format.size());
+	archive_file.write(format.data(), format.size());
+
+	return true;
+}
+
+bool AlignedArchiveWriter::Encode(const cv::Mat& aligned_face, const std::string& format, std::vector<uchar>& data)
+{
+	if (format.compare("raw") == 0)
+	{
+		// Just the pixels, row by row
+		cv::Mat face = aligned_face.isContinuous() ? aligned_face : aligned_face.clone();
+		data.assign(face.data, face.data + face.total() * face.elemSize());
+		return true;
+	}
+	else
+	{
+		return cv::imencode("." + format, aligned_face, data);
+	}
+}
+
+void AlignedArchiveWriter::WriteChunk(const std::vector<AlignedArchiveEntry>& entries, const std::vector<std::vector<uchar> >& data)
+{
+	if (!archive_file.is_open() || entries.empty())
+	{
+		return;
+	}
+
+	archive_file.write("CHNK", 4);
+	WriteInt(archive_file, (int)entries.size());
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		AlignedArchiveEntry entry = entries[i];
+		entry.size = (long long)data[i].size();
+		entry.offset = (long long)archive_file.tellp() + RECORD_HEADER_SIZE;
+
+		WriteInt(archive_file, entry.frame_number);
+		WriteInt(archive_file, entry.face_id);
+		WriteInt(archive_file, entry.success ? 1 : 0);
+		WriteInt(archive_file, entry.rows);
+		WriteInt(archive_file, entry.cols);
+		WriteInt(archive_file, entry.type);
+		WriteLong(archive_file, entry.size);
+		archive_file.write((const char*)data[i].data(), data[i].size());
+
+		index.push_back(entry);
+	}
+}
+
+void AlignedArchiveWriter::Write(int frame_number, int face_id, bool success, const cv::Mat& aligned_face)
+{
+	std::vector<std::vector<uchar> > data(1);
+	if (!Encode(aligned_face, format, data[0]))
+	{
+		WARN_STREAM("Could not encode similarity aligned image");
+		return;
+	}
+
+	AlignedArchiveEntry entry;
+	entry.frame_number = frame_number;
+	entry.face_id = face_id;
+	entry.success = success;
+	entry.rows = aligned_face.rows;
+	entry.cols = aligned_face.cols;
+	entry.type = aligned_face.type();
+	entry.offset = 0;
+	entry.size = 0;
+
+	WriteChunk(std::vector<AlignedArchiveEntry>(1, entry), data);
+}
+
+void AlignedArchiveWriter::Close()
+{
+	if (!archive_file.is_open())
+	{
+		return;
+	}
+
+	long long index_offset = (long long)archive_file.tellp();
+
+	archive_file.write("INDX", 4);
+	WriteLong(archive_file, (long long)index.size());
+	for (size_t i = 0; i < index.size(); ++i)
+	{
+		WriteInt(archive_file, index[i].frame_number);
+		WriteInt(archive_file, index[i].face_id);
+		WriteInt(archive_file, index[i].success ? 1 : 0);
+		WriteInt(archive_file, index[i].rows);
+		WriteInt(archive_file, index[i].cols);
+		WriteInt(archive_file, index[i].type);
+		WriteLong(archive_file, index[i].offset);
+		WriteLong(archive_file, index[i].size);
+	}
+
+	WriteLong(archive_file, index_offset);
+	archive_file.write("OFAE", 4);
+
+	archive_file.close();
+	index.clear();
+}
+
+AlignedArchiveReader::AlignedArchiveReader() :archive_file(), data_start(0) {}
+
+bool AlignedArchiveReader::Open(const std::string& filename)
+{
+	index.clear();
+	format = "";
+
+	archive_file.open(filename, std::ios_base::in | std::ios_base::binary);
+
+	if (!archive_file.is_open())
+	{
+		return false;
+	}
+
+	int version, format_length;
+	if (!ReadTag(archive_file, "OFAA") || !ReadInt(archive_file, version) || version != ARCHIVE_VERSION || !ReadInt(archive_file, format_length) || format_length < 0)
+	{
+		WARN_STREAM("Not an aligned face archive: " << filename);
+		archive_file.close();
+		return false;
+	}
+
+	format.resize(format_length);
+	archive_file.read(&format[0], format_length);
+	data_start = (long long)archive_file.tellg();
+
+	archive_file.seekg(0, std::ios_base::end);
+	long long file_size = (long long)archive_file.tellg();
+
+	if (!ReadIndex(file_size))
+	{
+		WARN_STREAM("The aligned face archive was not closed properly, reconstructing the index: " << filename);
+		ScanChunks(file_size);
+	}
+
+	return true;
+}
+
+void AlignedArchiveReader::Close()
+{
+	archive_file.close();
+	index.clear();
+}
+
+bool AlignedArchiveReader::ReadIndex(long long file_size)
+{
+	archive_file.clear();
+	if (file_size < data_start + TRAILER_SIZE)
+	{
+		return false;
+	}
+
+	long long index_offset;
+	archive_file.seekg(file_size - TRAILER_SIZE);
+	if (!ReadLong(archive_file, index_offset) || !ReadTag(archive_file, "OFAE") || index_offset < data_start || index_offset > file_size - TRAILER_SIZE)
+	{
+		return false;
+	}
+
+	long long num_faces;
+	archive_file.seekg(index_offset);
+	if (!ReadTag(archive_file, "INDX") || !ReadLong(archive_file, num_faces) || num_faces < 0 || num_faces * INDEX_ENTRY_SIZE > file_size - index_offset)
+	{
+		return false;
+	}
+
+	index.resize((size_t)num_faces);
+	for (size_t i = 0; i < index.size(); ++i)
+	{
+		int success;
+		ReadInt(archive_file, index[i].frame_number);
+		ReadInt(archive_file, index[i].face_id);
+		ReadInt(archive_file, success);
+		ReadInt(archive_file, index[i].rows);
+		ReadInt(archive_file, index[i].cols);
+		ReadInt(archive_file, index[i].type);
+		ReadLong(archive_file, index[i].offset);
+		ReadLong(archive_file, index[i].size);
+		index[i].success = success != 0;
+	}
+
+	if (!archive_file)
+	{
+		index.clear();
+		return false;
+	}
+
+	return true;
+}
+
+void AlignedArchiveReader::ScanChunks(long long file_size)
+{
+	archive_file.clear();
+	archive_file.seekg(data_start);
+
+	// Keep reading until the index, the end of the file, or a chunk cut short
+	int num_records;
+	while (ReadTag(archive_file, "CHNK") && ReadInt(archive_file, num_records))
+	{
+		for (int i = 0; i < num_records; ++i)
+		{
+			AlignedArchiveEntry entry;
+			int success;
+			ReadInt(archive_file, entry.frame_number);
+			ReadInt(archive_file, entry.face_id);
+			ReadInt(archive_file, success);
+			ReadInt(archive_file, entry.rows);
+			ReadInt(archive_file, entry.cols);
+			ReadInt(archive_file, entry.type);
+			ReadLong(archive_file, entry.size);
+			entry.success = success != 0;
+			entry.offset = (long long)archive_file.tellg();
+
+			if (!archive_file || entry.size < 0 || entry.offset + entry.size > file_size)
+			{
+				archive_file.clear();
+				return;
+			}
+
+			index.push_back(entry);
+			archive_file.seekg(entry.offset + entry.size);
+		}
+	}
+	archive_file.clear();
+}
+
+bool AlignedArchiveReader::ReadData(size_t i, std::vector<uchar>& data)
+{
+	if (i >= index.size())
+	{
+		return false;
+	}
+
+	data.resize((size_t)index[i].size);
+	archive_file.clear();
+	archive_file.seekg(index[i].offset);
+	archive_file.read((char*)data.data(), data.size());
+
+	return (bool)archive_file;
+}
+
+bool AlignedArchiveReader::Read(size_t i, cv::Mat& aligned_face)
+{
+	std::vector<uchar> data;
+	if (!ReadData(i, data))
+	{
+		return false;
+	}
+
+	if (format.compare("raw") == 0)
+	{
+		cv::Mat face(index[i].rows, index[i].cols, index[i].type);
+		if (data.size() != face.total() * face.elemSize())
+		{
+			return false;
+		}
+		std::copy(data.begin(), data.end(), face.data);
+		aligned_face = face;
+	}
+	else
+	{
+		aligned_face = cv::imdecode(data, cv::IMREAD_UNCHANGED);
+	}
+
+	return !aligned_face.empty();
+}
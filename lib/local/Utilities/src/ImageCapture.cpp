@@ -339,6 +339,65 @@ void ImageCapture::SetCameraIntrinsics(float fx, float fy, float cx, float cy)
 	}
 }
 
+bool ImageCapture::ReadImage(size_t image_index, cv::Mat& rgb_image, cv::Mat_<uchar>& gray_image, std::string& image_name,
+	std::vector<cv::Rect_<float> >& image_bounding_boxes, float& image_fx, float& image_fy, float& image_cx, float& image_cy) const
+{
+	if (image_index >= image_files.size())
+	{
+		return false;
+	}
+
+	// Load the image as an 8 bit RGB
+	rgb_image = cv::imread(image_files[image_index], cv::IMREAD_COLOR);
+
+	if (rgb_image.empty())
+	{
+		ERROR_STREAM("Could not open the image: " + image_files[image_index]);
+		return false;
+	}
+
+	int width = rgb_image.size().width;
+	int height = rgb_image.size().height;
+
+	// Same as in SetCameraIntrinsics, but without changing the state of the reader
+	if (image_optical_center_set)
+	{
+		image_cx = cx;
+		image_cy = cy;
+	}
+	else
+	{
+		image_cx = width / 2.0f;
+		image_cy = height / 2.0f;
+	}
+
+	if (image_focal_length_set)
+	{
+		image_fx = fx;
+		image_fy = fy;
+	}
+	else
+	{
+		image_fx = (500.0f * (width / 640.0f) + 500.0f * (height / 480.0f)) / 2.0f;
+		image_fy = image_fx;
+	}
+
+	ConvertToGrayscale_8bit(rgb_image, gray_image);
+
+	image_name = image_files[image_index];
+
+	if (!bounding_boxes.empty())
+	{
+		image_bounding_boxes = bounding_boxes[image_index];
+	}
+	else
+	{
+		image_bounding_boxes.clear();
+	}
+
+	return true;
+}
+
 // Returns a read image in 3 channel RGB format, also prepares a grayscale frame if needed
 cv::Mat ImageCapture::GetNextImage()
 {
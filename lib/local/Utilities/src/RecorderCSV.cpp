@@ -46,7 +46,7 @@ struct fullstop : std::numpunct<char> {
 
 // Opening the file and preparing the header for it
 bool RecorderCSV::Open(std::string output_file_name, bool is_sequence, bool output_2D_landmarks, bool output_3D_landmarks, bool output_model_params, bool output_pose, bool output_AUs, bool output_gaze,
-	int num_face_landmarks, int num_model_modes, int num_eye_landmarks, const std::vector<std::string>& au_names_class, const std::vector<std::string>& au_names_reg)
+	int num_face_landmarks, int num_model_modes, int num_eye_landmarks, const AUSchema& au_schema_class, const AUSchema& au_schema_reg, bool output_interpolated)
 {
 
 	output_file.open(output_file_name, std::ios_base::out);
@@ -64,14 +64,22 @@ bool RecorderCSV::Open(std::string output_file_name, bool is_sequence, bool outp
 	this->output_gaze = output_gaze;
 	this->output_model_params = output_model_params;
 	this->output_pose = output_pose;
+	this->output_interpolated = output_interpolated && is_sequence;
 
-	this->au_names_class = au_names_class;
-	this->au_names_reg = au_names_reg;
+	this->au_schema_class = au_schema_class;
+	this->au_schema_reg = au_schema_reg;
+	this->au_columns_class = AUColumns();
+	this->au_columns_reg = AUColumns();
 
 	// Different headers if we are writing out the results on a sequence or an individual image
 	if(this->is_sequence)
 	{
 		output_file << "frame, face_id, timestamp, confidence, success";
+
+		if (this->output_interpolated)
+		{
+			output_file << ", interpolated";
+		}
 	}
 	else
 	{
@@ -150,16 +158,14 @@ bool RecorderCSV::Open(std::string output_file_name, bool is_sequence, bool outp
 
 	if (output_AUs)
 	{
-		std::sort(this->au_names_reg.begin(), this->au_names_reg.end());
-		for (std::string reg_name : this->au_names_reg)
+		for (int id : this->au_schema_reg.SortedIds())
 		{
-			output_file << ", " << reg_name << "_r";
+			output_file << ", " << this->au_schema_reg.Name(id) << "_r";
 		}
 
-		std::sort(this->au_names_class.begin(), this->au_names_class.end());
-		for (std::string class_name : this->au_names_class)
+		for (int id : this->au_schema_class.SortedIds())
 		{
-			output_file << ", " << class_name << "_c";
+			output_file << ", " << this->au_schema_class.Name(id) << "_c";
 		}
 	}
 
@@ -172,7 +178,7 @@ bool RecorderCSV::Open(std::string output_file_name, bool is_sequence, bool outp
 void RecorderCSV::WriteLine(int face_id, int frame_num, double time_stamp, bool landmark_detection_success, double landmark_confidence,
 	const cv::Mat_<float>& landmarks_2D, const cv::Mat_<float>& landmarks_3D, const cv::Mat_<float>& pdm_model_params, const cv::Vec6f& rigid_shape_params, cv::Vec6f& pose_estimate,
 	const cv::Point3f& gazeDirection0, const cv::Point3f& gazeDirection1, const cv::Vec2f& gaze_angle, const std::vector<cv::Point2f>& eye_landmarks2d, const std::vector<cv::Point3f>& eye_landmarks3d,
-	const std::vector<std::pair<std::string, double> >& au_intensities, const std::vector<std::pair<std::string, double> >& au_occurences)
+	const AUView& au_intensities, const AUView& au_occurences, bool interpolated)
 {
 
 	if (!output_file.is_open())
@@ -193,6 +199,11 @@ void RecorderCSV::WriteLine(int face_id, int frame_num, double time_stamp, bool
 		output_file << ", " << landmark_confidence;
 		output_file << std::setprecision(0);
 		output_file << ", " << landmark_detection_success;
+
+		if (output_interpolated)
+		{
+			output_file << ", " << interpolated;
+		}
 	}
 	else
 	{
@@ -287,51 +298,46 @@ void RecorderCSV::WriteLine(int face_id, int frame_num, double time_stamp, bool
 	if (output_AUs)
 	{
 
-		// write out ar the correct index
 		output_file.precision(2);
-		for (std::string au_name : au_names_reg)
-		{
-			for (auto au_reg : au_intensities)
-			{
-				if (au_name.compare(au_reg.first) == 0)
-				{
-					output_file << ", " << au_reg.second;
-					break;
-				}
-			}
-		}
+		WriteActionUnits(au_schema_reg, au_columns_reg, au_intensities);
 
-		if (au_intensities.size() == 0)
+		output_file.precision(1);
+		WriteActionUnits(au_schema_class, au_columns_class, au_occurences);
+	}
+	output_file << std::endl;
+}
+
+// Write out the AU predictions in the column order of the header
+void RecorderCSV::WriteActionUnits(const AUSchema& au_schema, AUColumns& au_columns, const AUView& au_predictions)
+{
+	if (au_predictions.empty())
+	{
+		for (size_t p = 0; p < au_schema.size(); ++p)
 		{
-			for (size_t p = 0; p < au_names_reg.size(); ++p)
-			{
-				output_file << ", 0";
-			}
+			output_file << ", 0";
 		}
+		return;
+	}
 
-		output_file.precision(1);
-		// write out ar the correct index
-		for (std::string au_name : au_names_class)
+	// The predictions normally come through the same schema object for every row, so the columns are only matched up by name once
+	if (&au_predictions.Schema() != au_columns.source)
+	{
+		const AUSchema& au_schema_pred = au_predictions.Schema();
+		au_columns.ids.clear();
+		for (int id : au_schema.SortedIds())
 		{
-			for (auto au_class : au_occurences)
-			{
-				if (au_name.compare(au_class.first) == 0)
-				{
-					output_file << ", " << au_class.second;
-					break;
-				}
-			}
+			au_columns.ids.push_back(au_schema_pred.Find(au_schema.Name(id)));
 		}
+		au_columns.source = &au_schema_pred;
+	}
 
-		if (au_occurences.size() == 0)
+	for (int id_pred : au_columns.ids)
+	{
+		if (id_pred >= 0)
 		{
-			for (size_t p = 0; p < au_names_class.size(); ++p)
-			{
-				output_file << ", 0";
-			}
+			output_file << ", " << au_predictions[id_pred];
 		}
 	}
-	output_file << std::endl;
 }
 
 // Closing the file and cleaning up
@@ -39,6 +39,17 @@ using namespace Utilities;
 #define WARN_STREAM( stream ) \
 std::cout << "Warning: " << stream << std::endl
 
+// Pushing to an output queue, keeping track of how long recording was blocked for and of how many items were waiting
+template<typename T>
+void PushOutput(ConcurrentQueue<T>& queue, const T& item, double& stall_time, size_t& max_queue_depth)
+{
+	auto start = std::chrono::steady_clock::now();
+	queue.push(item);
+	stall_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	max_queue_depth = std::max(max_queue_depth, queue.size());
+}
+
 void CreateDirectory(std::string output_path)
 {
 	// Removing trailing separators, as that causes issues with directory creation in unix
@@ -96,23 +107,72 @@ void RecorderOpenFace::VideoWritingTask(bool is_sequence)
 void RecorderOpenFace::AlignedImageWritingTask()
 {
 
-	std::pair<std::string, cv::Mat> tracked_data;
+	AlignedFaceOutput aligned_data;
+
+	// When writing to an archive the faces are encoded and appended in chunks, with several of these threads the chunks
+	// end up in the archive out of frame order (every entry keeps its frame number and face id)
+	std::vector<AlignedArchiveEntry> chunk_entries;
+	std::vector<std::vector<uchar> > chunk_data;
 
 	while (true)
 	{
-		aligned_face_queue.pop(tracked_data);
+		aligned_face_queue.pop(aligned_data);
 
 		// Empty frame indicates termination
-		if (tracked_data.second.empty())
+		if (aligned_data.aligned_face.empty())
 			break;
 
-		bool write_success = cv::imwrite(tracked_data.first, tracked_data.second);
+		if (params.outputAlignedArchive())
+		{
+			std::vector<uchar> data;
+			if (!AlignedArchiveWriter::Encode(aligned_data.aligned_face, aligned_archive.GetFormat(), data))
+			{
+				WARN_STREAM("Could not encode similarity aligned image");
+				continue;
+			}
 
-		if (!write_success)
+			AlignedArchiveEntry entry;
+			entry.frame_number = aligned_data.frame_number;
+			entry.face_id = aligned_data.face_id;
+			entry.success = aligned_data.success;
+			entry.rows = aligned_data.aligned_face.rows;
+			entry.cols = aligned_data.aligned_face.cols;
+			entry.type = aligned_data.aligned_face.type();
+			chunk_entries.push_back(entry);
+			chunk_data.push_back(std::move(data));
+
+			// Write out the chunk once it is full or nothing else is waiting
+			if (chunk_entries.size() >= ALIGNED_ARCHIVE_CHUNK || aligned_face_queue.empty())
+			{
+				std::lock_guard<std::mutex> lock(aligned_archive_mutex);
+				aligned_archive.WriteChunk(chunk_entries, chunk_data);
+				chunk_entries.clear();
+				chunk_data.clear();
+			}
+		}
+		else
 		{
-			WARN_STREAM("Could not output similarity aligned image image");
+			bool write_success = cv::imwrite(aligned_data.filename, aligned_data.aligned_face);
+
+			if (!write_success)
+			{
+				WARN_STREAM("Could not output similarity aligned image image");
+			}
 		}
 	}
+
+	std::lock_guard<std::mutex> lock(aligned_archive_mutex);
+	aligned_archive.WriteChunk(chunk_entries, chunk_data);
+}
+
+int RecorderOpenFace::NumberOfEncodeThreads() const
+{
+	int num_threads = params.encodeThreads();
+	if (num_threads <= 0)
+	{
+		num_threads = std::min(std::max((int)std::thread::hardware_concurrency() / 4, 1), 4);
+	}
+	return num_threads;
 }
 
 void RecorderOpenFace::PrepareRecording(const std::string& in_filename)
@@ -186,7 +246,17 @@ void RecorderOpenFace::PrepareRecording(const std::string& in_filename)
 	}
 
 	// Prepare image recording
-	if (params.outputAlignedFaces())
+	if (params.outputAlignedFaces() && params.outputAlignedArchive())
+	{
+		std::string archive_filename = out_name + "_aligned.faces";
+		metadata_file << "Output aligned archive:" << archive_filename << std::endl;
+		archive_filename = (fs::path(record_root) / archive_filename).string();
+		if (!aligned_archive.Open(archive_filename, params.imageFormatAligned()))
+		{
+			WARN_STREAM("Could not open the aligned face archive " << archive_filename);
+		}
+	}
+	else if (params.outputAlignedFaces())
 	{
 		aligned_output_directory = out_name + "_aligned";
 		metadata_file << "Output aligned directory:" << this->aligned_output_directory << std::endl;
@@ -195,11 +265,17 @@ void RecorderOpenFace::PrepareRecording(const std::string& in_filename)
 	}
 
 	this->frame_number = 0;
+	this->interpolated = false;
 	this->tracked_writing_thread_started = false;
 	this->aligned_writing_thread_started = false;
+
+	this->tracked_stall_time = 0;
+	this->aligned_stall_time = 0;
+	this->tracked_max_queue_depth = 0;
+	this->aligned_max_queue_depth = 0;
 }
 
-RecorderOpenFace::RecorderOpenFace(const std::string in_filename, const RecorderOpenFaceParameters& parameters, std::vector<std::string>& arguments):video_writer(), params(parameters)
+RecorderOpenFace::RecorderOpenFace(const std::string in_filename, const RecorderOpenFaceParameters& parameters, std::vector<std::string>& arguments):video_writer(), params(parameters), au_schema_reg_source(nullptr), au_schema_class_source(nullptr)
 {
 
 	// From the filename, strip out the name without directory and extension
@@ -259,7 +335,7 @@ RecorderOpenFace::RecorderOpenFace(const std::string in_filename, const Recorder
 
 }
 
-RecorderOpenFace::RecorderOpenFace(const std::string in_filename, const RecorderOpenFaceParameters& parameters, std::string output_directory):video_writer(), params(parameters)
+RecorderOpenFace::RecorderOpenFace(const std::string in_filename, const RecorderOpenFaceParameters& parameters, std::string output_directory):video_writer(), params(parameters), au_schema_reg_source(nullptr), au_schema_class_source(nullptr)
 {
 	// From the filename, strip out the name without directory and extension
 	if (fs::is_directory(in_filename))
@@ -306,22 +382,6 @@ void RecorderOpenFace::WriteObservation()
 		int num_eye_landmarks = (int)eye_landmarks2D.size();
 		int num_model_modes = pdm_params_local.rows;
 
-		std::vector<std::string> au_names_class;
-		for (auto au : au_occurences)
-		{
-			au_names_class.push_back(au.first);
-		}
-
-		std::sort(au_names_class.begin(), au_names_class.end());
-
-		std::vector<std::string> au_names_reg;
-		for (auto au : au_intensities)
-		{
-			au_names_reg.push_back(au.first);
-		}
-
-		std::sort(au_names_reg.begin(), au_names_reg.end());
-
 		metadata_file << "Output csv:" << csv_filename << std::endl;
 		metadata_file << "Gaze: " << params.outputGaze() << std::endl;
 		metadata_file << "AUs: " << params.outputAUs() << std::endl;
@@ -329,23 +389,25 @@ void RecorderOpenFace::WriteObservation()
 		metadata_file << "Landmarks 3D: " << params.output3DLandmarks() << std::endl;
 		metadata_file << "Pose: " << params.outputPose() << std::endl;
 		metadata_file << "Shape parameters: " << params.outputPDMParams() << std::endl;
+		metadata_file << "Interpolated frames: " << params.outputInterpolated() << std::endl;
 
 		csv_filename = (fs::path(record_root) / csv_filename).string();
 		csv_recorder.Open(csv_filename, params.isSequence(), params.output2DLandmarks(), params.output3DLandmarks(), params.outputPDMParams(), params.outputPose(),
-			params.outputAUs(), params.outputGaze(), num_face_landmarks, num_model_modes, num_eye_landmarks, au_names_class, au_names_reg);
+			params.outputAUs(), params.outputGaze(), num_face_landmarks, num_model_modes, num_eye_landmarks, au_schema_class, au_schema_reg, params.outputInterpolated());
 	}
 
 	this->csv_recorder.WriteLine(face_id, frame_number, timestamp, landmark_detection_success, 
 		landmark_detection_confidence, landmarks_2D, landmarks_3D, pdm_params_local, pdm_params_global, head_pose,
-		gaze_direction0, gaze_direction1, gaze_angle, eye_landmarks2D, eye_landmarks3D, au_intensities, au_occurences);
+		gaze_direction0, gaze_direction1, gaze_angle, eye_landmarks2D, eye_landmarks3D, 
+		AUView(au_schema_reg, au_intensities), AUView(au_schema_class, au_occurences), interpolated);
 
 	if(params.outputHOG())
 	{
 		this->hog_recorder.Write();
 	}
 
-	// Write aligned faces
-	if (params.outputAlignedFaces())
+	// Write aligned faces (there are none for interpolated frames)
+	if (params.outputAlignedFaces() && !interpolated)
 	{
 
 		if (!aligned_writing_thread_started)
@@ -354,24 +416,38 @@ void RecorderOpenFace::WriteObservation()
 			int capacity = (1024 * 1024 * ALIGNED_QUEUE_CAPACITY) / (aligned_face.size().width *aligned_face.size().height * aligned_face.channels()) + 1;
 			aligned_face_queue.set_capacity(capacity);
 
-			// Start the alignment output thread			
-			aligned_writing_thread = std::thread(&RecorderOpenFace::AlignedImageWritingTask, this);
+			// Start the alignment output threads, the faces can be encoded in any order
+			int num_threads = NumberOfEncodeThreads();
+			for (int i = 0; i < num_threads; ++i)
+			{
+				aligned_writing_threads.push_back(std::thread(&RecorderOpenFace::AlignedImageWritingTask, this));
+			}
 		}
 
-		char name[100];
+		AlignedFaceOutput aligned_data;
+		aligned_data.aligned_face = aligned_face;
+		aligned_data.frame_number = frame_number;
+		aligned_data.face_id = face_id;
+		aligned_data.success = landmark_detection_success;
 
-		// Filename is based on frame number (TODO stringstream this)
-		if(params.isSequence())
-			std::sprintf(name, "frame_det_%02d_%06d.", face_id, frame_number);
-		else
-			std::sprintf(name, "face_det_%06d.", face_id);
+		// The archive keeps the frame number and face id itself, otherwise they are in the filename
+		if (!params.outputAlignedArchive())
+		{
+			char name[100];
+
+			// Filename is based on frame number (TODO stringstream this)
+			if(params.isSequence())
+				std::sprintf(name, "frame_det_%02d_%06d.", face_id, frame_number);
+			else
+				std::sprintf(name, "face_det_%06d.", face_id);
 
-		// Construct the output filename
-		std::string out_file = (fs::path(aligned_output_directory) / fs::path(std::string(name) + params.imageFormatAligned())).string();
+			// Construct the output filename
+			aligned_data.filename = (fs::path(aligned_output_directory) / fs::path(std::string(name) + params.imageFormatAligned())).string();
+		}
 
 		if(params.outputBadAligned() || landmark_detection_success)
 		{
-			aligned_face_queue.push(std::pair<std::string, cv::Mat>(out_file, aligned_face));
+			PushOutput(aligned_face_queue, aligned_data, aligned_stall_time, aligned_max_queue_depth);
 		}
 
 		// Clear the image
@@ -379,6 +455,12 @@ void RecorderOpenFace::WriteObservation()
 
 	}
 
+	interpolated = false;
+}
+
+void RecorderOpenFace::SetObservationInterpolated(bool interpolated)
+{
+	this->interpolated = interpolated;
 }
 
 void RecorderOpenFace::WriteObservationTracked()
@@ -413,8 +495,12 @@ void RecorderOpenFace::WriteObservationTracked()
 				}
 			}
 
-			// Start the video and tracked image writing thread
-			video_writing_thread = std::thread(&RecorderOpenFace::VideoWritingTask, this, params.isSequence());
+			// Start the video and tracked image writing threads, a video has to be written by a single thread to keep the frames in order
+			int num_threads = params.isSequence() ? 1 : NumberOfEncodeThreads();
+			for (int i = 0; i < num_threads; ++i)
+			{
+				video_writing_threads.push_back(std::thread(&RecorderOpenFace::VideoWritingTask, this, params.isSequence()));
+			}
 
 		}
 
@@ -425,11 +511,11 @@ void RecorderOpenFace::WriteObservationTracked()
 
 		if (params.isSequence())
 		{
-			vis_to_out_queue.push(std::pair<std::string, cv::Mat>("", vis_to_out));
+			PushOutput(vis_to_out_queue, std::pair<std::string, cv::Mat>("", vis_to_out), tracked_stall_time, tracked_max_queue_depth);
 		}
 		else
 		{
-			vis_to_out_queue.push(std::pair<std::string, cv::Mat>(media_filename, vis_to_out));
+			PushOutput(vis_to_out_queue, std::pair<std::string, cv::Mat>(media_filename, vis_to_out), tracked_stall_time, tracked_max_queue_depth);
 		}
 
 		// Clear the output
@@ -477,11 +563,28 @@ void RecorderOpenFace::SetObservationPose(const cv::Vec6f& pose)
 	this->head_pose = pose;
 }
 
-void RecorderOpenFace::SetObservationActionUnits(const std::vector<std::pair<std::string, double> >& au_intensities,
-	const std::vector<std::pair<std::string, double> >& au_occurences)
+void RecorderOpenFace::SetObservationActionUnits(const AUView& au_intensities, const AUView& au_occurences)
 {
-	this->au_intensities = au_intensities;
-	this->au_occurences = au_occurences;
+	// The schemas are fixed for a model so are only copied the first time around (or when a different schema is passed in),
+	// the values reuse the storage of the previous frame
+	if (au_intensities.HasSchema() && &au_intensities.Schema() != this->au_schema_reg_source)
+	{
+		if (au_intensities.Schema() != this->au_schema_reg)
+		{
+			this->au_schema_reg = au_intensities.Schema();
+		}
+		this->au_schema_reg_source = &au_intensities.Schema();
+	}
+	if (au_occurences.HasSchema() && &au_occurences.Schema() != this->au_schema_class_source)
+	{
+		if (au_occurences.Schema() != this->au_schema_class)
+		{
+			this->au_schema_class = au_occurences.Schema();
+		}
+		this->au_schema_class_source = &au_occurences.Schema();
+	}
+	this->au_intensities.assign(au_intensities.data(), au_intensities.data() + au_intensities.size());
+	this->au_occurences.assign(au_occurences.data(), au_occurences.data() + au_occurences.size());
 }
 
 void RecorderOpenFace::SetObservationGaze(const cv::Point3f& gaze_direction0, const cv::Point3f& gaze_direction1,
@@ -502,19 +605,41 @@ RecorderOpenFace::~RecorderOpenFace()
 
 void RecorderOpenFace::Close()
 {
-	// Insert terminating frames to the queues
-	vis_to_out_queue.push(std::pair<std::string, cv::Mat>("", cv::Mat()));
-	aligned_face_queue.push(std::pair<std::string, cv::Mat>("", cv::Mat()));
+	// Insert terminating frames to the queues, one for every writing thread
+	for (size_t i = 0; i < video_writing_threads.size(); ++i)
+		vis_to_out_queue.push(std::pair<std::string, cv::Mat>("", cv::Mat()));
+	for (size_t i = 0; i < aligned_writing_threads.size(); ++i)
+		aligned_face_queue.push(AlignedFaceOutput());
 
 	// Make sure the recording threads complete
-	if (video_writing_thread.joinable())
-		video_writing_thread.join();
-	if (aligned_writing_thread.joinable())
-		aligned_writing_thread.join();
+	for (size_t i = 0; i < video_writing_threads.size(); ++i)
+		video_writing_threads[i].join();
+	for (size_t i = 0; i < aligned_writing_threads.size(); ++i)
+		aligned_writing_threads[i].join();
+	video_writing_threads.clear();
+	aligned_writing_threads.clear();
+
+	// Report how the output kept up with the tracking
+	if (tracked_writing_thread_started && metadata_file.is_open())
+	{
+		metadata_file << "Tracked output queue:max depth " << tracked_max_queue_depth << ", blocked for " << tracked_stall_time << "s" << std::endl;
+	}
+	if (aligned_writing_thread_started && metadata_file.is_open())
+	{
+		metadata_file << "Aligned output queue:max depth " << aligned_max_queue_depth << ", blocked for " << aligned_stall_time << "s" << std::endl;
+	}
+	if (tracked_stall_time + aligned_stall_time > 1.0)
+	{
+		WARN_STREAM("Writing the output blocked processing for " << tracked_stall_time + aligned_stall_time << "s, consider using more encoding threads (-encode_threads)");
+	}
+	tracked_stall_time = 0;
+	aligned_stall_time = 0;
 
 	tracked_writing_thread_started = false;
 	aligned_writing_thread_started = false;
 
+	// Only once all of the faces have been written can the archive index be written
+	aligned_archive.Close();
 	hog_recorder.Close();
 	csv_recorder.Close();
 	video_writer.release();
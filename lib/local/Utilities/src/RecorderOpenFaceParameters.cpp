@@ -59,6 +59,7 @@ RecorderOpenFaceParameters::RecorderOpenFaceParameters(std::vector<std::string>
 
 	this->image_format_aligned = "bmp";
 	this->image_format_visualization = "jpg";
+	this->num_encode_threads = 0;
 
 	bool output_set = false;
 
@@ -71,8 +72,10 @@ RecorderOpenFaceParameters::RecorderOpenFaceParameters(std::vector<std::string>
 	this->output_hog = false;
 	this->output_tracked = false;
 	this->output_aligned_faces = false;
+	this->output_aligned_archive = false;
 
 	this->record_aligned_bad = true;
+	this->output_interpolated = false;
 
 	for (size_t i = 0; i < arguments.size(); ++i)
 	{
@@ -86,6 +89,12 @@ RecorderOpenFaceParameters::RecorderOpenFaceParameters(std::vector<std::string>
 			this->image_format_visualization = arguments[i + 1];
 			i++;
 		}
+		if (arguments[i].compare("-encode_threads") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> this->num_encode_threads;
+			i++;
+		}
 		if (arguments[i].compare("-nobadaligned") == 0)
 		{
 			this->record_aligned_bad = false;
@@ -95,6 +104,12 @@ RecorderOpenFaceParameters::RecorderOpenFaceParameters(std::vector<std::string>
 			this->output_aligned_faces = true;
 			output_set = true;
 		}
+		else if (arguments[i].compare("-simalign_archive") == 0)
+		{
+			this->output_aligned_faces = true;
+			this->output_aligned_archive = true;
+			output_set = true;
+		}
 		else if (arguments[i].compare("-hogalign") == 0)
 		{
 			this->output_hog = true;
@@ -178,6 +193,7 @@ RecorderOpenFaceParameters::RecorderOpenFaceParameters(bool sequence, bool is_fr
 
 	this->image_format_aligned = "bmp";
 	this->image_format_visualization = "jpg";
+	this->num_encode_threads = 0;
 
 	this->output_2D_landmarks = output_2D_landmarks;
 	this->output_3D_landmarks = output_3D_landmarks;
@@ -188,4 +204,6 @@ RecorderOpenFaceParameters::RecorderOpenFaceParameters(bool sequence, bool is_fr
 	this->output_hog = output_hog;
 	this->output_tracked = output_tracked;
 	this->output_aligned_faces = output_aligned_faces;
+	this->output_aligned_archive = false;
+	this->output_interpolated = false;
 }
\ No newline at end of file
@@ -61,6 +61,11 @@ bool SequenceCapture::Open(std::vector<std::string>& arguments)
 	std::string input_root = "";
 	fx = -1; fy = -1; cx = -1; cy = -1;
 
+	// The capture options do not carry over from the previously opened sequence
+	live_mode = false;
+	num_decode_threads = 0;
+	capture_memory = CAPTURE_CAPACITY;
+
 	std::string separator = std::string(1, fs::path::preferred_separator);
 
 	// First check if there is a root argument (so that videos and input directories could be defined more easily)
@@ -152,6 +157,27 @@ bool SequenceCapture::Open(std::vector<std::string>& arguments)
 			valid[i + 1] = false;
 			i++;
 		}
+		else if (arguments[i].compare("-live") == 0)
+		{
+			live_mode = true;
+			valid[i] = false;
+		}
+		else if (arguments[i].compare("-decode_threads") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> num_decode_threads;
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-capture_memory") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> capture_memory;
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
 	}
 
 	for (int i = (int)arguments.size() - 1; i >= 0; --i)
@@ -208,6 +234,7 @@ bool SequenceCapture::OpenWebcam(int device, int image_width, int image_height,
 	no_input_specified = false;
 	frame_num = 0;
 	time_stamp = 0;
+	dropped_frames = 0;
 
 	if (device < 0)
 	{
@@ -257,6 +284,16 @@ bool SequenceCapture::OpenWebcam(int device, int image_width, int image_height,
 	start_time = cv::getTickCount();
 	capturing = true;
 
+	// Only the latest frame is in use when reading from a webcam (plus the ones the caller holds on to)
+	frame_pool.SetMaxBuffers(8);
+
+	if (live_mode)
+	{
+		live_frame = cv::Mat();
+		live_frame_new = false;
+		capture_thread = std::thread(&SequenceCapture::LiveCaptureThread, this);
+	}
+
 	return true;
 
 }
@@ -272,8 +309,31 @@ void SequenceCapture::Close()
 		capture_queue.pop();
 	}
 
+	// Wake up the consumer waiting for a live frame
+	{
+		std::unique_lock<std::mutex> lock(live_frame_mutex);
+		live_frame_cond.notify_all();
+	}
+
 	if (capture_thread.joinable())
 		capture_thread.join();
+
+	// Wake up the decoding threads waiting for their turn (they will see that capturing stopped)
+	{
+		std::unique_lock<std::mutex> lock(decode_order_mutex);
+		decode_order_cond.notify_all();
+	}
+	for (size_t i = 0; i < decode_threads.size(); ++i)
+	{
+		decode_threads[i].join();
+	}
+	decode_threads.clear();
+
+	// A decoding thread could have placed one more frame on the queue before stopping
+	while (!capture_queue.empty())
+	{
+		capture_queue.pop();
+	}
 	
 	// Release the capture objects
 	if (capture.isOpened())
@@ -294,6 +354,7 @@ bool SequenceCapture::OpenVideoFile(std::string video_file, float fx, float fy,
 	no_input_specified = false;
 	frame_num = 0;
 	time_stamp = 0;
+	dropped_frames = 0;
 
 	latest_frame = cv::Mat();
 	latest_gray_frame = cv::Mat();
@@ -328,6 +389,13 @@ bool SequenceCapture::OpenVideoFile(std::string video_file, float fx, float fy,
 	this->name = video_file;
 	capturing = true;
 
+	// The queue can only be resized before anybody uses it
+	int capacity = CaptureQueueCapacity(0);
+	capture_queue.set_capacity(capacity);
+
+	// The RGB and grayscale versions of every frame on the queue, and a few that are being processed
+	frame_pool.SetMaxBuffers(2 * (capacity + 4));
+
 	capture_thread = std::thread(&SequenceCapture::CaptureThread, this);
 
 	return true;
@@ -341,6 +409,7 @@ bool SequenceCapture::OpenImageSequence(std::string directory, float fx, float f
 	no_input_specified = false;
 	frame_num = 0;
 	time_stamp = 0;
+	dropped_frames = 0;
 
 	image_files.clear();
 
@@ -394,7 +463,25 @@ bool SequenceCapture::OpenImageSequence(std::string directory, float fx, float f
 	vid_length = image_files.size();
 	capturing = true;
 
-	capture_thread = std::thread(&SequenceCapture::CaptureThread, this);
+	// Decoding large images is slower than tracking, so decode several frames ahead in parallel
+	int num_threads = num_decode_threads;
+	if (num_threads <= 0)
+	{
+		num_threads = std::min(std::max((int)std::thread::hardware_concurrency() / 2, 1), 8);
+	}
+
+	// Every decoding thread holds on to a frame while waiting for its turn, that counts against the memory budget as well
+	int capacity = CaptureQueueCapacity(num_threads);
+	capture_queue.set_capacity(capacity);
+	frame_pool.SetMaxBuffers(capacity + num_threads + 4);
+
+	next_decode_frame = 0;
+	next_queued_frame = 0;
+
+	for (int i = 0; i < num_threads; ++i)
+	{
+		decode_threads.push_back(std::thread(&SequenceCapture::DecodeThread, this));
+	}
 	
 	return true;
 
@@ -429,48 +516,86 @@ void SequenceCapture::SetCameraIntrinsics(float fx, float fy, float cx, float cy
 	}
 }
 
-void SequenceCapture::CaptureThread()
+int SequenceCapture::CaptureQueueCapacity(int frames_in_flight) const
 {
-	int capacity = (CAPTURE_CAPACITY * 1024 * 1024) / (4 * frame_width * frame_height);
-	capture_queue.set_capacity(capacity);
+	// Every frame is stored as RGB and grayscale
+	size_t frame_size = 4 * (size_t)frame_width * (size_t)frame_height;
+	int capacity = (int)(((size_t)capture_memory * 1024 * 1024) / std::max(frame_size, (size_t)1)) - frames_in_flight;
 
-	int frame_num_int = 0;
+	return std::max(capacity, 1);
+}
 
-	while(capturing)
+void SequenceCapture::DecodeThread()
+{
+	while (capturing)
 	{
-		double timestamp_curr = 0;
+		size_t frame_ind = next_decode_frame++;
+
+		// Only a single thread signals the end of the sequence
+		if (frame_ind > image_files.size())
+			break;
+
 		cv::Mat tmp_frame;
 		cv::Mat_<uchar> tmp_gray_frame;
 
-		if (!is_image_seq)
+		// An empty image indicates the end of the sequence (or a failure to read it)
+		if (frame_ind < image_files.size())
 		{
-			bool success = capture.read(tmp_frame);
-
-			if (!success)
+			tmp_frame = cv::imread(image_files[frame_ind], cv::IMREAD_COLOR);
+			if (!tmp_frame.empty())
 			{
-				// Indicate lack of success by returning an empty image
-				tmp_frame = cv::Mat();
-				capturing = false;
+				tmp_gray_frame = frame_pool.Acquire(tmp_frame.rows, tmp_frame.cols, CV_8UC1);
 			}
+		}
 
-			// Recording the timestamp
-			timestamp_curr = frame_num_int * (1.0 / fps);			
+		ConvertToGrayscale_8bit(tmp_frame, tmp_gray_frame);
+
+		// Wait for the turn of this frame, so that the frames are processed in order
+		std::unique_lock<std::mutex> lock(decode_order_mutex);
+		decode_order_cond.wait(lock, [&]() { return next_queued_frame == frame_ind || !capturing; });
+
+		if (!capturing)
+			break;
+
+		// The queue is single producer, so the push has to stay under decode_order_mutex
+		capture_queue.push(std::make_tuple(0.0, tmp_frame, tmp_gray_frame));
+		next_queued_frame++;
+
+		if (tmp_frame.empty())
+		{
+			capturing = false;
 		}
-		else if (is_image_seq)
+
+		lock.unlock();
+		decode_order_cond.notify_all();
+	}
+}
+
+// Used for video files, image sequences use DecodeThread
+void SequenceCapture::CaptureThread()
+{
+	int frame_num_int = 0;
+
+	while(capturing)
+	{
+		double timestamp_curr = 0;
+
+		// Decode into recycled buffers (the capture only reallocates them if the frame size is different)
+		cv::Mat tmp_frame = frame_pool.Acquire(frame_height, frame_width, CV_8UC3);
+		cv::Mat_<uchar> tmp_gray_frame = frame_pool.Acquire(frame_height, frame_width, CV_8UC1);
+
+		bool success = capture.read(tmp_frame);
+
+		if (!success)
 		{
-			if (image_files.empty() || frame_num_int >= (int)image_files.size())
-			{
-				// Indicate lack of success by returning an empty image
-				tmp_frame = cv::Mat();
-				capturing = false;
-			}
-			else
-			{
-				tmp_frame = cv::imread(image_files[frame_num_int], cv::IMREAD_COLOR);
-			}
-			timestamp_curr = 0;
+			// Indicate lack of success by returning an empty image
+			tmp_frame = cv::Mat();
+			capturing = false;
 		}
 
+		// Recording the timestamp
+		timestamp_curr = frame_num_int * (1.0 / fps);			
+
 		frame_num_int++;
 		// Set the grayscale frame
 		ConvertToGrayscale_8bit(tmp_frame, tmp_gray_frame);
@@ -480,6 +605,39 @@ void SequenceCapture::CaptureThread()
 	}
 }
 
+void SequenceCapture::LiveCaptureThread()
+{
+	while (capturing)
+	{
+		cv::Mat tmp_frame = frame_pool.Acquire(frame_height, frame_width, CV_8UC3);
+		bool success = capture.read(tmp_frame);
+
+		// The time of capture, and not of when the frame gets processed
+		double timestamp_curr = (cv::getTickCount() - start_time) / cv::getTickFrequency();
+
+		if (!success)
+		{
+			// Indicate lack of success by returning an empty image
+			tmp_frame = cv::Mat();
+			capturing = false;
+		}
+
+		std::unique_lock<std::mutex> lock(live_frame_mutex);
+
+		// The latest frame wins, the previous one is dropped if it has not been processed
+		if (live_frame_new && !live_frame.empty())
+		{
+			dropped_frames++;
+		}
+		live_frame = tmp_frame;
+		live_time_stamp = timestamp_curr;
+		live_frame_new = true;
+
+		lock.unlock();
+		live_frame_cond.notify_one();
+	}
+}
+
 cv::Mat SequenceCapture::GetNextFrame()
 {
 	if(!is_webcam)
@@ -493,9 +651,35 @@ cv::Mat SequenceCapture::GetNextFrame()
 		latest_gray_frame = std::get<2>(data);
 
 	}
+	else if (live_mode)
+	{
+		// Wait for a frame that was not processed yet
+		std::unique_lock<std::mutex> lock(live_frame_mutex);
+		live_frame_cond.wait(lock, [&]() { return live_frame_new || !capturing; });
+
+		if (live_frame_new)
+		{
+			latest_frame = live_frame;
+			time_stamp = live_time_stamp;
+			live_frame_new = false;
+		}
+		else
+		{
+			latest_frame = cv::Mat();
+		}
+		lock.unlock();
+
+		if (!latest_frame.empty())
+		{
+			latest_gray_frame = frame_pool.Acquire(latest_frame.rows, latest_frame.cols, CV_8UC1);
+		}
+		ConvertToGrayscale_8bit(latest_frame, latest_gray_frame);
+	}
 	else
 	{
-		// Webcam does not use the threaded interface
+		// Webcam does not use the threaded interface, the previous frame could still be used elsewhere so read into a free buffer
+		latest_frame = frame_pool.Acquire(frame_height, frame_width, CV_8UC3);
+		latest_gray_frame = frame_pool.Acquire(frame_height, frame_width, CV_8UC1);
 		bool success = capture.read(latest_frame);
 
 		time_stamp = (cv::getTickCount() - start_time) / cv::getTickFrequency();
@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Tadas Baltrusaitis all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx_ut.h"
+
+#include "ServerJobs.h"
+
+namespace Utilities
+{
+
+	bool ReadJobArguments(std::istream& input, std::vector<std::string>& arguments, const std::string& executable)
+	{
+		std::string line;
+		while (std::getline(input, line))
+		{
+			std::vector<std::string> tokens;
+			std::string token;
+			bool in_quotes = false;
+			bool has_token = false;
+			for (char c : line)
+			{
+				if (c == '"')
+				{
+					in_quotes = !in_quotes;
+					has_token = true;
+				}
+				else if (!in_quotes && (c == ' ' || c == '\t' || c == '\r'))
+				{
+					if (has_token)
+						tokens.push_back(token);
+					token.clear();
+					has_token = false;
+				}
+				else
+				{
+					token += c;
+					has_token = true;
+				}
+			}
+			if (has_token)
+				tokens.push_back(token);
+
+			// A client sending an empty line (e.g. a stray newline) should not stop the server
+			if (tokens.empty())
+				continue;
+
+			if (tokens[0].compare("quit") == 0)
+				return false;
+
+			arguments.clear();
+			arguments.push_back(executable);
+			arguments.insert(arguments.end(), tokens.begin(), tokens.end());
+			return true;
+		}
+		return false;
+	}
+
+}
@@ -110,11 +110,13 @@ Visualizer::Visualizer(bool vis_track, bool vis_hog, bool vis_align, bool vis_au
 	this->vis_aus = vis_aus;
 }
 
-// Setting the image on which to draw
+// Setting the image on which to draw, it is only copied and drawn on once the visualization is actually needed (shown or recorded)
 void Visualizer::SetImage(const cv::Mat& canvas, float fx, float fy, float cx, float cy)
 {
-	// Convert the image to 8 bit RGB
-	captured_image = canvas.clone();
+	frame = canvas;
+	captured_image = cv::Mat();
+	draw_commands.clear();
+	rendered = false;
 
 	this->fx = fx;
 	this->fy = fy;
@@ -131,6 +133,12 @@ void Visualizer::SetImage(const cv::Mat& canvas, float fx, float fy, float cx, f
 
 void Visualizer::SetObservationFaceAlign(const cv::Mat& aligned_face)
 {
+	// Only ever shown
+	if (!vis_align)
+	{
+		return;
+	}
+
 	if(this->aligned_face_image.empty())
 	{
 		this->aligned_face_image = aligned_face;
@@ -160,46 +168,55 @@ void Visualizer::SetObservationHOG(const cv::Mat_<double>& hog_descriptor, int n
 }
 
 
-void Visualizer::SetObservationLandmarks(const cv::Mat_<float>& landmarks_2D, double confidence, const cv::Mat_<int>& visibilities)
+// Drawing the landmarks on the canvas
+static void DrawLandmarks(cv::Mat& canvas, const cv::Mat_<float>& landmarks_2D, const cv::Mat_<int>& visibilities)
 {
+	// Draw 2D landmarks on the image
+	int n = landmarks_2D.rows / 2;
 
-	if(confidence > visualisation_boundary)
+	// Drawing feature points
+	for (int i = 0; i < n; ++i)
 	{
-		// Draw 2D landmarks on the image
-		int n = landmarks_2D.rows / 2;
-
-		// Drawing feature points
-		for (int i = 0; i < n; ++i)
+		if (visibilities.empty() || visibilities.at<int>(i))
 		{
-			if (visibilities.empty() || visibilities.at<int>(i))
-			{
-				cv::Point featurePoint(cvRound(landmarks_2D.at<float>(i) * (float)draw_multiplier), cvRound(landmarks_2D.at<float>(i + n) * (float)draw_multiplier));
+			cv::Point featurePoint(cvRound(landmarks_2D.at<float>(i) * (float)draw_multiplier), cvRound(landmarks_2D.at<float>(i + n) * (float)draw_multiplier));
 
-				// A rough heuristic for drawn point size
-				int thickness = (int)std::ceil(3.0* ((double)captured_image.cols) / 640.0);
-				int thickness_2 = (int)std::ceil(1.0* ((double)captured_image.cols) / 640.0);
+			// A rough heuristic for drawn point size
+			int thickness = (int)std::ceil(3.0* ((double)canvas.cols) / 640.0);
+			int thickness_2 = (int)std::ceil(1.0* ((double)canvas.cols) / 640.0);
 
-				cv::circle(captured_image, featurePoint, 1 * draw_multiplier, cv::Scalar(0, 0, 255), thickness, cv::LINE_AA, draw_shiftbits);
-				cv::circle(captured_image, featurePoint, 1 * draw_multiplier, cv::Scalar(255, 0, 0), thickness_2, cv::LINE_AA, draw_shiftbits);
+			cv::circle(canvas, featurePoint, 1 * draw_multiplier, cv::Scalar(0, 0, 255), thickness, cv::LINE_AA, draw_shiftbits);
+			cv::circle(canvas, featurePoint, 1 * draw_multiplier, cv::Scalar(255, 0, 0), thickness_2, cv::LINE_AA, draw_shiftbits);
 
-			}
-			else
-			{
-				// Draw a fainter point if the landmark is self occluded
-				cv::Point featurePoint(cvRound(landmarks_2D.at<float>(i) * (double)draw_multiplier), cvRound(landmarks_2D.at<float>(i + n) * (double)draw_multiplier));
+		}
+		else
+		{
+			// Draw a fainter point if the landmark is self occluded
+			cv::Point featurePoint(cvRound(landmarks_2D.at<float>(i) * (double)draw_multiplier), cvRound(landmarks_2D.at<float>(i + n) * (double)draw_multiplier));
 
-				// A rough heuristic for drawn point size
-				int thickness = (int)std::ceil(2.5* ((double)captured_image.cols) / 640.0);
-				int thickness_2 = (int)std::ceil(1.0* ((double)captured_image.cols) / 640.0);
+			// A rough heuristic for drawn point size
+			int thickness = (int)std::ceil(2.5* ((double)canvas.cols) / 640.0);
+			int thickness_2 = (int)std::ceil(1.0* ((double)canvas.cols) / 640.0);
 
-				cv::circle(captured_image, featurePoint, 1 * draw_multiplier, cv::Scalar(0, 0, 155), thickness, cv::LINE_AA, draw_shiftbits);
-				cv::circle(captured_image, featurePoint, 1 * draw_multiplier, cv::Scalar(155, 0, 0), thickness_2, cv::LINE_AA, draw_shiftbits);
+			cv::circle(canvas, featurePoint, 1 * draw_multiplier, cv::Scalar(0, 0, 155), thickness, cv::LINE_AA, draw_shiftbits);
+			cv::circle(canvas, featurePoint, 1 * draw_multiplier, cv::Scalar(155, 0, 0), thickness_2, cv::LINE_AA, draw_shiftbits);
 
-			}
 		}
 	}
 }
 
+void Visualizer::SetObservationLandmarks(const cv::Mat_<float>& landmarks_2D, double confidence, const cv::Mat_<int>& visibilities)
+{
+
+	if(confidence > visualisation_boundary)
+	{
+		// The landmarks are copied, as they will only be drawn later
+		cv::Mat_<float> landmarks = landmarks_2D.clone();
+		cv::Mat_<int> visible = visibilities.clone();
+		draw_commands.push_back([landmarks, visible](cv::Mat& canvas) { DrawLandmarks(canvas, landmarks, visible); });
+	}
+}
+
 void Visualizer::SetObservationPose(const cv::Vec6f& pose, double confidence)
 {
 
@@ -213,34 +230,54 @@ void Visualizer::SetObservationPose(const cv::Vec6f& pose, double confidence)
 		// Scale from 0 to 1, to allow to indicated by colour how confident we are in the tracking
 		vis_certainty = (vis_certainty - visualisation_boundary) / (1 - visualisation_boundary);
 
-		// A rough heuristic for box around the face width
-		int thickness = (int)std::ceil(2.0* ((double)captured_image.cols) / 640.0);
-
 		// Draw it in reddish if uncertain, blueish if certain
-		DrawBox(captured_image, pose, cv::Scalar(vis_certainty*255.0, 0, (1 - vis_certainty) * 255), thickness, fx, fy, cx, cy);
+		cv::Scalar colour(vis_certainty*255.0, 0, (1 - vis_certainty) * 255);
+
+		float fx = this->fx, fy = this->fy, cx = this->cx, cy = this->cy;
+		draw_commands.push_back([pose, colour, fx, fy, cx, cy](cv::Mat& canvas)
+		{
+			// A rough heuristic for box around the face width
+			int thickness = (int)std::ceil(2.0* ((double)canvas.cols) / 640.0);
+
+			DrawBox(canvas, pose, colour, thickness, fx, fy, cx, cy);
+		});
 	}
 }
 
-void Visualizer::SetObservationActionUnits(const std::vector<std::pair<std::string, double> >& au_intensities,
-	const std::vector<std::pair<std::string, double> >& au_occurences)
+void Visualizer::SetObservationActionUnits(const AUView& au_intensities, const AUView& au_occurences)
 {
-	if (au_intensities.size() > 0 || au_occurences.size() > 0)
+	// Only ever shown
+	if (vis_aus && (!au_intensities.empty() || !au_occurences.empty()))
 	{
 
-		std::set<std::string> au_names;
-		std::map<std::string, bool> occurences_map;
-		std::map<std::string, double> intensities_map;
+		// Merge the AUs of both views by name (the schemas keep their ids sorted by name), -1 marks an AU missing from one of them
+		const std::vector<int> no_ids;
+		const std::vector<int>& ids_intensity = au_intensities.empty() ? no_ids : au_intensities.Schema().SortedIds();
+		const std::vector<int>& ids_occurence = au_occurences.empty() ? no_ids : au_occurences.Schema().SortedIds();
 
-		for (size_t idx = 0; idx < au_intensities.size(); idx++)
-		{
-			au_names.insert(au_intensities[idx].first);
-			intensities_map[au_intensities[idx].first] = au_intensities[idx].second;
-		}
+		std::vector<std::pair<int, int>> au_ids;
+		au_ids.reserve(ids_intensity.size() + ids_occurence.size());
 
-		for (size_t idx = 0; idx < au_occurences.size(); idx++)
+		size_t i = 0, o = 0;
+		while (i < ids_intensity.size() || o < ids_occurence.size())
 		{
-			au_names.insert(au_occurences[idx].first);
-			occurences_map[au_occurences[idx].first] = au_occurences[idx].second > 0;
+			int order;
+			if (i == ids_intensity.size())
+			{
+				order = 1;
+			}
+			else if (o == ids_occurence.size())
+			{
+				order = -1;
+			}
+			else
+			{
+				order = au_intensities.Name(ids_intensity[i]).compare(au_occurences.Name(ids_occurence[o]));
+			}
+
+			int id_intensity = order <= 0 ? ids_intensity[i++] : -1;
+			int id_occurence = order >= 0 ? ids_occurence[o++] : -1;
+			au_ids.push_back(std::make_pair(id_intensity, id_occurence));
 		}
 
 		const int AU_TRACKBAR_LENGTH = 400;
@@ -249,7 +286,7 @@ void Visualizer::SetObservationActionUnits(const std::vector<std::pair<std::stri
 		const int MARGIN_X = 185;
 		const int MARGIN_Y = 10;
 
-		const int nb_aus = (int) au_names.size();
+		const int nb_aus = (int) au_ids.size();
 
 		// Do not reinitialize
 		if (action_units_image.empty())
@@ -261,44 +298,34 @@ void Visualizer::SetObservationActionUnits(const std::vector<std::pair<std::stri
 			action_units_image.setTo(255);
 		}
 
-		std::map<std::string, std::pair<bool, double>> aus;
-
-		// first, prepare a mapping "AU name" -> { present, intensity }
-		for (auto au_name : au_names)
+		// build the graph, in the order of AU names
+		unsigned int idx = 0;
+		for (auto& au : au_ids)
 		{
-			// Insert the intensity and AU presense (as these do not always overlap check if they exist first)
-			bool occurence = false;
-			if (occurences_map.find(au_name) != occurences_map.end())
+			const std::string& name = au.first >= 0 ? au_intensities.Name(au.first) : au_occurences.Name(au.second);
+
+			// The intensity and AU presense (as these do not always overlap check if they exist first)
+			bool present = false;
+			if (au.second >= 0)
 			{
-				occurence = occurences_map[au_name] != 0;
+				present = au_occurences[au.second] > 0;
 			}
 			else
 			{
 				// If we do not have an occurence label, trust the intensity one
-				occurence = intensities_map[au_name] > 1;
+				present = au_intensities[au.first] > 1;
 			}
 			double intensity = 0.0;
-			if (intensities_map.find(au_name) != intensities_map.end())
+			if (au.first >= 0)
 			{
-				intensity = intensities_map[au_name];
+				intensity = au_intensities[au.first];
 			}
 			else
 			{
 				// If we do not have an intensity label, trust the occurence one
-				intensity = occurences_map[au_name] == 0 ? 0 : 5;
+				intensity = present ? 5 : 0;
 			}
 
-			aus[au_name] = std::make_pair(occurence, intensity);
-		}
-
-		// then, build the graph
-		unsigned int idx = 0;
-		for (auto& au : aus)
-		{
-			std::string name = au.first;
-			bool present = au.second.first;
-			double intensity = au.second.second;
-
 			int offset = MARGIN_Y + idx * (AU_TRACKBAR_HEIGHT + 10);
 			std::ostringstream au_i;
 			au_i << std::setprecision(2) << std::setw(4) << std::fixed << intensity;
@@ -324,78 +351,85 @@ void Visualizer::SetObservationActionUnits(const std::vector<std::pair<std::stri
 
 
 // Eye gaze infomration drawing, first of eye landmarks then of gaze
-void Visualizer::SetObservationGaze(const cv::Point3f& gaze_direction0, const cv::Point3f& gaze_direction1, const std::vector<cv::Point2f>& eye_landmarks2d, const std::vector<cv::Point3f>& eye_landmarks3d, double confidence)
+static void DrawGaze(cv::Mat& canvas, const cv::Point3f& gaze_direction0, const cv::Point3f& gaze_direction1, const std::vector<cv::Point2f>& eye_landmarks2d, const std::vector<cv::Point3f>& eye_landmarks3d,
+	float fx, float fy, float cx, float cy)
 {
-	if(confidence > visualisation_boundary)
+	// First draw the eye region landmarks
+	for (size_t i = 0; i < eye_landmarks2d.size(); ++i)
 	{
-		if (eye_landmarks2d.size() > 0)
-		{
-			// First draw the eye region landmarks
-			for (size_t i = 0; i < eye_landmarks2d.size(); ++i)
-			{
-				cv::Point featurePoint(cvRound(eye_landmarks2d[i].x * (double)draw_multiplier), cvRound(eye_landmarks2d[i].y * (double)draw_multiplier));
-
-				// A rough heuristic for drawn point size
-				int thickness = 1;
-				int thickness_2 = 1;
-
-				size_t next_point = i + 1;
-				if (i == 7)
-					next_point = 0;
-				if (i == 19)
-					next_point = 8;
-				if (i == 27)
-					next_point = 20;
-
-				if (i == 7 + 28)
-					next_point = 0 + 28;
-				if (i == 19 + 28)
-					next_point = 8 + 28;
-				if (i == 27 + 28)
-					next_point = 20 + 28;
-
-				cv::Point nextFeaturePoint(cvRound(eye_landmarks2d[next_point].x * (double)draw_multiplier), cvRound(eye_landmarks2d[next_point].y * (double)draw_multiplier));
-				if ((i < 28 && (i < 8 || i > 19)) || (i >= 28 && (i < 8 + 28 || i > 19 + 28)))
-					cv::line(captured_image, featurePoint, nextFeaturePoint, cv::Scalar(255, 0, 0), thickness_2, cv::LINE_AA, draw_shiftbits);
-				else
-					cv::line(captured_image, featurePoint, nextFeaturePoint, cv::Scalar(0, 0, 255), thickness_2, cv::LINE_AA, draw_shiftbits);
+		cv::Point featurePoint(cvRound(eye_landmarks2d[i].x * (double)draw_multiplier), cvRound(eye_landmarks2d[i].y * (double)draw_multiplier));
+
+		// A rough heuristic for drawn point size
+		int thickness = 1;
+		int thickness_2 = 1;
+
+		size_t next_point = i + 1;
+		if (i == 7)
+			next_point = 0;
+		if (i == 19)
+			next_point = 8;
+		if (i == 27)
+			next_point = 20;
+
+		if (i == 7 + 28)
+			next_point = 0 + 28;
+		if (i == 19 + 28)
+			next_point = 8 + 28;
+		if (i == 27 + 28)
+			next_point = 20 + 28;
+
+		cv::Point nextFeaturePoint(cvRound(eye_landmarks2d[next_point].x * (double)draw_multiplier), cvRound(eye_landmarks2d[next_point].y * (double)draw_multiplier));
+		if ((i < 28 && (i < 8 || i > 19)) || (i >= 28 && (i < 8 + 28 || i > 19 + 28)))
+			cv::line(canvas, featurePoint, nextFeaturePoint, cv::Scalar(255, 0, 0), thickness_2, cv::LINE_AA, draw_shiftbits);
+		else
+			cv::line(canvas, featurePoint, nextFeaturePoint, cv::Scalar(0, 0, 255), thickness_2, cv::LINE_AA, draw_shiftbits);
 
-			}
+	}
 
-			// Now draw the gaze lines themselves
-			cv::Mat cameraMat = (cv::Mat_<float>(3, 3) << fx, 0, cx, 0, fy, cy, 0, 0, 0);
+	// Now draw the gaze lines themselves
+	cv::Mat cameraMat = (cv::Mat_<float>(3, 3) << fx, 0, cx, 0, fy, cy, 0, 0, 0);
 
-			// Grabbing the pupil location, to draw eye gaze need to know where the pupil is
-			cv::Point3f pupil_left(0, 0, 0);
-			cv::Point3f pupil_right(0, 0, 0);
-			for (size_t i = 0; i < 8; ++i)
-			{
-				pupil_left = pupil_left + eye_landmarks3d[i];
-				pupil_right = pupil_right + eye_landmarks3d[i + eye_landmarks3d.size()/2];
-			}
-			pupil_left = pupil_left / 8;
-			pupil_right = pupil_right / 8;
+	// Grabbing the pupil location, to draw eye gaze need to know where the pupil is
+	cv::Point3f pupil_left(0, 0, 0);
+	cv::Point3f pupil_right(0, 0, 0);
+	for (size_t i = 0; i < 8; ++i)
+	{
+		pupil_left = pupil_left + eye_landmarks3d[i];
+		pupil_right = pupil_right + eye_landmarks3d[i + eye_landmarks3d.size()/2];
+	}
+	pupil_left = pupil_left / 8;
+	pupil_right = pupil_right / 8;
 
-			std::vector<cv::Point3f> points_left;
-			points_left.push_back(cv::Point3f(pupil_left));
-			points_left.push_back(cv::Point3f(pupil_left) + cv::Point3f(gaze_direction0)*50.0);
+	std::vector<cv::Point3f> points_left;
+	points_left.push_back(cv::Point3f(pupil_left));
+	points_left.push_back(cv::Point3f(pupil_left) + cv::Point3f(gaze_direction0)*50.0);
 
-			std::vector<cv::Point3f> points_right;
-			points_right.push_back(cv::Point3f(pupil_right));
-			points_right.push_back(cv::Point3f(pupil_right) + cv::Point3f(gaze_direction1)*50.0);
+	std::vector<cv::Point3f> points_right;
+	points_right.push_back(cv::Point3f(pupil_right));
+	points_right.push_back(cv::Point3f(pupil_right) + cv::Point3f(gaze_direction1)*50.0);
 
-			cv::Mat_<float> proj_points;
-			cv::Mat_<float> mesh_0 = (cv::Mat_<float>(2, 3) << points_left[0].x, points_left[0].y, points_left[0].z, points_left[1].x, points_left[1].y, points_left[1].z);
-			Project(proj_points, mesh_0, fx, fy, cx, cy);
-			cv::line(captured_image, cv::Point(cvRound(proj_points.at<float>(0, 0) * (float)draw_multiplier), cvRound(proj_points.at<float>(0, 1) * (float)draw_multiplier)),
-				cv::Point(cvRound(proj_points.at<float>(1, 0) * (float)draw_multiplier), cvRound(proj_points.at<float>(1, 1) * (float)draw_multiplier)), cv::Scalar(110, 220, 0), 2, cv::LINE_AA, draw_shiftbits);
+	cv::Mat_<float> proj_points;
+	cv::Mat_<float> mesh_0 = (cv::Mat_<float>(2, 3) << points_left[0].x, points_left[0].y, points_left[0].z, points_left[1].x, points_left[1].y, points_left[1].z);
+	Project(proj_points, mesh_0, fx, fy, cx, cy);
+	cv::line(canvas, cv::Point(cvRound(proj_points.at<float>(0, 0) * (float)draw_multiplier), cvRound(proj_points.at<float>(0, 1) * (float)draw_multiplier)),
+		cv::Point(cvRound(proj_points.at<float>(1, 0) * (float)draw_multiplier), cvRound(proj_points.at<float>(1, 1) * (float)draw_multiplier)), cv::Scalar(110, 220, 0), 2, cv::LINE_AA, draw_shiftbits);
 
-			cv::Mat_<float> mesh_1 = (cv::Mat_<float>(2, 3) << points_right[0].x, points_right[0].y, points_right[0].z, points_right[1].x, points_right[1].y, points_right[1].z);
-			Project(proj_points, mesh_1, fx, fy, cx, cy);
-			cv::line(captured_image, cv::Point(cvRound(proj_points.at<float>(0, 0) * (float)draw_multiplier), cvRound(proj_points.at<float>(0, 1) * (float)draw_multiplier)),
-				cv::Point(cvRound(proj_points.at<float>(1, 0) * (float)draw_multiplier), cvRound(proj_points.at<float>(1, 1) * (float)draw_multiplier)), cv::Scalar(110, 220, 0), 2, cv::LINE_AA, draw_shiftbits);
+	cv::Mat_<float> mesh_1 = (cv::Mat_<float>(2, 3) << points_right[0].x, points_right[0].y, points_right[0].z, points_right[1].x, points_right[1].y, points_right[1].z);
+	Project(proj_points, mesh_1, fx, fy, cx, cy);
+	cv::line(canvas, cv::Point(cvRound(proj_points.at<float>(0, 0) * (float)draw_multiplier), cvRound(proj_points.at<float>(0, 1) * (float)draw_multiplier)),
+		cv::Point(cvRound(proj_points.at<float>(1, 0) * (float)draw_multiplier), cvRound(proj_points.at<float>(1, 1) * (float)draw_multiplier)), cv::Scalar(110, 220, 0), 2, cv::LINE_AA, draw_shiftbits);
 
-		}
+}
+
+void Visualizer::SetObservationGaze(const cv::Point3f& gaze_direction0, const cv::Point3f& gaze_direction1, const std::vector<cv::Point2f>& eye_landmarks2d, const std::vector<cv::Point3f>& eye_landmarks3d, double confidence)
+{
+	if(confidence > visualisation_boundary && eye_landmarks2d.size() > 0)
+	{
+		float fx = this->fx, fy = this->fy, cx = this->cx, cy = this->cy;
+		draw_commands.push_back([gaze_direction0, gaze_direction1, eye_landmarks2d, eye_landmarks3d, fx, fy, cx, cy](cv::Mat& canvas)
+		{
+			DrawGaze(canvas, gaze_direction0, gaze_direction1, eye_landmarks2d, eye_landmarks3d, fx, fy, cx, cy);
+		});
 	}
 }
 
@@ -406,7 +440,33 @@ void Visualizer::SetFps(double fps)
 	std::sprintf(fpsC, "%d", (int)fps);
 	std::string fpsSt("FPS:");
 	fpsSt += fpsC;
-	cv::putText(captured_image, fpsSt, cv::Point(10, 20), cv::FONT_HERSHEY_SIMPLEX, 0.5, CV_RGB(255, 0, 0), 1, cv::LINE_AA);
+	draw_commands.push_back([fpsSt](cv::Mat& canvas)
+	{
+		cv::putText(canvas, fpsSt, cv::Point(10, 20), cv::FONT_HERSHEY_SIMPLEX, 0.5, CV_RGB(255, 0, 0), 1, cv::LINE_AA);
+	});
+}
+
+// Copying the frame and drawing everything on it, only done the first time the visualization is needed
+void Visualizer::Render()
+{
+	if (rendered)
+	{
+		return;
+	}
+
+	captured_image = canvas_pool.Copy(frame);
+	if (!captured_image.empty())
+	{
+		for (size_t i = 0; i < draw_commands.size(); ++i)
+		{
+			draw_commands[i](captured_image);
+		}
+	}
+
+	// The original frame is not needed anymore
+	frame = cv::Mat();
+	draw_commands.clear();
+	rendered = true;
 }
 
 char Visualizer::ShowObservation()
@@ -430,6 +490,7 @@ char Visualizer::ShowObservation()
 	}
 	if (vis_track)
 	{
+		Render();
 		cv::imshow("tracking result", captured_image);
 		ovservation_shown = true;
 	}
@@ -446,6 +507,7 @@ char Visualizer::ShowObservation()
 
 cv::Mat Visualizer::GetVisImage()
 {
+	Render();
 	return captured_image;
 }
 